@@ -0,0 +1,123 @@
+/*
+ * Micro-benchmark for buf_set_buf()/bit_copy(), comparing the word at a
+ * time implementation in src/helper/binarybuffer.c with the bit by bit
+ * loop it replaced, for field sizes from 1 to 100000 bits and every
+ * combination of source and destination bit offsets.
+ *
+ * Build it from a configured build directory, e.g.
+ *
+ *   cc -O2 -DHAVE_CONFIG_H -I. -I$SRC/src -I$SRC/src/helper \
+ *      -I$SRC/jimtcl -Ijimtcl -o bit_copy_bench \
+ *      $SRC/contrib/bit_copy_bench.c $SRC/src/helper/binarybuffer.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <helper/binarybuffer.h>
+
+/* the previous buf_set_buf(), kept as reference */
+static void bit_copy_reference(uint8_t *dst, unsigned dst_start,
+	const uint8_t *src, unsigned src_start, unsigned len)
+{
+	unsigned sq = src_start % 8;
+	unsigned dq = dst_start % 8;
+
+	src += src_start / 8;
+	dst += dst_start / 8;
+
+	for (unsigned i = 0; i < len; i++) {
+		if (((*src >> sq) & 1) == 1)
+			*dst |= 1 << dq;
+		else
+			*dst &= ~(1 << dq);
+		if (sq++ == 7) {
+			sq = 0;
+			src++;
+		}
+		if (dq++ == 7) {
+			dq = 0;
+			dst++;
+		}
+	}
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void)
+{
+	static const unsigned sizes[] = { 1, 7, 8, 13, 32, 64, 100, 1000, 10000, 100000 };
+	const unsigned bytes = 100000 / 8 + 2;
+	uint8_t *src = malloc(bytes);
+	uint8_t *ref = malloc(bytes);
+	uint8_t *dst = malloc(bytes);
+
+	if (!src || !ref || !dst)
+		return 1;
+
+	srand(1);
+	for (unsigned i = 0; i < bytes; i++)
+		src[i] = rand();
+
+	/* check every offset combination against the reference first */
+	for (unsigned s = 0; s < ARRAY_SIZE(sizes); s++) {
+		for (unsigned so = 0; so < 8; so++) {
+			for (unsigned dof = 0; dof < 8; dof++) {
+				memset(ref, 0x5a, bytes);
+				memset(dst, 0x5a, bytes);
+				bit_copy_reference(ref, dof, src, so, sizes[s]);
+				bit_copy(dst, dof, src, so, sizes[s]);
+				if (memcmp(ref, dst, bytes)) {
+					printf("MISMATCH: %u bits, src offset %u, dst offset %u\n",
+							sizes[s], so, dof);
+					return 1;
+				}
+			}
+		}
+	}
+
+	printf("%8s %14s %14s %8s\n", "bits", "reference ns", "bit_copy ns", "speedup");
+	for (unsigned s = 0; s < ARRAY_SIZE(sizes); s++) {
+		unsigned len = sizes[s];
+		unsigned rounds = 1 + 20000000 / (len + 64);
+		double t0, t_ref, t_new;
+
+		t0 = now();
+		for (unsigned r = 0; r < rounds; r++)
+			bit_copy_reference(dst, r % 8, src, (r / 8) % 8, len);
+		t_ref = (now() - t0) / rounds * 1e9;
+
+		t0 = now();
+		for (unsigned r = 0; r < rounds; r++)
+			bit_copy(dst, r % 8, src, (r / 8) % 8, len);
+		t_new = (now() - t0) / rounds * 1e9;
+
+		printf("%8u %14.1f %14.1f %7.1fx\n", len, t_ref, t_new, t_ref / t_new);
+	}
+
+	free(src);
+	free(ref);
+	free(dst);
+	return 0;
+}
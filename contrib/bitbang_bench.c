@@ -0,0 +1,209 @@
+/*
+ * Micro-benchmark for the bitbang layer, running DR scans through
+ * bitbang_execute_queue() against the dummy driver's simulated scan chain,
+ * once with the bulk tms_seq()/shift_buf() callbacks and once with the
+ * per bit write()/read() calls they replace.  The captured data of both
+ * runs is compared, so it doubles as a consistency check.
+ *
+ * Build it from a configured build directory, e.g.
+ *
+ *   cc -O2 -DHAVE_CONFIG_H -I. -I$SRC/src -I$SRC/src/helper \
+ *      -I$SRC/src/jtag -I$SRC/src/jtag/drivers \
+ *      -I$SRC/jimtcl -Ijimtcl -o bitbang_bench \
+ *      $SRC/contrib/bitbang_bench.c $SRC/src/helper/binarybuffer.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* the drivers are built right into the benchmark, with just enough of
+ * the JTAG core around them to execute a queue */
+#include "jtag/interface.c"
+#include "jtag/drivers/bitbang.c"
+#include "jtag/drivers/dummy.c"
+
+#define BENCH_SCANS     64
+#define BENCH_SCAN_BITS 32768
+#define BENCH_ROUNDS    8
+
+struct jtag_command *jtag_command_queue;
+struct jtag_interface *jtag_interface;
+const char * const jtag_only[] = { "jtag", NULL };
+const struct command_registration hello_command_handlers[] = {
+	COMMAND_REGISTRATION_DONE
+};
+int debug_level = LOG_LVL_USER;
+
+int jtag_build_buffer(const struct scan_command *cmd, uint8_t **buffer)
+{
+	int bit_count = jtag_scan_size(cmd);
+
+	*buffer = calloc(1, DIV_ROUND_UP(bit_count, 8));
+	bit_count = 0;
+	for (int i = 0; i < cmd->num_fields; i++) {
+		if (cmd->fields[i].out_value)
+			buf_set_buf(cmd->fields[i].out_value, 0, *buffer, bit_count,
+					cmd->fields[i].num_bits);
+		bit_count += cmd->fields[i].num_bits;
+	}
+	return bit_count;
+}
+
+int jtag_read_buffer(uint8_t *buffer, const struct scan_command *cmd)
+{
+	int bit_count = 0;
+
+	for (int i = 0; i < cmd->num_fields; i++) {
+		if (cmd->fields[i].in_value)
+			buf_set_buf(buffer, bit_count, cmd->fields[i].in_value, 0,
+					cmd->fields[i].num_bits);
+		bit_count += cmd->fields[i].num_bits;
+	}
+	return ERROR_OK;
+}
+
+int jtag_scan_size(const struct scan_command *cmd)
+{
+	int bit_count = 0;
+
+	for (int i = 0; i < cmd->num_fields; i++)
+		bit_count += cmd->fields[i].num_bits;
+	return bit_count;
+}
+
+enum scan_type jtag_scan_type(const struct scan_command *cmd)
+{
+	int type = 0;
+
+	for (int i = 0; i < cmd->num_fields; i++) {
+		if (cmd->fields[i].in_value)
+			type |= SCAN_IN;
+		if (cmd->fields[i].out_value)
+			type |= SCAN_OUT;
+	}
+	return type;
+}
+
+void jtag_sleep(uint32_t us)
+{
+}
+
+int jtag_get_flush_queue_count(void)
+{
+	return 0;
+}
+
+enum reset_types jtag_get_reset_config(void)
+{
+	return RESET_NONE;
+}
+
+void command_print(struct command_context *context, const char *format, ...)
+{
+}
+
+int parse_uint(const char *str, unsigned *ul)
+{
+	return ERROR_FAIL;
+}
+
+int parse_u32(const char *str, uint32_t *ul)
+{
+	return ERROR_FAIL;
+}
+
+int parse_u64(const char *str, uint64_t *ul)
+{
+	return ERROR_FAIL;
+}
+
+void log_printf_lf(enum log_levels level, const char *file, unsigned line,
+		const char *function, const char *format, ...)
+{
+}
+
+static struct scan_field bench_fields[BENCH_SCANS];
+static struct scan_command bench_scans[BENCH_SCANS];
+static struct jtag_command bench_cmds[BENCH_SCANS];
+
+static double bench_run(uint8_t *in)
+{
+	struct timespec start, end;
+
+	for (int i = 0; i < BENCH_SCANS; i++)
+		bench_fields[i].in_value = in + i * BENCH_SCAN_BITS / 8;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int round = 0; round < BENCH_ROUNDS; round++)
+		bitbang_execute_queue();
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int main(void)
+{
+	size_t size = BENCH_SCANS * BENCH_SCAN_BITS / 8;
+	uint8_t *out = malloc(size);
+	uint8_t *in_bulk = malloc(size);
+	uint8_t *in_bits = malloc(size);
+
+	srand(1);
+	for (size_t i = 0; i < size; i++)
+		out[i] = rand();
+
+	/* two TAPs in BYPASS with a long data register on the first one */
+	struct dummy_tap *tap = dummy_add_tap(4, 0, 0);
+	dummy_add_tap(5, 0, 0);
+	struct dummy_dr *dr = calloc(1, sizeof(*dr));
+	dr->instruction = tap->ir;
+	dr->length = 64;
+	tap->drs = dr;
+
+	for (int i = 0; i < BENCH_SCANS; i++) {
+		bench_fields[i].num_bits = BENCH_SCAN_BITS;
+		bench_fields[i].out_value = out + i * BENCH_SCAN_BITS / 8;
+		bench_scans[i].num_fields = 1;
+		bench_scans[i].fields = &bench_fields[i];
+		bench_scans[i].end_state = TAP_IDLE;
+		bench_cmds[i].type = JTAG_SCAN;
+		bench_cmds[i].cmd.scan = &bench_scans[i];
+		bench_cmds[i].next = i + 1 < BENCH_SCANS ? &bench_cmds[i + 1] : NULL;
+	}
+	jtag_command_queue = &bench_cmds[0];
+
+	dummy_init();
+	double bits = (double)BENCH_SCANS * BENCH_SCAN_BITS * BENCH_ROUNDS;
+
+	double bulk = bench_run(in_bulk);
+	printf("%-16s %8.2f Mbit/s\n", "shift_buf():", bits / bulk / 1e6);
+
+	dummy_bitbang.tms_seq = NULL;
+	dummy_bitbang.shift_buf = NULL;
+	double per_bit = bench_run(in_bits);
+	printf("%-16s %8.2f Mbit/s\n", "write()/read():", bits / per_bit / 1e6);
+
+	printf("speedup %.2fx, captured data %s\n", per_bit / bulk,
+			memcmp(in_bulk, in_bits, size) ? "DIFFERS" : "matches");
+
+	free(out);
+	free(in_bulk);
+	free(in_bits);
+	return 0;
+}
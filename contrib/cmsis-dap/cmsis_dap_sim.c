@@ -0,0 +1,591 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.           *
+ ***************************************************************************/
+
+/*
+  A software CMSIS-DAP for the "socket" backend of OpenOCD's cmsis-dap
+  driver.  It models an SWD-DP with one MEM-AP in front of a block of RAM,
+  so queue handling, packet packing and the error paths of the driver can
+  be exercised and timed without a probe.  Packets are read from stdin and
+  answered on stdout, each framed by a u16 little endian length.
+
+  To compile run:
+  gcc -Wall -O2 -std=gnu99 -o cmsis_dap_sim cmsis_dap_sim.c
+
+  Options:
+  -s bytes   packet size reported to the driver (default 64)
+  -c count   packet count reported to the driver (default 4)
+  -b addr    RAM base address (default 0x20000000)
+  -m bytes   RAM size (default 65536)
+  -l usec    round trip latency of the link, paid by each packet that the
+             driver hadn't sent yet when the previous one was answered (default 0)
+  -w n       make every n-th AP access answer WAIT ...
+  -W tries   ... for that many tries, the driver's retry count applies (default 1)
+  -f n       make every n-th AP access answer FAULT and set STICKYERR
+
+  Usage example:
+
+  socat TCP-LISTEN:5555,reuseaddr,fork EXEC:"./cmsis_dap_sim -l 1000"
+
+  openocd -c "interface cmsis-dap; cmsis_dap_backend socket; cmsis_dap_socket_port 5555" \
+	  -c "transport select swd" -f target/stm32f1x.cfg
+
+  Statistics are printed on stderr when the driver disconnects.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+
+#define CMD_DAP_INFO              0x00
+#define CMD_DAP_LED               0x01
+#define CMD_DAP_CONNECT           0x02
+#define CMD_DAP_DISCONNECT        0x03
+#define CMD_DAP_TFER_CONFIGURE    0x04
+#define CMD_DAP_TFER              0x05
+#define CMD_DAP_TFER_BLOCK        0x06
+#define CMD_DAP_TFER_ABORT        0x07
+#define CMD_DAP_WRITE_ABORT       0x08
+#define CMD_DAP_DELAY             0x09
+#define CMD_DAP_RESET_TARGET      0x0A
+#define CMD_DAP_SWJ_PINS          0x10
+#define CMD_DAP_SWJ_CLOCK         0x11
+#define CMD_DAP_SWJ_SEQ           0x12
+#define CMD_DAP_SWD_CONFIGURE     0x13
+#define CMD_DAP_INVALID           0xFF
+
+#define DAP_OK                    0
+#define DAP_ERROR                 0xFF
+
+/* transfer request bits */
+#define TFER_APnDP                0x01
+#define TFER_RnW                  0x02
+#define TFER_A32                  0x0C
+#define TFER_MATCH_VALUE          0x10
+#define TFER_MATCH_MASK           0x20
+
+/* transfer response bits */
+#define ACK_OK                    0x01
+#define ACK_WAIT                  0x02
+#define ACK_FAULT                 0x04
+#define TFER_MISMATCH             0x10
+
+/* DP registers and bits */
+#define DP_IDCODE                 0x00
+#define DP_ABORT                  0x00
+#define DP_CTRL_STAT              0x04
+#define DP_SELECT                 0x08
+#define DP_RDBUFF                 0x0C
+
+#define DP_IDCODE_VALUE           0x2ba01477
+#define STICKYORUN                (1u << 1)
+#define STICKYERR                 (1u << 5)
+#define WDATAERR                  (1u << 7)
+#define CDBGPWRUPREQ              (1u << 28)
+#define CSYSPWRUPREQ              (1u << 30)
+
+#define ABORT_STKERRCLR           (1u << 2)
+#define ABORT_WDERRCLR            (1u << 3)
+#define ABORT_ORUNERRCLR          (1u << 4)
+
+/* MEM-AP registers */
+#define AP_CSW                    0x00
+#define AP_TAR                    0x04
+#define AP_DRW                    0x0C
+#define AP_BD0                    0x10
+#define AP_CFG                    0xF4
+#define AP_BASE                   0xF8
+#define AP_IDR                    0xFC
+
+#define AP_IDR_VALUE              0x24770011
+#define CSW_DEVICEEN              (1u << 6)
+
+static unsigned packet_size = 64;
+static unsigned packet_count = 4;
+static uint32_t ram_base = 0x20000000;
+static uint32_t ram_size = 65536;
+static uint8_t *ram;
+static unsigned latency_us;
+static unsigned wait_every, wait_tries = 1, fault_every;
+
+/* DP and MEM-AP state */
+static uint32_t ctrl_stat, select_reg, rdbuff;
+static uint32_t csw = CSW_DEVICEEN | 2, tar;
+static uint16_t wait_retry = 64, match_retry;
+static uint32_t match_mask = 0xffffffff;
+
+/* injection bookkeeping */
+static unsigned long ap_accesses;
+static unsigned busy_left;
+
+static unsigned long stat_packets, stat_transfers, stat_waits, stat_faults;
+
+static uint32_t get_u32(const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static bool ram_access(uint32_t address, unsigned size, bool read, uint32_t *value)
+{
+	if (address < ram_base || address - ram_base > ram_size - size)
+		return false;
+
+	uint8_t *p = ram + (address - ram_base);
+	unsigned lane = address & 3;
+
+	if (read) {
+		uint32_t v = 0;
+		for (unsigned i = 0; i < size; i++)
+			v |= p[i] << (8 * (lane + i));
+		*value = v;
+	} else {
+		for (unsigned i = 0; i < size; i++)
+			p[i] = *value >> (8 * (lane + i));
+	}
+	return true;
+}
+
+/* one DRW or BDx access, with the TAR increment of the CSW */
+static bool mem_ap_data(unsigned reg, bool read, uint32_t *value)
+{
+	unsigned size = 1u << (csw & 7);
+	if (size > 4)
+		size = 4;
+
+	if (reg != AP_DRW) {
+		uint32_t address = (tar & ~0xfu) | (reg - AP_BD0);
+		return ram_access(address, 4, read, value);
+	}
+
+	bool ok = ram_access(tar & ~(size - 1), size, read, value);
+
+	/* increments stay inside a 1 KB block */
+	if (csw & 0x30)
+		tar = (tar & ~0x3ffu) | ((tar + size) & 0x3ff);
+	return ok;
+}
+
+/* an AP access as seen on the wire, @returns the ACK */
+static int ap_access(unsigned reg, bool read, uint32_t *value)
+{
+	ap_accesses++;
+
+	if (busy_left) {
+		busy_left--;
+		return ACK_WAIT;
+	}
+	if (wait_every && ap_accesses % wait_every == 0) {
+		busy_left = wait_tries - 1;
+		return ACK_WAIT;
+	}
+	if (fault_every && ap_accesses % fault_every == 0) {
+		ctrl_stat |= STICKYERR;
+		return ACK_FAULT;
+	}
+
+	uint32_t v = read ? 0 : *value;
+	bool ok = true;
+
+	if (select_reg >> 24 != 0) {
+		/* nothing but MEM-AP 0 */
+		v = 0;
+	} else {
+		reg |= select_reg & 0xf0;
+		switch (reg) {
+			case AP_CSW:
+				if (read)
+					v = csw;
+				else
+					csw = v | CSW_DEVICEEN;
+				break;
+			case AP_TAR:
+				if (read)
+					v = tar;
+				else
+					tar = v;
+				break;
+			case AP_DRW:
+			case AP_BD0:
+			case AP_BD0 + 4:
+			case AP_BD0 + 8:
+			case AP_BD0 + 12:
+				ok = mem_ap_data(reg, read, &v);
+				break;
+			case AP_BASE:
+				v = 0xffffffff;
+				break;
+			case AP_IDR:
+				v = AP_IDR_VALUE;
+				break;
+			default:
+				v = 0;
+				break;
+		}
+	}
+
+	if (!ok) {
+		/* a bus error shows up as a sticky error */
+		ctrl_stat |= STICKYERR;
+		return ACK_FAULT;
+	}
+
+	if (read) {
+		rdbuff = v;
+		*value = v;
+	}
+	return ACK_OK;
+}
+
+static void dp_abort(uint32_t value)
+{
+	if (value & ABORT_STKERRCLR)
+		ctrl_stat &= ~STICKYERR;
+	if (value & ABORT_WDERRCLR)
+		ctrl_stat &= ~WDATAERR;
+	if (value & ABORT_ORUNERRCLR)
+		ctrl_stat &= ~STICKYORUN;
+}
+
+static int dp_access(unsigned reg, bool read, uint32_t *value)
+{
+	/* with a sticky error set only IDCODE, ABORT and CTRL/STAT reads
+	 * get through */
+	if ((ctrl_stat & STICKYERR) && reg != DP_IDCODE && !(read && reg == DP_CTRL_STAT))
+		return ACK_FAULT;
+
+	switch (reg) {
+		case DP_IDCODE:
+			if (read)
+				*value = DP_IDCODE_VALUE;
+			else
+				dp_abort(*value);
+			break;
+		case DP_CTRL_STAT:
+			if (read) {
+				/* power up requests are acknowledged right away */
+				*value = ctrl_stat | (ctrl_stat & (CDBGPWRUPREQ | CSYSPWRUPREQ)) << 1;
+			} else
+				ctrl_stat = (*value & ~(STICKYERR | WDATAERR | STICKYORUN))
+					| (ctrl_stat & (STICKYERR | WDATAERR | STICKYORUN));
+			break;
+		case DP_SELECT:
+			if (read)
+				*value = 0;
+			else
+				select_reg = *value;
+			break;
+		case DP_RDBUFF:
+			if (read)
+				*value = rdbuff;
+			break;
+	}
+	return ACK_OK;
+}
+
+/* one transfer with the probe retrying WAIT, @returns the ACK */
+static int transfer(uint8_t request, uint32_t *value)
+{
+	bool read = request & TFER_RnW;
+	unsigned reg = request & TFER_A32;
+	int ack;
+
+	stat_transfers++;
+
+	if (!(request & TFER_APnDP))
+		return dp_access(reg, read, value);
+
+	if (ctrl_stat & STICKYERR)
+		return ACK_FAULT;
+
+	for (unsigned retry = 0; ; retry++) {
+		ack = ap_access(reg, read, value);
+		if (ack != ACK_WAIT)
+			break;
+		stat_waits++;
+		if (retry >= wait_retry)
+			break;
+	}
+	if (ack == ACK_FAULT)
+		stat_faults++;
+	return ack;
+}
+
+/* DAP_Transfer, @returns the response length */
+static unsigned cmd_transfer(const uint8_t *req, unsigned req_len, uint8_t *resp)
+{
+	unsigned count = req[2];
+	unsigned pos = 3, out = 3, done = 0;
+	uint8_t status = ACK_OK;
+
+	for (; done < count && pos < req_len; done++) {
+		uint8_t request = req[pos++];
+		uint32_t value = 0;
+
+		if (!(request & TFER_RnW) || (request & (TFER_MATCH_VALUE | TFER_MATCH_MASK))) {
+			if (pos + 4 > req_len)
+				break;
+			value = get_u32(req + pos);
+			pos += 4;
+		}
+
+		if (request & TFER_MATCH_MASK) {
+			match_mask = value;
+			continue;
+		}
+
+		if (request & TFER_MATCH_VALUE) {
+			uint32_t match = value;
+			unsigned retry = 0;
+
+			do {
+				status = transfer(request, &value);
+			} while (status == ACK_OK && (value & match_mask) != match
+					&& retry++ < match_retry);
+			if (status == ACK_OK && (value & match_mask) != match)
+				status |= TFER_MISMATCH;
+		} else {
+			status = transfer(request, &value);
+			if (status == ACK_OK && (request & TFER_RnW)) {
+				put_u32(resp + out, value);
+				out += 4;
+			}
+		}
+
+		if (status != ACK_OK)
+			break;
+	}
+
+	/* the count is of the transfers that went through */
+	resp[1] = done;
+	resp[2] = status;
+	return out;
+}
+
+/* DAP_TransferBlock, @returns the response length */
+static unsigned cmd_transfer_block(const uint8_t *req, unsigned req_len, uint8_t *resp)
+{
+	unsigned count = req[2] | req[3] << 8;
+	uint8_t request = req[4];
+	unsigned pos = 5, out = 4, done = 0;
+	uint8_t status = ACK_OK;
+
+	for (; done < count; done++) {
+		uint32_t value = 0;
+
+		if (!(request & TFER_RnW)) {
+			if (pos + 4 > req_len)
+				break;
+			value = get_u32(req + pos);
+			pos += 4;
+		} else if (out + 4 > packet_size)
+			break;
+
+		status = transfer(request, &value);
+		if (status != ACK_OK)
+			break;
+		if (request & TFER_RnW) {
+			put_u32(resp + out, value);
+			out += 4;
+		}
+	}
+
+	resp[1] = done;
+	resp[2] = done >> 8;
+	resp[3] = status;
+	return out;
+}
+
+static unsigned cmd_info(uint8_t id, uint8_t *resp)
+{
+	static const char fw_version[] = "sim";
+
+	switch (id) {
+		case 0x04:
+			resp[1] = sizeof(fw_version);
+			memcpy(resp + 2, fw_version, sizeof(fw_version));
+			return 2 + sizeof(fw_version);
+		case 0xF0:
+			resp[1] = 1;
+			resp[2] = 0x01;	/* SWD */
+			return 3;
+		case 0xFE:
+			resp[1] = 1;
+			resp[2] = packet_count;
+			return 3;
+		case 0xFF:
+			resp[1] = 2;
+			resp[2] = packet_size;
+			resp[3] = packet_size >> 8;
+			return 4;
+		default:
+			resp[1] = 0;
+			return 2;
+	}
+}
+
+/* @returns the response length, 0 for no response */
+static unsigned handle(const uint8_t *req, unsigned len, uint8_t *resp)
+{
+	resp[0] = req[0];
+	resp[1] = DAP_OK;
+
+	switch (req[0]) {
+		case CMD_DAP_INFO:
+			return cmd_info(len > 1 ? req[1] : 0, resp);
+		case CMD_DAP_CONNECT:
+			/* SWD only */
+			resp[1] = len > 1 && req[1] <= 1 ? 1 : 0;
+			return 2;
+		case CMD_DAP_TFER_CONFIGURE:
+			if (len >= 6) {
+				wait_retry = req[2] | req[3] << 8;
+				match_retry = req[4] | req[5] << 8;
+			}
+			return 2;
+		case CMD_DAP_TFER:
+			return len >= 3 ? cmd_transfer(req, len, resp) : 0;
+		case CMD_DAP_TFER_BLOCK:
+			return len >= 5 ? cmd_transfer_block(req, len, resp) : 0;
+		case CMD_DAP_TFER_ABORT:
+			return 0;
+		case CMD_DAP_WRITE_ABORT:
+			if (len >= 6)
+				dp_abort(get_u32(req + 2));
+			return 2;
+		case CMD_DAP_SWJ_PINS:
+			/* nRESET and nTRST high, SWDIO high */
+			resp[1] = 0xa2;
+			return 2;
+		case CMD_DAP_RESET_TARGET:
+			resp[2] = 0;
+			return 3;
+		case CMD_DAP_LED:
+		case CMD_DAP_DISCONNECT:
+		case CMD_DAP_DELAY:
+		case CMD_DAP_SWJ_CLOCK:
+		case CMD_DAP_SWJ_SEQ:
+		case CMD_DAP_SWD_CONFIGURE:
+			return 2;
+		default:
+			resp[0] = CMD_DAP_INVALID;
+			return 1;
+	}
+}
+
+static bool read_all(void *data, size_t size)
+{
+	uint8_t *p = data;
+
+	while (size > 0) {
+		ssize_t n = read(STDIN_FILENO, p, size);
+		if (n <= 0)
+			return false;
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+static bool write_all(const void *data, size_t size)
+{
+	const uint8_t *p = data;
+
+	while (size > 0) {
+		ssize_t n = write(STDOUT_FILENO, p, size);
+		if (n <= 0)
+			return false;
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "s:c:b:m:l:w:W:f:")) != -1) {
+		unsigned long v = strtoul(optarg, NULL, 0);
+		switch (c) {
+			case 's': packet_size = v; break;
+			case 'c': packet_count = v; break;
+			case 'b': ram_base = v; break;
+			case 'm': ram_size = v; break;
+			case 'l': latency_us = v; break;
+			case 'w': wait_every = v; break;
+			case 'W': wait_tries = v; break;
+			case 'f': fault_every = v; break;
+			default:
+				fprintf(stderr, "usage: %s [-s packet_size] [-c packet_count] "
+						"[-b ram_base] [-m ram_size] [-l latency_us] "
+						"[-w wait_every [-W wait_tries]] [-f fault_every]\n", argv[0]);
+				return 1;
+		}
+	}
+
+	if (packet_size < 8 || packet_size > 0xffff || ram_size < 4 || wait_tries == 0) {
+		fprintf(stderr, "invalid option value\n");
+		return 1;
+	}
+
+	ram = calloc(1, ram_size);
+	uint8_t *req = malloc(0x10000);
+	uint8_t *resp = malloc(packet_size + 4);
+	if (!ram || !req || !resp)
+		return 1;
+
+	for (;;) {
+		uint8_t header[2];
+
+		/* a packet that was already waiting didn't need a round trip */
+		struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+		if (latency_us && poll(&pfd, 1, 0) == 0)
+			usleep(latency_us);
+
+		if (!read_all(header, 2))
+			break;
+		unsigned len = header[0] | header[1] << 8;
+		if (len == 0 || len > packet_size || !read_all(req, len))
+			break;
+
+		stat_packets++;
+
+		unsigned resp_len = handle(req, len, resp);
+		if (resp_len == 0)
+			continue;
+
+		header[0] = resp_len;
+		header[1] = resp_len >> 8;
+		if (!write_all(header, 2) || !write_all(resp, resp_len))
+			break;
+	}
+
+	fprintf(stderr, "%lu packets, %lu transfers, %lu WAIT, %lu FAULT\n",
+			stat_packets, stat_transfers, stat_waits, stat_faults);
+	return 0;
+}
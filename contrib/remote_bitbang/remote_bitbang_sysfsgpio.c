@@ -293,6 +293,52 @@ static void cleanup_all_fds(void)
 	cleanup_fd(srst_fd, srst_gpio);
 }
 
+/*
+ * Version 2 shift: a 16 bit little endian bit count, then the TMS, TDI
+ * and sample vectors.  Sampled TDO bits are sent back packed the same way.
+ */
+static int process_shift(void)
+{
+	unsigned char tms[512], tdi[512], sample[512], tdo[512];
+	int lo = getchar();
+	int hi = getchar();
+
+	if (lo == EOF || hi == EOF)
+		return -1;
+
+	unsigned n = lo | (hi << 8);
+	unsigned size = (n + 7) / 8;
+	if (size > sizeof(tms)) {
+		LOG_ERROR("Shift of %u bits is too long", n);
+		return -1;
+	}
+
+	if (fread(tms, 1, size, stdin) != size
+			|| fread(tdi, 1, size, stdin) != size
+			|| fread(sample, 1, size, stdin) != size)
+		return -1;
+
+	unsigned sampled = 0;
+	memset(tdo, 0, size);
+	for (unsigned i = 0; i < n; i++) {
+		int mask = 1 << (i % 8);
+		int tms_bit = !!(tms[i / 8] & mask);
+		int tdi_bit = !!(tdi[i / 8] & mask);
+
+		sysfsgpio_write(0, tms_bit, tdi_bit);
+		if (sample[i / 8] & mask) {
+			if (sysfsgpio_read() == '1')
+				tdo[sampled / 8] |= 1 << (sampled % 8);
+			sampled++;
+		}
+		sysfsgpio_write(1, tms_bit, tdi_bit);
+	}
+
+	if (sampled)
+		fwrite(tdo, 1, (sampled + 7) / 8, stdout);
+	return 0;
+}
+
 static void process_remote_protocol(void)
 {
 	int c;
@@ -313,7 +359,12 @@ static void process_remote_protocol(void)
 					(d & 1));
 		} else if (c == 'R')
 			putchar(sysfsgpio_read());
-		else
+		else if (c == 'V') /* protocol version */
+			putchar('2');
+		else if (c == 'S') { /* shift */
+			if (process_shift() < 0)
+				break;
+		} else
 			LOG_ERROR("Unknown command '%c' received", c);
 	}
 }
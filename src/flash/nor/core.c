@@ -37,6 +37,8 @@
  */
 
 static struct flash_bank *flash_banks;
+/* changes with the list of banks or the layout of one of them */
+static unsigned flash_banks_generation;
 
 int flash_driver_erase(struct flash_bank *bank, int first, int last)
 {
@@ -137,6 +139,17 @@ void flash_bank_add(struct flash_bank *bank)
 		flash_banks = bank;
 
 	bank->bank_number = bank_num;
+	flash_banks_generation++;
+}
+
+void flash_bank_layout_changed(struct flash_bank *bank)
+{
+	flash_banks_generation++;
+}
+
+unsigned flash_get_bank_generation(void)
+{
+	return flash_banks_generation;
 }
 
 struct flash_bank *flash_bank_list(void)
@@ -764,3 +777,147 @@ int flash_write(struct target *target, struct image *image,
 {
 	return flash_write_unlock(target, image, written, erase, false);
 }
+
+void flash_stream_init(struct flash_stream *stream, struct target *target)
+{
+	memset(stream, 0, sizeof(*stream));
+	stream->target = target;
+	stream->retval = ERROR_OK;
+}
+
+/* programs the pending data, padded up to pad_to if that is past it */
+static int flash_stream_flush(struct flash_stream *stream, uint32_t pad_to)
+{
+	struct flash_bank *bank = stream->bank;
+
+	if (!stream->pending)
+		return ERROR_OK;
+	stream->pending = false;
+
+	if (pad_to > stream->end) {
+		memset(stream->buffer + (stream->end - stream->start),
+				bank->default_padded_value, pad_to - stream->end);
+		stream->end = pad_to;
+	}
+
+	int retval = flash_driver_write(bank, stream->buffer,
+			stream->start - bank->base, stream->end - stream->start);
+	if (retval != ERROR_OK) {
+		stream->retval = retval;
+		return retval;
+	}
+
+	stream->written += stream->end - stream->start;
+	return ERROR_OK;
+}
+
+/* the sector of the current bank holding addr, or all of it if the
+ * driver doesn't tell */
+static void flash_stream_sector(struct flash_stream *stream, uint32_t addr,
+		uint32_t *sector_start, uint32_t *sector_end)
+{
+	struct flash_bank *bank = stream->bank;
+	uint32_t offset = addr - bank->base;
+
+	for (int i = 0; i < bank->num_sectors; i++) {
+		struct flash_sector *sector = &bank->sectors[i];
+		if (offset >= sector->offset && offset - sector->offset < sector->size) {
+			*sector_start = bank->base + sector->offset;
+			*sector_end = *sector_start + sector->size;
+			return;
+		}
+	}
+
+	*sector_start = bank->base;
+	*sector_end = bank->base + bank->size;
+}
+
+int flash_stream_write(struct flash_stream *stream, uint32_t addr,
+		const uint8_t *data, uint32_t count)
+{
+	struct flash_bank *bank = stream->bank;
+	int retval;
+
+	while (count > 0 && stream->retval == ERROR_OK) {
+		bool in_bank = bank && addr >= bank->base && addr - bank->base < bank->size;
+
+		if (stream->pending && addr >= stream->end && addr < stream->sector_end) {
+			/* more of the current sector, pad the gap as flash_write() would */
+			memset(stream->buffer + (stream->end - stream->start),
+					bank->default_padded_value, addr - stream->end);
+			stream->end = addr;
+		} else if (in_bank && addr >= stream->end) {
+			/* a later sector of the same bank, the current one is done */
+			if (flash_stream_flush(stream, stream->sector_end) != ERROR_OK)
+				break;
+		} else {
+			/* another bank, or data out of order: start over */
+			if (flash_stream_flush(stream, 0) != ERROR_OK)
+				break;
+			retval = get_flash_bank_by_addr(stream->target, addr, false, &bank);
+			if (retval != ERROR_OK) {
+				stream->retval = retval;
+				break;
+			}
+			stream->bank = bank;
+			if (bank == NULL) {
+				/* like flash_write(), skip data outside of flash */
+				LOG_WARNING("no flash bank found for address %" PRIx32, addr);
+				break;
+			}
+			in_bank = false;
+		}
+
+		if (!stream->pending) {
+			uint32_t sector_start;
+			flash_stream_sector(stream, addr, &sector_start, &stream->sector_end);
+
+			uint32_t size = stream->sector_end - sector_start;
+			if (size > stream->buffer_size) {
+				uint8_t *buffer = realloc(stream->buffer, size);
+				if (buffer == NULL) {
+					LOG_ERROR("Out of memory for flash bank buffer");
+					stream->retval = ERROR_FAIL;
+					break;
+				}
+				stream->buffer = buffer;
+				stream->buffer_size = size;
+			}
+
+			/* a run continuing in this bank is padded from the start
+			 * of the sector, a new run starts at its data */
+			stream->start = in_bank ? sector_start : addr;
+			memset(stream->buffer, bank->default_padded_value, addr - stream->start);
+			stream->end = addr;
+			stream->pending = true;
+		}
+
+		uint32_t n = MIN(count, stream->sector_end - addr);
+		memcpy(stream->buffer + (addr - stream->start), data, n);
+		stream->end = addr + n;
+		addr += n;
+		data += n;
+		count -= n;
+
+		if (stream->end == stream->sector_end)
+			flash_stream_flush(stream, 0);
+	}
+
+	return stream->retval;
+}
+
+int flash_stream_done(struct flash_stream *stream, uint32_t *written)
+{
+	if (stream->retval == ERROR_OK)
+		flash_stream_flush(stream, 0);
+
+	free(stream->buffer);
+	stream->buffer = NULL;
+	stream->buffer_size = 0;
+	stream->pending = false;
+	stream->bank = NULL;
+
+	if (written)
+		*written = stream->written;
+	return stream->retval;
+}
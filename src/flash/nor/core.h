@@ -132,6 +132,45 @@ int flash_unlock_address_range(struct target *target, uint32_t addr,
 int flash_write(struct target *target,
 		struct image *image, uint32_t *written, int erase);
 
+/**
+ * State of programming data that arrives piecewise, in ascending order
+ * of addresses, as GDB sends it with vFlashWrite packets.  Each sector
+ * is programmed as soon as it is complete, gaps within a bank are padded
+ * as flash_write() pads them, and sectors without data are not touched.
+ */
+struct flash_stream {
+	struct target *target;
+	/** Bank of the run being programmed, NULL before the first data. */
+	struct flash_bank *bank;
+	/** Pending data, covering [start, end) of the current sector. */
+	uint8_t *buffer;
+	uint32_t buffer_size;
+	bool pending;
+	uint32_t start;
+	uint32_t end;
+	uint32_t sector_end;
+	/** Bytes programmed so far. */
+	uint32_t written;
+	/** First error, later data is dropped once it is set. */
+	int retval;
+};
+
+/** Prepares @a stream for programming the flash of @a target. */
+void flash_stream_init(struct flash_stream *stream, struct target *target);
+/**
+ * Hands @a count bytes for address @a addr to @a stream, programming
+ * every sector they complete.
+ * @returns The first error of the stream so far, or ERROR_OK.
+ */
+int flash_stream_write(struct flash_stream *stream, uint32_t addr,
+		const uint8_t *data, uint32_t count);
+/**
+ * Programs what is left in @a stream and releases it.
+ * @param written On return, contains the number of bytes written.
+ * @returns The first error of the whole stream, or ERROR_OK.
+ */
+int flash_stream_done(struct flash_stream *stream, uint32_t *written);
+
 /**
  * Forces targets to re-examine their erase/protection state.
  * This routine must be called when the system may modify the status.
@@ -139,6 +178,11 @@ int flash_write(struct target *target,
 void flash_set_dirty(void);
 /** @returns The number of flash banks currently defined. */
 int flash_get_bank_count(void);
+/**
+ * @returns A counter that changes whenever a bank is added or probed
+ * again, for callers caching something derived from the bank layout.
+ */
+unsigned flash_get_bank_generation(void);
 /**
  * Provides default read implementation for flash memory.
  * @param bank The bank to read.
@@ -32,6 +32,14 @@
  */
 void flash_bank_add(struct flash_bank *bank);
 
+/**
+ * Notes that the base, size or sectors of a bank may have changed, as
+ * after an explicit probe, so anything describing the layout of the
+ * banks to a debugger is regenerated.
+ * @param bank The bank that was probed.
+ */
+void flash_bank_layout_changed(struct flash_bank *bank);
+
 /**
  * @return The first bank in the global list.
  */
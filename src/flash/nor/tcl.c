@@ -147,6 +147,7 @@ COMMAND_HANDLER(handle_flash_probe_command)
 
 	if (p) {
 		retval = p->driver->probe(p);
+		flash_bank_layout_changed(p);
 		if (retval == ERROR_OK)
 			command_print(CMD_CTX,
 				"flash '%s' found at 0x%8.8" PRIx32,
@@ -81,7 +81,7 @@ bool buf_cmp(const void *_buf1, const void *_buf2, unsigned size)
 
 	unsigned last = size / 8;
 	if (memcmp(_buf1, _buf2, last) != 0)
-		return false;
+		return true;
 
 	unsigned trailing = size % 8;
 	if (!trailing)
@@ -99,10 +99,14 @@ bool buf_cmp_mask(const void *_buf1, const void *_buf2,
 
 	const uint8_t *buf1 = _buf1, *buf2 = _buf2, *mask = _mask;
 	unsigned last = size / 8;
-	for (unsigned i = 0; i < last; i++) {
-		if (buf_cmp_masked(buf1[i], buf2[i], mask[i]))
-			return true;
-	}
+	uint8_t diff = 0;
+
+	/* no early exit, so the compiler can vectorize this */
+	for (unsigned i = 0; i < last; i++)
+		diff |= (buf1[i] ^ buf2[i]) & mask[i];
+	if (diff)
+		return true;
+
 	unsigned trailing = size % 8;
 	if (!trailing)
 		return false;
@@ -125,46 +129,61 @@ void *buf_set_ones(void *_buf, unsigned size)
 	return buf;
 }
 
+/* the n (1-8) bits of src starting at bit sq (0-7), right aligned */
+static inline uint8_t buf_get_bits8(const uint8_t *src, unsigned sq, unsigned n)
+{
+	unsigned v = src[0] >> sq;
+	if (sq + n > 8)
+		v |= src[1] << (8 - sq);
+	return v & (0xff >> (8 - n));
+}
+
 void *buf_set_buf(const void *_src, unsigned src_start,
 	void *_dst, unsigned dst_start, unsigned len)
 {
-	const uint8_t *src = _src;
-	uint8_t *dst = _dst;
-	unsigned i, sb, db, sq, dq, lb, lq;
-
-	sb = src_start / 8;
-	db = dst_start / 8;
-	sq = src_start % 8;
-	dq = dst_start % 8;
-	lb = len / 8;
-	lq = len % 8;
-
-	src += sb;
-	dst += db;
-
-	/* check if both buffers are on byte boundary and
-	 * len is a multiple of 8bit so we can simple copy
-	 * the buffer */
-	if ((sq == 0) && (dq == 0) &&  (lq == 0)) {
-		for (i = 0; i < lb; i++)
-			*dst++ = *src++;
-		return _dst;
+	const uint8_t *src = (const uint8_t *)_src + src_start / 8;
+	uint8_t *dst = (uint8_t *)_dst + dst_start / 8;
+	unsigned sq = src_start % 8;
+	unsigned dq = dst_start % 8;
+
+	/* bring dst to a byte boundary */
+	if (dq && len) {
+		unsigned n = MIN(8 - dq, len);
+		uint8_t mask = (0xff >> (8 - n)) << dq;
+
+		*dst = (*dst & ~mask) | (buf_get_bits8(src, sq, n) << dq);
+		dst++;
+		len -= n;
+		sq += n;
+		src += sq / 8;
+		sq %= 8;
 	}
 
-	/* fallback to slow bit copy */
-	for (i = 0; i < len; i++) {
-		if (((*src >> (sq&7)) & 1) == 1)
-			*dst |= 1 << (dq&7);
-		else
-			*dst &= ~(1 << (dq&7));
-		if (sq++ == 7) {
-			sq = 0;
-			src++;
-		}
-		if (dq++ == 7) {
-			dq = 0;
-			dst++;
+	if (sq == 0) {
+		memcpy(dst, src, len / 8);
+		src += len / 8;
+		dst += len / 8;
+		len %= 8;
+	} else {
+		/* 64 bits at a time; all nine source bytes hold bits being
+		 * copied, so this never reads past the end of the source */
+		while (len >= 64) {
+			uint64_t v = le_to_h_u64(src) >> sq;
+			v |= (uint64_t)src[8] << (64 - sq);
+			h_u64_to_le(dst, v);
+			src += 8;
+			dst += 8;
+			len -= 64;
 		}
+
+		for (; len >= 8; len -= 8)
+			*dst++ = buf_get_bits8(src++, sq, 8);
+	}
+
+	/* the remaining bits go to the low end of the last dst byte */
+	if (len) {
+		uint8_t mask = 0xff >> (8 - len);
+		*dst = (*dst & ~mask) | buf_get_bits8(src, sq, len);
 	}
 
 	return _dst;
@@ -330,55 +349,79 @@ int str_to_buf(const char *str, unsigned str_len,
 
 void bit_copy_queue_init(struct bit_copy_queue *q)
 {
-	INIT_LIST_HEAD(&q->list);
+	q->entries = q->inline_entries;
+	q->count = 0;
+	q->capacity = ARRAY_SIZE(q->inline_entries);
 }
 
 int bit_copy_queued(struct bit_copy_queue *q, uint8_t *dst, unsigned dst_offset, const uint8_t *src,
 	unsigned src_offset, unsigned bit_count)
 {
-	struct bit_copy_queue_entry *qe = malloc(sizeof(*qe));
-	if (!qe)
-		return ERROR_FAIL;
+	if (q->count == q->capacity) {
+		unsigned capacity = 2 * q->capacity;
+		struct bit_copy_queue_entry *entries;
+
+		if (q->entries == q->inline_entries) {
+			entries = malloc(capacity * sizeof(*entries));
+			if (entries)
+				memcpy(entries, q->entries, q->count * sizeof(*entries));
+		} else
+			entries = realloc(q->entries, capacity * sizeof(*entries));
+		if (!entries)
+			return ERROR_FAIL;
+
+		q->entries = entries;
+		q->capacity = capacity;
+	}
 
+	struct bit_copy_queue_entry *qe = &q->entries[q->count++];
 	qe->dst = dst;
 	qe->dst_offset = dst_offset;
 	qe->src = src;
 	qe->src_offset = src_offset;
 	qe->bit_count = bit_count;
-	list_add_tail(&qe->list, &q->list);
 
 	return ERROR_OK;
 }
 
 void bit_copy_execute(struct bit_copy_queue *q)
 {
-	struct bit_copy_queue_entry *qe;
-	struct bit_copy_queue_entry *tmp;
-	list_for_each_entry_safe(qe, tmp, &q->list, list) {
+	for (unsigned i = 0; i < q->count; i++) {
+		struct bit_copy_queue_entry *qe = &q->entries[i];
 		bit_copy(qe->dst, qe->dst_offset, qe->src, qe->src_offset, qe->bit_count);
-		list_del(&qe->list);
-		free(qe);
 	}
+	q->count = 0;
 }
 
 void bit_copy_discard(struct bit_copy_queue *q)
 {
-	struct bit_copy_queue_entry *qe;
-	struct bit_copy_queue_entry *tmp;
-	list_for_each_entry_safe(qe, tmp, &q->list, list) {
-		list_del(&qe->list);
-		free(qe);
-	}
+	if (q->entries != q->inline_entries)
+		free(q->entries);
+	bit_copy_queue_init(q);
 }
 
+/* value + 1 of each hex digit, 0 for anything else */
+static const uint8_t hex_digit_value[256] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+	['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+	['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+};
+
+static const char hex_digits[] = "0123456789abcdef";
+
 int unhexify(char *bin, const char *hex, int count)
 {
-	int i, tmp;
+	int i;
 
 	for (i = 0; i < count; i++) {
-		if (sscanf(hex + (2 * i), "%02x", &tmp) != 1)
-			return i;
-		bin[i] = tmp;
+		unsigned hi = hex_digit_value[(uint8_t)hex[2 * i]];
+		if (!hi)
+			break;
+		unsigned lo = hex_digit_value[(uint8_t)hex[2 * i + 1]];
+		if (!lo)
+			break;
+		bin[i] = ((hi - 1) << 4) | (lo - 1);
 	}
 
 	return i;
@@ -386,16 +429,22 @@ int unhexify(char *bin, const char *hex, int count)
 
 int hexify(char *hex, const char *bin, int count, int out_maxlen)
 {
-	int i, cmd_len = 0;
+	int i;
 
 	/* May use a length, or a null-terminated string as input. */
 	if (count == 0)
 		count = strlen(bin);
 
-	for (i = 0; i < count; i++)
-		cmd_len += snprintf(hex + cmd_len, out_maxlen - cmd_len, "%02x", bin[i] & 0xff);
+	/* whole digit pairs only, and room for the terminating zero */
+	for (i = 0; i < count && 2 * i + 2 < out_maxlen; i++) {
+		uint8_t b = bin[i];
+		hex[2 * i] = hex_digits[b >> 4];
+		hex[2 * i + 1] = hex_digits[b & 0xf];
+	}
+	if (out_maxlen > 0)
+		hex[2 * i] = '\0';
 
-	return cmd_len;
+	return 2 * i;
 }
 
 void buffer_shr(void *_buf, unsigned buf_len, unsigned count)
@@ -215,17 +215,27 @@ static inline void bit_copy(uint8_t *dst, unsigned dst_offset, const uint8_t *sr
 	buf_set_buf(src, src_offset, dst, dst_offset, bit_count);
 }
 
-struct bit_copy_queue {
-	struct list_head list;
-};
-
 struct bit_copy_queue_entry {
 	uint8_t *dst;
 	unsigned dst_offset;
 	const uint8_t *src;
 	unsigned src_offset;
 	unsigned bit_count;
-	struct list_head list;
+};
+
+#define BIT_COPY_QUEUE_INLINE 32
+
+/**
+ * Copies to be done later by bit_copy_execute().  Entries are kept in
+ * the inline array until it fills up, then in a heap array that doubles
+ * as needed.  bit_copy_execute() keeps that array for the next round,
+ * bit_copy_discard() releases it.
+ */
+struct bit_copy_queue {
+	struct bit_copy_queue_entry *entries;
+	unsigned count;
+	unsigned capacity;
+	struct bit_copy_queue_entry inline_entries[BIT_COPY_QUEUE_INLINE];
 };
 
 void bit_copy_queue_init(struct bit_copy_queue *q);
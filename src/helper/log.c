@@ -34,6 +34,10 @@
 
 #include <stdarg.h>
 
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
 #ifdef _DEBUG_FREE_SPACE_
 #ifdef HAVE_MALLOC_H
 #include <malloc.h>
@@ -73,6 +77,61 @@ struct store_log_forward {
 	const char *string;
 };
 
+#ifdef HAVE_PTHREAD_H
+/* Messages logged by helper threads, e.g. the JTAG queue worker, must not
+ * reach stderr, telnet or GDB while the main thread uses them.  They are
+ * queued here and printed by the main thread in log_flush_deferred(). */
+struct log_deferred {
+	struct log_deferred *next;
+	enum log_levels level;
+	const char *file;
+	int line;
+	const char *function;
+	char *string;
+};
+
+static bool log_main_thread_known;
+static pthread_t log_main_thread;
+static pthread_mutex_t log_deferred_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct log_deferred *log_deferred_head;
+static struct log_deferred **log_deferred_tail = &log_deferred_head;
+#endif
+
+bool log_on_main_thread(void)
+{
+#ifdef HAVE_PTHREAD_H
+	return !log_main_thread_known || pthread_equal(pthread_self(), log_main_thread);
+#else
+	return true;
+#endif
+}
+
+#ifdef HAVE_PTHREAD_H
+static void log_defer(enum log_levels level, const char *file, int line,
+	const char *function, const char *string)
+{
+	struct log_deferred *entry = malloc(sizeof(*entry));
+	if (entry == NULL)
+		return;
+
+	entry->string = strdup(string);
+	if (entry->string == NULL) {
+		free(entry);
+		return;
+	}
+	entry->next = NULL;
+	entry->level = level;
+	entry->file = file;
+	entry->line = line;
+	entry->function = function;
+
+	pthread_mutex_lock(&log_deferred_lock);
+	*log_deferred_tail = entry;
+	log_deferred_tail = &entry->next;
+	pthread_mutex_unlock(&log_deferred_lock);
+}
+#endif
+
 /* either forward the log to the listeners or store it for possible forwarding later */
 static void log_forward(const char *file, unsigned line, const char *function, const char *string)
 {
@@ -122,6 +181,14 @@ static void log_puts(enum log_levels level,
 	const char *string)
 {
 	char *f;
+
+#ifdef HAVE_PTHREAD_H
+	if (!log_on_main_thread()) {
+		log_defer(level, file, line, function, string);
+		return;
+	}
+#endif
+
 	if (level == LOG_LVL_OUTPUT) {
 		/* do not prepend any headers, just print out what we were given and return */
 		fputs(string, log_output);
@@ -168,6 +235,30 @@ static void log_puts(enum log_levels level,
 		log_forward(file, line, function, string);
 }
 
+void log_flush_deferred(void)
+{
+#ifdef HAVE_PTHREAD_H
+	struct log_deferred *entry;
+
+	if (!log_on_main_thread())
+		return;
+
+	pthread_mutex_lock(&log_deferred_lock);
+	entry = log_deferred_head;
+	log_deferred_head = NULL;
+	log_deferred_tail = &log_deferred_head;
+	pthread_mutex_unlock(&log_deferred_lock);
+
+	while (entry) {
+		struct log_deferred *next = entry->next;
+		log_puts(entry->level, entry->file, entry->line, entry->function, entry->string);
+		free(entry->string);
+		free(entry);
+		entry = next;
+	}
+#endif
+}
+
 void log_printf(enum log_levels level,
 	const char *file,
 	unsigned line,
@@ -295,6 +386,11 @@ void log_init(void)
 	if (log_output == NULL)
 		log_output = stderr;
 
+#ifdef HAVE_PTHREAD_H
+	log_main_thread = pthread_self();
+	log_main_thread_known = true;
+#endif
+
 	start = last_time = timeval_ms();
 }
 
@@ -405,6 +501,11 @@ char *alloc_printf(const char *format, ...)
  */
 void keep_alive()
 {
+	/* only the main thread talks to GDB; it keeps the connection alive
+	 * while it waits for other threads */
+	if (!log_on_main_thread())
+		return;
+
 	current_time = timeval_ms();
 	if (current_time-last_time > 1000) {
 		extern int gdb_actual_connections;
@@ -440,6 +541,9 @@ void keep_alive()
 /* reset keep alive timer without sending message */
 void kept_alive()
 {
+	if (!log_on_main_thread())
+		return;
+
 	current_time = timeval_ms();
 	last_time = current_time;
 }
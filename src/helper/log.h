@@ -74,6 +74,15 @@ int set_log_output(struct command_context *cmd_ctx, FILE *output);
 
 int log_register_commands(struct command_context *cmd_ctx);
 
+/**
+ * @returns True when called from the thread that runs the server loop.
+ * Messages logged from other threads are held back until that thread
+ * calls log_flush_deferred(), and keep_alive() does nothing there.
+ */
+bool log_on_main_thread(void);
+/** Print the messages held back from other threads. */
+void log_flush_deferred(void);
+
 void keep_alive(void);
 void kept_alive(void);
 
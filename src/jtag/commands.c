@@ -33,11 +33,13 @@
 #endif
 
 #include <jtag/jtag.h>
+#include <jtag/interface.h>
 #include "commands.h"
 
 struct cmd_queue_page {
 	struct cmd_queue_page *next;
 	void *address;
+	size_t size;
 	size_t used;
 };
 
@@ -45,8 +47,23 @@ struct cmd_queue_page {
 static struct cmd_queue_page *cmd_queue_pages;
 static struct cmd_queue_page *cmd_queue_pages_tail;
 
+/* Pages released by jtag_command_queue_reset() are kept here, up to
+ * cmd_queue_pool_max of them, so the next flush can reuse them without
+ * going back to malloc().  Only pages of CMD_QUEUE_PAGE_SIZE are pooled;
+ * oversized pages are always freed. */
+#define CMD_QUEUE_POOL_DEFAULT 16
+static struct cmd_queue_page *cmd_queue_pool;
+static unsigned cmd_queue_pool_count;
+static unsigned cmd_queue_pool_max = CMD_QUEUE_POOL_DEFAULT;
+
+static struct cmd_queue_stats cmd_queue_stats;
+
 struct jtag_command *jtag_command_queue;
-static struct jtag_command **next_command_pointer = &jtag_command_queue;
+
+/* the queue being built; it becomes jtag_command_queue only once the
+ * driver is asked to execute it, see jtag_command_queue_detach() */
+static struct jtag_command *cmd_queue_head;
+static struct jtag_command **next_command_pointer = &cmd_queue_head;
 
 void jtag_queue_command(struct jtag_command *cmd)
 {
@@ -102,48 +119,270 @@ void *cmd_queue_alloc(size_t size)
 
 	if (*p_page) {
 		p_page = &cmd_queue_pages_tail;
-		if (CMD_QUEUE_PAGE_SIZE - (*p_page)->used < size)
+		if ((*p_page)->size - (*p_page)->used < size)
 			p_page = &((*p_page)->next);
 	}
 
 	if (!*p_page) {
-		*p_page = malloc(sizeof(struct cmd_queue_page));
+		if (size <= CMD_QUEUE_PAGE_SIZE && cmd_queue_pool) {
+			*p_page = cmd_queue_pool;
+			cmd_queue_pool = cmd_queue_pool->next;
+			cmd_queue_pool_count--;
+		} else {
+			*p_page = malloc(sizeof(struct cmd_queue_page));
+			(*p_page)->size = (size < CMD_QUEUE_PAGE_SIZE) ?
+						CMD_QUEUE_PAGE_SIZE : size;
+			(*p_page)->address = malloc((*p_page)->size);
+			cmd_queue_stats.pages_allocated++;
+		}
 		(*p_page)->used = 0;
-		size_t alloc_size = (size < CMD_QUEUE_PAGE_SIZE) ?
-					CMD_QUEUE_PAGE_SIZE : size;
-		(*p_page)->address = malloc(alloc_size);
 		(*p_page)->next = NULL;
 		cmd_queue_pages_tail = *p_page;
+
+		cmd_queue_stats.pages_in_use++;
+		if (cmd_queue_stats.pages_in_use > cmd_queue_stats.peak_pages)
+			cmd_queue_stats.peak_pages = cmd_queue_stats.pages_in_use;
 	}
 
 	offset = (*p_page)->used;
 	(*p_page)->used += size;
+	cmd_queue_stats.bytes_in_use += size;
 
 	t = (*p_page)->address;
 	return t + offset;
 }
 
-static void cmd_queue_free(void)
+static void cmd_queue_page_free(struct cmd_queue_page *page)
+{
+	free(page->address);
+	free(page);
+}
+
+void jtag_command_queue_detach(struct jtag_command_batch *batch)
+{
+	batch->commands = cmd_queue_head;
+	batch->pages = cmd_queue_pages;
+	batch->bytes = cmd_queue_stats.bytes_in_use;
+
+	cmd_queue_head = NULL;
+	next_command_pointer = &cmd_queue_head;
+	cmd_queue_pages = NULL;
+	cmd_queue_pages_tail = NULL;
+
+	cmd_queue_stats.last_flush_bytes = cmd_queue_stats.bytes_in_use;
+	if (cmd_queue_stats.bytes_in_use > cmd_queue_stats.peak_flush_bytes)
+		cmd_queue_stats.peak_flush_bytes = cmd_queue_stats.bytes_in_use;
+	cmd_queue_stats.bytes_in_use = 0;
+	cmd_queue_stats.pages_in_use = 0;
+}
+
+void jtag_command_batch_free(struct jtag_command_batch *batch)
 {
-	struct cmd_queue_page *page = cmd_queue_pages;
+	struct cmd_queue_page *page = batch->pages;
 
 	while (page) {
 		struct cmd_queue_page *last = page;
-		free(page->address);
 		page = page->next;
-		free(last);
+
+		if (last->size == CMD_QUEUE_PAGE_SIZE
+				&& cmd_queue_pool_count < cmd_queue_pool_max) {
+			last->next = cmd_queue_pool;
+			cmd_queue_pool = last;
+			cmd_queue_pool_count++;
+		} else
+			cmd_queue_page_free(last);
 	}
 
-	cmd_queue_pages = NULL;
-	cmd_queue_pages_tail = NULL;
+	batch->commands = NULL;
+	batch->pages = NULL;
+	batch->bytes = 0;
+
+	cmd_queue_stats.pages_pooled = cmd_queue_pool_count;
+}
+
+void cmd_queue_set_pool_size(unsigned max_pages)
+{
+	cmd_queue_pool_max = max_pages;
+
+	/* trim the pool right away rather than on the next flush */
+	while (cmd_queue_pool_count > cmd_queue_pool_max) {
+		struct cmd_queue_page *page = cmd_queue_pool;
+		cmd_queue_pool = page->next;
+		cmd_queue_pool_count--;
+		cmd_queue_page_free(page);
+	}
+	cmd_queue_stats.pages_pooled = cmd_queue_pool_count;
+}
+
+unsigned cmd_queue_get_pool_size(void)
+{
+	return cmd_queue_pool_max;
+}
+
+void cmd_queue_get_stats(struct cmd_queue_stats *stats)
+{
+	*stats = cmd_queue_stats;
 }
 
 void jtag_command_queue_reset(void)
 {
-	cmd_queue_free();
+	struct jtag_command_batch batch;
 
-	jtag_command_queue = NULL;
-	next_command_pointer = &jtag_command_queue;
+	jtag_command_queue_detach(&batch);
+	jtag_command_batch_free(&batch);
+}
+
+/*
+ * Peephole optimizer, run on the queue just before it is handed to the
+ * interface driver.  Every rewrite must leave the bits seen by the TAPs,
+ * and the points where Capture/Update happen, unchanged.
+ */
+static bool jtag_queue_optimizer_enabled;
+static struct jtag_queue_optimizer_stats jtag_queue_optimizer_stats;
+
+/* state the TAPs are in after cmd, given they were in state before it */
+static tap_state_t jtag_command_end_state(const struct jtag_command *cmd,
+		tap_state_t state)
+{
+	switch (cmd->type) {
+		case JTAG_SCAN:
+			return cmd->cmd.scan->end_state;
+		case JTAG_RUNTEST:
+			return cmd->cmd.runtest->end_state;
+		case JTAG_TLR_RESET:
+			return TAP_RESET;
+		case JTAG_PATHMOVE:
+			return cmd->cmd.pathmove->path[cmd->cmd.pathmove->num_states - 1];
+		case JTAG_SLEEP:
+		case JTAG_STABLECLOCKS:
+			return state;
+		default:
+			/* resets and raw TMS sequences: don't try to follow */
+			return TAP_INVALID;
+	}
+}
+
+static bool jtag_scan_same_out(const struct scan_command *a,
+		const struct scan_command *b)
+{
+	if (a->num_fields != b->num_fields)
+		return false;
+
+	for (int i = 0; i < a->num_fields; i++) {
+		const struct scan_field *fa = a->fields + i;
+		const struct scan_field *fb = b->fields + i;
+
+		if (fa->num_bits != fb->num_bits)
+			return false;
+		if (!fa->out_value || !fb->out_value)
+			return false;
+		if (buf_cmp(fa->out_value, fb->out_value, fa->num_bits))
+			return false;
+	}
+	return true;
+}
+
+/* unlink the command following prev, keeping the queue tail valid */
+static void jtag_command_remove_next(struct jtag_command *prev)
+{
+	struct jtag_command *cmd = prev->next;
+
+	prev->next = cmd->next;
+	if (next_command_pointer == &cmd->next)
+		next_command_pointer = &prev->next;
+
+	jtag_queue_optimizer_stats.commands_saved++;
+}
+
+void jtag_command_queue_optimize(void)
+{
+	struct jtag_queue_optimizer_stats *stats = &jtag_queue_optimizer_stats;
+	const struct scan_command *last_ir = NULL;
+	tap_state_t state = TAP_INVALID;
+
+	if (!jtag_queue_optimizer_enabled)
+		return;
+
+	for (struct jtag_command *cmd = cmd_queue_head; cmd; cmd = cmd->next) {
+		struct jtag_command *next;
+
+		if (cmd->type == JTAG_RUNTEST) {
+			struct runtest_command *runtest = cmd->cmd.runtest;
+
+			/* RUN/IDLE is where both runtests clock, so nothing but
+			 * the command boundary is lost by merging them */
+			while ((next = cmd->next) != NULL
+					&& next->type == JTAG_RUNTEST
+					&& runtest->end_state == TAP_IDLE) {
+				runtest->num_cycles += next->cmd.runtest->num_cycles;
+				runtest->end_state = next->cmd.runtest->end_state;
+				stats->runtests_merged++;
+				jtag_command_remove_next(cmd);
+			}
+		} else if (cmd->type == JTAG_SCAN && !cmd->cmd.scan->ir_scan) {
+			struct scan_command *scan = cmd->cmd.scan;
+
+			/* leaving DRSHIFT through DRPAUSE and coming back does not
+			 * pass Capture-DR or Update-DR, so both scans shift one
+			 * continuous bit stream */
+			while ((next = cmd->next) != NULL
+					&& next->type == JTAG_SCAN
+					&& !next->cmd.scan->ir_scan
+					&& scan->end_state == TAP_DRPAUSE) {
+				struct scan_command *tail = next->cmd.scan;
+				int num_fields = scan->num_fields + tail->num_fields;
+				struct scan_field *fields = cmd_queue_alloc(num_fields * sizeof(*fields));
+
+				memcpy(fields, scan->fields, scan->num_fields * sizeof(*fields));
+				memcpy(fields + scan->num_fields, tail->fields,
+						tail->num_fields * sizeof(*fields));
+				scan->fields = fields;
+				scan->num_fields = num_fields;
+				scan->end_state = tail->end_state;
+
+				stats->dr_scans_fused++;
+				stats->bits_saved += 1 + tap_get_tms_path_len(TAP_DRPAUSE, TAP_DRSHIFT);
+				jtag_command_remove_next(cmd);
+			}
+		} else if (cmd->type == JTAG_SCAN)
+			last_ir = cmd->cmd.scan;
+		else if (cmd->type != JTAG_SLEEP && cmd->type != JTAG_STABLECLOCKS)
+			last_ir = NULL;
+
+		state = jtag_command_end_state(cmd, state);
+
+		/* an IR scan reloading what is already latched, without looking
+		 * at what it captures, and ending where we already are */
+		while ((next = cmd->next) != NULL
+				&& next->type == JTAG_SCAN
+				&& next->cmd.scan->ir_scan
+				&& last_ir != NULL
+				&& tap_is_state_stable(state)
+				&& next->cmd.scan->end_state == state
+				&& !(jtag_scan_type(next->cmd.scan) & SCAN_IN)
+				&& jtag_scan_same_out(last_ir, next->cmd.scan)) {
+			stats->ir_scans_dropped++;
+			stats->bits_saved += jtag_scan_size(next->cmd.scan)
+					+ tap_get_tms_path_len(state, TAP_IRSHIFT)
+					+ tap_get_tms_path_len(TAP_IRSHIFT, state);
+			jtag_command_remove_next(cmd);
+		}
+	}
+}
+
+void jtag_queue_optimizer_enable(bool enable)
+{
+	jtag_queue_optimizer_enabled = enable;
+}
+
+bool jtag_queue_optimizer_is_enabled(void)
+{
+	return jtag_queue_optimizer_enabled;
+}
+
+void jtag_queue_optimizer_get_stats(struct jtag_queue_optimizer_stats *stats)
+{
+	*stats = jtag_queue_optimizer_stats;
 }
 
 enum scan_type jtag_scan_type(const struct scan_command *cmd)
@@ -253,3 +492,89 @@ int jtag_read_buffer(uint8_t *buffer, const struct scan_command *cmd)
 
 	return retval;
 }
+
+COMMAND_HANDLER(handle_cmd_queue_pool_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		unsigned max_pages;
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], max_pages);
+		cmd_queue_set_pool_size(max_pages);
+	}
+
+	command_print(CMD_CTX, "command queue page pool: %u pages of %u bytes",
+			cmd_queue_get_pool_size(), (unsigned)CMD_QUEUE_PAGE_SIZE);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_cmd_queue_stats_command)
+{
+	struct cmd_queue_stats stats;
+
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	cmd_queue_get_stats(&stats);
+
+	command_print(CMD_CTX, "pages in use: %u, pooled: %u, peak: %u, malloc'ed: %u",
+			stats.pages_in_use, stats.pages_pooled, stats.peak_pages,
+			stats.pages_allocated);
+	command_print(CMD_CTX, "bytes per flush: last %zu, peak %zu",
+			stats.last_flush_bytes, stats.peak_flush_bytes);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_optimize_queue_command)
+{
+	struct jtag_queue_optimizer_stats stats;
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		bool enable;
+		COMMAND_PARSE_ENABLE(CMD_ARGV[0], enable);
+		jtag_queue_optimizer_enable(enable);
+	}
+
+	jtag_queue_optimizer_get_stats(&stats);
+
+	command_print(CMD_CTX, "queue optimizer %s",
+			jtag_queue_optimizer_is_enabled() ? "enabled" : "disabled");
+	command_print(CMD_CTX, "runtests merged: %u, IR scans dropped: %u, DR scans fused: %u",
+			stats.runtests_merged, stats.ir_scans_dropped, stats.dr_scans_fused);
+	command_print(CMD_CTX, "commands saved: %u, TCK cycles saved: %llu",
+			stats.commands_saved, stats.bits_saved);
+	return ERROR_OK;
+}
+
+const struct command_registration cmd_queue_command_handlers[] = {
+	{
+		.name = "cmd_queue_pool",
+		.handler = handle_cmd_queue_pool_command,
+		.mode = COMMAND_ANY,
+		.help = "Display or set how many command queue pages are "
+			"kept for reuse across queue flushes.",
+		.usage = "[max_pages]",
+	},
+	{
+		.name = "optimize_queue",
+		.handler = handle_optimize_queue_command,
+		.mode = COMMAND_ANY,
+		.help = "Display or set whether queued commands are merged "
+			"or dropped where that does not change what the TAPs "
+			"see, and report how much was saved.",
+		.usage = "['enable'|'disable']",
+	},
+	{
+		.name = "cmd_queue_stats",
+		.handler = handle_cmd_queue_stats_command,
+		.mode = COMMAND_ANY,
+		.help = "Report command queue page usage and bytes "
+			"allocated per flush.",
+		.usage = "",
+	},
+	COMMAND_REGISTRATION_DONE
+};
@@ -162,11 +162,79 @@ struct jtag_command {
 	struct jtag_command *next;
 };
 
-/** The current queue of jtag_command_s structures. */
+/** The queue of jtag_command_s structures being executed by the driver. */
 extern struct jtag_command *jtag_command_queue;
 
+/**
+ * Usage counters of the command queue allocator, see cmd_queue_alloc().
+ */
+struct cmd_queue_stats {
+	/** pages holding commands of the queue being built */
+	unsigned pages_in_use;
+	/** most pages ever used by a single queue */
+	unsigned peak_pages;
+	/** pages kept for reuse by the next queue */
+	unsigned pages_pooled;
+	/** pages obtained from malloc() since startup */
+	unsigned pages_allocated;
+	/** bytes handed out for the queue being built */
+	size_t bytes_in_use;
+	/** bytes handed out for the last flushed queue */
+	size_t last_flush_bytes;
+	/** most bytes ever handed out for a single queue */
+	size_t peak_flush_bytes;
+};
+
 void *cmd_queue_alloc(size_t size);
 
+/**
+ * A queue of commands taken off the builder along with the cmd_queue
+ * pages backing them, so a new queue can be built while it executes.
+ */
+struct jtag_command_batch {
+	struct jtag_command *commands;
+	struct cmd_queue_page *pages;
+	size_t bytes;
+};
+
+/** Move the commands queued so far into @a batch and start a new queue. */
+void jtag_command_queue_detach(struct jtag_command_batch *batch);
+/** Release the pages of a batch once nothing refers to them anymore. */
+void jtag_command_batch_free(struct jtag_command_batch *batch);
+
+void cmd_queue_set_pool_size(unsigned max_pages);
+unsigned cmd_queue_get_pool_size(void);
+void cmd_queue_get_stats(struct cmd_queue_stats *stats);
+
+/**
+ * What the queue optimizer saved since startup,
+ * see jtag_command_queue_optimize().
+ */
+struct jtag_queue_optimizer_stats {
+	/** RUN/IDLE clocking folded into the preceding runtest */
+	unsigned runtests_merged;
+	/** IR scans reloading the instruction already latched */
+	unsigned ir_scans_dropped;
+	/** DR scans appended to a preceding one ending in DRPAUSE */
+	unsigned dr_scans_fused;
+	/** commands no longer sent to the interface driver */
+	unsigned commands_saved;
+	/** TCK cycles no longer clocked */
+	unsigned long long bits_saved;
+};
+
+/**
+ * Rewrite the queued commands, if enabled, before they go to the driver:
+ * merge runtests that continue in RUN/IDLE, drop IR scans that reload
+ * the instruction just loaded, and fuse DR scans continuing from DRPAUSE.
+ */
+void jtag_command_queue_optimize(void);
+void jtag_queue_optimizer_enable(bool enable);
+bool jtag_queue_optimizer_is_enabled(void);
+void jtag_queue_optimizer_get_stats(struct jtag_queue_optimizer_stats *stats);
+
+extern const struct command_registration cmd_queue_command_handlers[];
+
 void jtag_queue_command(struct jtag_command *cmd);
 void jtag_command_queue_reset(void);
 
@@ -97,6 +97,9 @@ tap_state_t cmd_queue_cur_state = TAP_RESET;
 static bool jtag_verify_capture_ir = true;
 static int jtag_verify = 1;
 
+/* submitted queues run in the background, see jtag_submit_queue() */
+static bool jtag_pipelined;
+
 /* how long the OpenOCD should wait before attempting JTAG communication after reset lines
  *deasserted (in ms) */
 static int adapter_nsrst_delay;	/* default to no nSRST delay */
@@ -402,18 +405,124 @@ void jtag_add_plain_ir_scan(int num_bits, const uint8_t *out_bits, uint8_t *in_b
 	jtag_set_error(retval);
 }
 
-static int jtag_check_value_inner(uint8_t *captured, uint8_t *in_check_value,
-				  uint8_t *in_check_mask, int num_bits);
+static void jtag_check_value_report(const uint8_t *captured, const uint8_t *in_check_value,
+				  const uint8_t *in_check_mask, int num_bits);
 
-static int jtag_check_value_mask_callback(jtag_callback_data_t data0,
+/*
+ * Captured values to verify, collected per queue flush into one table
+ * checked by a single callback, rather than a callback per field.
+ */
+struct jtag_verify_entry {
+	const uint8_t *captured;
+	const uint8_t *expected;
+	const uint8_t *mask;
+	int num_bits;
+};
+
+struct jtag_verify_table {
+	struct jtag_verify_table *next;
+	struct jtag_verify_entry *entries;
+	unsigned count;
+	unsigned capacity;
+	/* its callback is queued and hasn't run yet */
+	bool busy;
+};
+
+/* every table ever allocated, and the one filled for the current queue */
+static struct jtag_verify_table *jtag_verify_tables;
+static struct jtag_verify_table *jtag_verify_table_cur;
+
+static int jtag_verify_table_callback(jtag_callback_data_t data0,
 	jtag_callback_data_t data1,
 	jtag_callback_data_t data2,
 	jtag_callback_data_t data3)
 {
-	return jtag_check_value_inner((uint8_t *)data0,
-		(uint8_t *)data1,
-		(uint8_t *)data2,
-		(int)data3);
+	struct jtag_verify_table *table = (struct jtag_verify_table *)data0;
+	const struct jtag_verify_entry *failed = NULL;
+	unsigned num_failed = 0;
+
+	/* compare everything first, only look closer at what failed */
+	for (unsigned i = 0; i < table->count; i++) {
+		const struct jtag_verify_entry *e = &table->entries[i];
+		bool compare_failed;
+
+		if (e->mask)
+			compare_failed = buf_cmp_mask(e->captured, e->expected, e->mask, e->num_bits);
+		else
+			compare_failed = buf_cmp(e->captured, e->expected, e->num_bits);
+
+		if (compare_failed) {
+			if (!failed)
+				failed = e;
+			num_failed++;
+		}
+	}
+
+	if (failed) {
+		jtag_check_value_report(failed->captured, failed->expected,
+				failed->mask, failed->num_bits);
+		if (num_failed > 1)
+			LOG_WARNING(" ... and %u more bad values in the same queue",
+					num_failed - 1);
+	}
+
+	table->count = 0;
+	table->busy = false;
+	if (jtag_verify_table_cur == table)
+		jtag_verify_table_cur = NULL;
+
+	return failed ? ERROR_JTAG_QUEUE_FAILED : ERROR_OK;
+}
+
+static int jtag_verify_table_add(struct jtag_verify_table *table,
+		const struct scan_field *field)
+{
+	if (table->count == table->capacity) {
+		unsigned capacity = table->capacity ? 2 * table->capacity : 64;
+		struct jtag_verify_entry *entries = realloc(table->entries,
+				capacity * sizeof(*entries));
+		if (!entries) {
+			LOG_ERROR("out of memory");
+			return ERROR_FAIL;
+		}
+		table->entries = entries;
+		table->capacity = capacity;
+	}
+
+	struct jtag_verify_entry *e = &table->entries[table->count++];
+	e->captured = field->in_value;
+	e->expected = field->check_value;
+	e->mask = field->check_mask;
+	e->num_bits = field->num_bits;
+
+	return ERROR_OK;
+}
+
+static struct jtag_verify_table *jtag_verify_table_get(void)
+{
+	struct jtag_verify_table *table;
+
+	for (table = jtag_verify_tables; table; table = table->next) {
+		if (!table->busy)
+			return table;
+	}
+
+	table = calloc(1, sizeof(*table));
+	if (table) {
+		table->next = jtag_verify_tables;
+		jtag_verify_tables = table;
+	}
+	return table;
+}
+
+/* the queue is gone, whether or not the table callbacks ran */
+static void jtag_verify_tables_reset(void)
+{
+	for (struct jtag_verify_table *table = jtag_verify_tables; table; table = table->next) {
+		table->count = 0;
+		table->busy = false;
+	}
+	jtag_verify_table_cur = NULL;
 }
 
 static void jtag_add_scan_check(struct jtag_tap *active, void (*jtag_add_scan)(
@@ -425,15 +534,35 @@ static void jtag_add_scan_check(struct jtag_tap *active, void (*jtag_add_scan)(
 {
 	jtag_add_scan(active, in_num_fields, in_fields, state);
 
+	struct jtag_verify_table *table = jtag_verify_table_cur;
+	bool new_table = false;
+
 	for (int i = 0; i < in_num_fields; i++) {
-		if ((in_fields[i].check_value != NULL) && (in_fields[i].in_value != NULL)) {
-			/* this is synchronous for a minidriver */
-			jtag_add_callback4(jtag_check_value_mask_callback,
-				(jtag_callback_data_t)in_fields[i].in_value,
-				(jtag_callback_data_t)in_fields[i].check_value,
-				(jtag_callback_data_t)in_fields[i].check_mask,
-				(jtag_callback_data_t)in_fields[i].num_bits);
+		if ((in_fields[i].check_value == NULL) || (in_fields[i].in_value == NULL))
+			continue;
+
+		if (!table) {
+			table = jtag_verify_table_get();
+			if (!table) {
+				jtag_set_error(ERROR_FAIL);
+				return;
+			}
+			table->busy = true;
+			new_table = true;
 		}
+
+		int retval = jtag_verify_table_add(table, &in_fields[i]);
+		if (retval != ERROR_OK) {
+			jtag_set_error(retval);
+			break;
+		}
+	}
+
+	if (new_table) {
+		jtag_verify_table_cur = table;
+		/* this is synchronous for a minidriver */
+		jtag_add_callback4(jtag_verify_table_callback,
+			(jtag_callback_data_t)table, 0, 0, 0);
 	}
 }
 
@@ -463,6 +592,34 @@ void jtag_add_dr_scan(struct jtag_tap *active,
 	jtag_set_error(retval);
 }
 
+void jtag_add_dr_scan_u32(struct jtag_tap *active,
+	int in_num_fields,
+	const struct scan_field_u32 *in_fields,
+	tap_state_t state)
+{
+	assert(state != TAP_RESET);
+
+	jtag_prelude(state);
+
+	int retval;
+	retval = interface_jtag_add_dr_scan_u32(active, in_num_fields, in_fields, state);
+	jtag_set_error(retval);
+}
+
+void jtag_add_dr_scan_u64(struct jtag_tap *active,
+	int in_num_fields,
+	const struct scan_field_u64 *in_fields,
+	tap_state_t state)
+{
+	assert(state != TAP_RESET);
+
+	jtag_prelude(state);
+
+	int retval;
+	retval = interface_jtag_add_dr_scan_u64(active, in_num_fields, in_fields, state);
+	jtag_set_error(retval);
+}
+
 void jtag_add_plain_dr_scan(int num_bits, const uint8_t *out_bits, uint8_t *in_bits,
 	tap_state_t state)
 {
@@ -773,6 +930,33 @@ void jtag_add_sleep(uint32_t us)
 	jtag_set_error(interface_jtag_add_sleep(us));
 }
 
+static void jtag_check_value_report(const uint8_t *captured, const uint8_t *in_check_value,
+	const uint8_t *in_check_mask, int num_bits)
+{
+	char *captured_str, *in_check_value_str;
+	int bits = (num_bits > DEBUG_JTAG_IOZ) ? DEBUG_JTAG_IOZ : num_bits;
+
+	/* NOTE:  we've lost diagnostic context here -- 'which tap' */
+
+	captured_str = buf_to_str(captured, bits, 16);
+	in_check_value_str = buf_to_str(in_check_value, bits, 16);
+
+	LOG_WARNING("Bad value '%s' captured during DR or IR scan:",
+		captured_str);
+	LOG_WARNING(" check_value: 0x%s", in_check_value_str);
+
+	free(captured_str);
+	free(in_check_value_str);
+
+	if (in_check_mask) {
+		char *in_check_mask_str;
+
+		in_check_mask_str = buf_to_str(in_check_mask, bits, 16);
+		LOG_WARNING(" check_mask: 0x%s", in_check_mask_str);
+		free(in_check_mask_str);
+	}
+}
+
 static int jtag_check_value_inner(uint8_t *captured, uint8_t *in_check_value,
 	uint8_t *in_check_mask, int num_bits)
 {
@@ -785,29 +969,7 @@ static int jtag_check_value_inner(uint8_t *captured, uint8_t *in_check_value,
 		compare_failed = buf_cmp(captured, in_check_value, num_bits);
 
 	if (compare_failed) {
-		char *captured_str, *in_check_value_str;
-		int bits = (num_bits > DEBUG_JTAG_IOZ) ? DEBUG_JTAG_IOZ : num_bits;
-
-		/* NOTE:  we've lost diagnostic context here -- 'which tap' */
-
-		captured_str = buf_to_str(captured, bits, 16);
-		in_check_value_str = buf_to_str(in_check_value, bits, 16);
-
-		LOG_WARNING("Bad value '%s' captured during DR or IR scan:",
-			captured_str);
-		LOG_WARNING(" check_value: 0x%s", in_check_value_str);
-
-		free(captured_str);
-		free(in_check_value_str);
-
-		if (in_check_mask) {
-			char *in_check_mask_str;
-
-			in_check_mask_str = buf_to_str(in_check_mask, bits, 16);
-			LOG_WARNING(" check_mask: 0x%s", in_check_mask_str);
-			free(in_check_mask_str);
-		}
-
+		jtag_check_value_report(captured, in_check_value, in_check_mask, num_bits);
 		retval = ERROR_JTAG_QUEUE_FAILED;
 	}
 	return retval;
@@ -844,6 +1006,7 @@ void jtag_execute_queue_noclear(void)
 {
 	jtag_flush_queue_count++;
 	jtag_set_error(interface_jtag_execute_queue());
+	jtag_verify_tables_reset();
 
 	if (jtag_flush_queue_sleep > 0) {
 		/* For debug purposes it can be useful to test performance
@@ -854,6 +1017,28 @@ void jtag_execute_queue_noclear(void)
 	}
 }
 
+void jtag_submit_queue(void)
+{
+	/* checks queued from now on belong to the next queue */
+	jtag_verify_table_cur = NULL;
+
+	jtag_flush_queue_count++;
+	jtag_set_error(interface_jtag_submit_queue());
+}
+
+int jtag_set_pipelined(bool enable)
+{
+	int retval = interface_jtag_set_pipelined(enable);
+	if (retval == ERROR_OK || !enable)
+		jtag_pipelined = enable;
+	return retval;
+}
+
+bool jtag_is_pipelined(void)
+{
+	return jtag_pipelined;
+}
+
 int jtag_get_flush_queue_count(void)
 {
 	return jtag_flush_queue_count;
@@ -1473,6 +1658,10 @@ int adapter_quit(void)
 	if (!jtag || !jtag->quit)
 		return ERROR_OK;
 
+	/* the queue worker must not outlive the driver */
+	if (jtag_pipelined)
+		jtag_set_pipelined(false);
+
 	/* close the JTAG interface */
 	int result = jtag->quit();
 	if (ERROR_OK != result)
@@ -78,12 +78,35 @@ static void bitbang_end_state(tap_state_t state)
 	}
 }
 
+/* zeroes, or ones, for clocking a constant TMS with tms_seq() */
+static const uint8_t bitbang_tms_zeros[64];
+static const uint8_t bitbang_tms_ones[64] = {
+	[0 ... 63] = 0xff
+};
+
+static void bitbang_tms_const(int tms, int num_cycles)
+{
+	const uint8_t *bits = tms ? bitbang_tms_ones : bitbang_tms_zeros;
+
+	do {
+		int n = MIN(num_cycles, (int)sizeof(bitbang_tms_zeros) * 8);
+		bitbang_interface->tms_seq(bits, 0, n);
+		num_cycles -= n;
+	} while (num_cycles > 0);
+}
+
 static void bitbang_state_move(int skip)
 {
 	int i = 0, tms = 0;
 	uint8_t tms_scan = tap_get_tms_path(tap_get_state(), tap_get_end_state());
 	int tms_count = tap_get_tms_path_len(tap_get_state(), tap_get_end_state());
 
+	if (bitbang_interface->tms_seq) {
+		bitbang_interface->tms_seq(&tms_scan, skip, MAX(tms_count - skip, 0));
+		tap_set_state(tap_get_end_state());
+		return;
+	}
+
 	for (i = skip; i < tms_count; i++) {
 		tms = (tms_scan >> i) & 1;
 		bitbang_interface->write(0, tms, 0);
@@ -105,6 +128,11 @@ static int bitbang_execute_tms(struct jtag_command *cmd)
 
 	DEBUG_JTAG_IO("TMS: %d bits", num_bits);
 
+	if (bitbang_interface->tms_seq) {
+		bitbang_interface->tms_seq(bits, 0, num_bits);
+		return ERROR_OK;
+	}
+
 	int tms = 0;
 	for (unsigned i = 0; i < num_bits; i++) {
 		tms = ((bits[i/8] >> (i % 8)) & 1);
@@ -121,6 +149,9 @@ static void bitbang_path_move(struct pathmove_command *cmd)
 	int num_states = cmd->num_states;
 	int state_count;
 	int tms = 0;
+	uint8_t tms_bits[DIV_ROUND_UP(cmd->num_states, 8)];
+
+	memset(tms_bits, 0, sizeof(tms_bits));
 
 	state_count = 0;
 	while (num_states) {
@@ -135,15 +166,22 @@ static void bitbang_path_move(struct pathmove_command *cmd)
 			exit(-1);
 		}
 
-		bitbang_interface->write(0, tms, 0);
-		bitbang_interface->write(1, tms, 0);
+		if (bitbang_interface->tms_seq)
+			tms_bits[state_count / 8] |= tms << (state_count % 8);
+		else {
+			bitbang_interface->write(0, tms, 0);
+			bitbang_interface->write(1, tms, 0);
+		}
 
 		tap_set_state(cmd->path[state_count]);
 		state_count++;
 		num_states--;
 	}
 
-	bitbang_interface->write(CLOCK_IDLE(), tms, 0);
+	if (bitbang_interface->tms_seq)
+		bitbang_interface->tms_seq(tms_bits, 0, cmd->num_states);
+	else
+		bitbang_interface->write(CLOCK_IDLE(), tms, 0);
 
 	tap_set_end_state(tap_get_state());
 }
@@ -161,11 +199,15 @@ static void bitbang_runtest(int num_cycles)
 	}
 
 	/* execute num_cycles */
-	for (i = 0; i < num_cycles; i++) {
-		bitbang_interface->write(0, 0, 0);
-		bitbang_interface->write(1, 0, 0);
+	if (bitbang_interface->tms_seq)
+		bitbang_tms_const(0, num_cycles);
+	else {
+		for (i = 0; i < num_cycles; i++) {
+			bitbang_interface->write(0, 0, 0);
+			bitbang_interface->write(1, 0, 0);
+		}
+		bitbang_interface->write(CLOCK_IDLE(), 0, 0);
 	}
-	bitbang_interface->write(CLOCK_IDLE(), 0, 0);
 
 	/* finish in end_state */
 	bitbang_end_state(saved_end_state);
@@ -178,6 +220,12 @@ static void bitbang_stableclocks(int num_cycles)
 	int tms = (tap_get_state() == TAP_RESET ? 1 : 0);
 	int i;
 
+	if (bitbang_interface->tms_seq) {
+		if (num_cycles > 0)
+			bitbang_tms_const(tms, num_cycles);
+		return;
+	}
+
 	/* send num_cycles clocks onto the cable */
 	for (i = 0; i < num_cycles; i++) {
 		bitbang_interface->write(1, tms, 0);
@@ -185,23 +233,83 @@ static void bitbang_stableclocks(int num_cycles)
 	}
 }
 
-static void bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer, int scan_size)
+/* whether a scan's TDO is read with sample(), and only after the queue */
+static bool bitbang_scan_pipelined(enum scan_type type)
 {
-	tap_state_t saved_end_state = tap_get_end_state();
-	int bit_cnt;
+	return type != SCAN_OUT && bitbang_interface->sample && !bitbang_interface->shift_buf;
+}
 
-	if (!((!ir_scan &&
-			(tap_get_state() == TAP_DRSHIFT)) ||
-			(ir_scan && (tap_get_state() == TAP_IRSHIFT)))) {
-		if (ir_scan)
-			bitbang_end_state(TAP_IRSHIFT);
-		else
-			bitbang_end_state(TAP_DRSHIFT);
+/* scans waiting for their pipelined TDO samples */
+struct bitbang_pending_scan {
+	struct scan_command *scan;
+	uint8_t *buffer;
+	int scan_size;
+};
 
-		bitbang_state_move(0);
-		bitbang_end_state(saved_end_state);
+static struct bitbang_pending_scan *bitbang_pending;
+static unsigned bitbang_pending_count;
+static unsigned bitbang_pending_max;
+
+static int bitbang_defer_scan(struct scan_command *scan, uint8_t *buffer, int scan_size)
+{
+	if (bitbang_pending_count == bitbang_pending_max) {
+		unsigned max = bitbang_pending_max ? 2 * bitbang_pending_max : 16;
+		struct bitbang_pending_scan *pending = realloc(bitbang_pending,
+				max * sizeof(*pending));
+		if (!pending) {
+			LOG_ERROR("out of memory");
+			return ERROR_FAIL;
+		}
+		bitbang_pending = pending;
+		bitbang_pending_max = max;
 	}
 
+	struct bitbang_pending_scan *p = &bitbang_pending[bitbang_pending_count++];
+	p->scan = scan;
+	p->buffer = buffer;
+	p->scan_size = scan_size;
+	return ERROR_OK;
+}
+
+/* fetch the samples of all deferred scans, in the order they were taken */
+static int bitbang_read_samples(void)
+{
+	int retval = ERROR_OK;
+
+	if (bitbang_pending_count == 0)
+		return ERROR_OK;
+
+	bitbang_interface->flush();
+
+	for (unsigned i = 0; i < bitbang_pending_count; i++) {
+		struct bitbang_pending_scan *p = &bitbang_pending[i];
+
+		for (int bit_cnt = 0; bit_cnt < p->scan_size; bit_cnt++) {
+			int bytec = bit_cnt/8;
+			int bcval = 1 << (bit_cnt % 8);
+
+			if (bitbang_interface->read_sample())
+				p->buffer[bytec] |= bcval;
+			else
+				p->buffer[bytec] &= ~bcval;
+		}
+
+		if (jtag_read_buffer(p->buffer, p->scan) != ERROR_OK)
+			retval = ERROR_JTAG_QUEUE_FAILED;
+		free(p->buffer);
+	}
+
+	bitbang_pending_count = 0;
+	return retval;
+}
+
+/* shift a scan one write()/read() at a time */
+static void bitbang_shift_bits(enum scan_type type, uint8_t *buffer, int scan_size)
+{
+	/* captured bits are filled in by bitbang_read_samples() */
+	bool pipelined = bitbang_scan_pipelined(type);
+	int bit_cnt;
+
 	for (bit_cnt = 0; bit_cnt < scan_size; bit_cnt++) {
 		int val = 0;
 		int tms = (bit_cnt == scan_size-1) ? 1 : 0;
@@ -219,18 +327,43 @@ static void bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer, int
 
 		bitbang_interface->write(0, tms, tdi);
 
-		if (type != SCAN_OUT)
+		if (pipelined)
+			bitbang_interface->sample();
+		else if (type != SCAN_OUT)
 			val = bitbang_interface->read();
 
 		bitbang_interface->write(1, tms, tdi);
 
-		if (type != SCAN_OUT) {
+		if (type != SCAN_OUT && !pipelined) {
 			if (val)
 				buffer[bytec] |= bcval;
 			else
 				buffer[bytec] &= ~bcval;
 		}
 	}
+}
+
+static void bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer, int scan_size)
+{
+	tap_state_t saved_end_state = tap_get_end_state();
+
+	if (!((!ir_scan &&
+			(tap_get_state() == TAP_DRSHIFT)) ||
+			(ir_scan && (tap_get_state() == TAP_IRSHIFT)))) {
+		if (ir_scan)
+			bitbang_end_state(TAP_IRSHIFT);
+		else
+			bitbang_end_state(TAP_DRSHIFT);
+
+		bitbang_state_move(0);
+		bitbang_end_state(saved_end_state);
+	}
+
+	if (bitbang_interface->shift_buf)
+		bitbang_interface->shift_buf(type == SCAN_IN ? NULL : buffer,
+				type == SCAN_OUT ? NULL : buffer, 0, scan_size, true);
+	else
+		bitbang_shift_bits(type, buffer, scan_size);
 
 	if (tap_get_state() != tap_get_end_state()) {
 		/* we *KNOW* the above loop transitioned out of
@@ -318,6 +451,13 @@ int bitbang_execute_queue(void)
 				scan_size = jtag_build_buffer(cmd->cmd.scan, &buffer);
 				type = jtag_scan_type(cmd->cmd.scan);
 				bitbang_scan(cmd->cmd.scan->ir_scan, type, buffer, scan_size);
+				if (bitbang_scan_pipelined(type)) {
+					if (bitbang_defer_scan(cmd->cmd.scan, buffer, scan_size) != ERROR_OK) {
+						free(buffer);
+						retval = ERROR_FAIL;
+					}
+					break;
+				}
 				if (jtag_read_buffer(buffer, cmd->cmd.scan) != ERROR_OK)
 					retval = ERROR_JTAG_QUEUE_FAILED;
 				if (buffer)
@@ -327,6 +467,9 @@ int bitbang_execute_queue(void)
 #ifdef _DEBUG_JTAG_IO_
 				LOG_DEBUG("sleep %" PRIi32, cmd->cmd.sleep->us);
 #endif
+				/* what is queued so far has to happen before the pause */
+				if (bitbang_interface->flush)
+					bitbang_interface->flush();
 				jtag_sleep(cmd->cmd.sleep->us);
 				break;
 			case JTAG_TMS:
@@ -341,6 +484,9 @@ int bitbang_execute_queue(void)
 	if (bitbang_interface->blink)
 		bitbang_interface->blink(0);
 
+	if (bitbang_read_samples() != ERROR_OK)
+		retval = ERROR_JTAG_QUEUE_FAILED;
+
 	return retval;
 }
 
@@ -360,6 +506,14 @@ static void bitbang_exchange(bool rnw, uint8_t buf[], unsigned int offset, unsig
 	LOG_DEBUG("bitbang_exchange");
 	int tdi;
 
+	if (bitbang_interface->shift_buf) {
+		if (rnw)
+			bitbang_interface->shift_buf(NULL, buf, offset, bit_cnt, false);
+		else
+			bitbang_interface->shift_buf(buf, NULL, offset, bit_cnt, false);
+		return;
+	}
+
 	for (unsigned int i = offset; i < bit_cnt + offset; i++) {
 		int bytec = i/8;
 		int bcval = 1 << (i % 8);
@@ -35,6 +35,28 @@ struct bitbang_interface {
 	void (*blink)(int on);
 	int (*swdio_read)(void);
 	void (*swdio_drive)(bool on);
+
+	/* optional pipelined TDO reads: sample() takes the place of read()
+	 * during scans, the values are fetched in the same order with
+	 * read_sample() once the whole queue went out and flush() was called
+	 */
+	void (*sample)(void);
+	int (*read_sample)(void);
+	void (*flush)(void);
+
+	/* optional versions of the write()/read() loops taking whole buffers,
+	 * starting at bit offset:
+	 * tms_seq() clocks out num_bits of TMS with TDI low, then drives TCK
+	 * low, leaving TMS at the last bit (low if there was none);
+	 * shift_buf() clocks out num_bits of TDI (low if tdi is NULL) with TMS
+	 * low, except for the last bit if exit is set, and stores what read()
+	 * (swdio_read() in SWD mode) would return before each rising edge in
+	 * tdo, unless that is NULL.  tdi and tdo may be the same buffer.  TCK
+	 * is left high, as after the last write(1, ...).
+	 */
+	void (*tms_seq)(const uint8_t *bits, unsigned offset, unsigned num_bits);
+	void (*shift_buf)(const uint8_t *tdi, uint8_t *tdo, unsigned offset,
+			unsigned num_bits, bool exit);
 };
 
 const struct swd_driver bitbang_swd;
@@ -36,6 +36,13 @@
 
 #include <hidapi.h>
 
+#ifndef _WIN32
+#include <sys/un.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
 /*
  * See CMSIS-DAP documentation:
  * Version 0.01 - Beta.
@@ -60,6 +67,9 @@ static uint16_t cmsis_dap_pid[MAX_USB_IDS + 1] = { 0 };
 static wchar_t *cmsis_dap_serial;
 static bool swd_mode;
 
+static char *cmsis_dap_socket_host;
+static char *cmsis_dap_socket_port;
+
 #define PACKET_SIZE       (64 + 1)	/* 64 bytes plus report id */
 #define USB_TIMEOUT       1000
 
@@ -143,8 +153,28 @@ static const char * const info_caps_str[] = {
 /* max clock speed (kHz) */
 #define DAP_MAX_CLOCK             5000
 
+struct cmsis_dap;
+
+/*
+ * How packets get to the adapter.  packet_buffer[0] is the HID report
+ * number, the command starts at packet_buffer[1]; write() sends the
+ * first txlen bytes of it and read() leaves the next reply at
+ * packet_buffer[0].  Up to packet_count packets may be written before
+ * their replies are read.
+ */
+struct cmsis_dap_backend {
+	const char *name;
+	/* finds the adapter and sets packet_size to its default */
+	int (*open)(struct cmsis_dap *dap);
+	void (*close)(struct cmsis_dap *dap);
+	int (*write)(struct cmsis_dap *dap, int txlen);
+	int (*read)(struct cmsis_dap *dap);
+};
+
 struct cmsis_dap {
+	const struct cmsis_dap_backend *backend;
 	hid_device *dev_handle;
+	int sockfd;
 	uint16_t packet_size;
 	uint16_t packet_count;
 	uint8_t *packet_buffer;
@@ -152,6 +182,10 @@ struct cmsis_dap {
 	uint8_t mode;
 };
 
+static const struct cmsis_dap_backend cmsis_dap_hid_backend;
+static const struct cmsis_dap_backend cmsis_dap_socket_backend;
+static const struct cmsis_dap_backend *cmsis_dap_backend = &cmsis_dap_hid_backend;
+
 struct pending_transfer_result {
 	uint8_t cmd;
 	uint32_t data;
@@ -161,11 +195,21 @@ struct pending_transfer_result {
 static int pending_transfer_count, pending_queue_len;
 static struct pending_transfer_result *pending_transfers;
 
+/* transfers of the pending queue that a packet in flight carries */
+struct pending_packet {
+	int first;
+	int count;
+	bool block;
+};
+
+/* one per packet the adapter can buffer */
+static struct pending_packet *pending_packets;
+
 static int queued_retval;
 
 static struct cmsis_dap *cmsis_dap_handle;
 
-static int cmsis_dap_usb_open(void)
+static int cmsis_dap_hid_open(struct cmsis_dap *dap)
 {
 	hid_device *dev = NULL;
 	int i;
@@ -251,60 +295,30 @@ static int cmsis_dap_usb_open(void)
 		return ERROR_FAIL;
 	}
 
-	struct cmsis_dap *dap = malloc(sizeof(struct cmsis_dap));
-	if (dap == NULL) {
-		LOG_ERROR("unable to allocate memory");
-		return ERROR_FAIL;
-	}
-
 	dap->dev_handle = dev;
-	dap->caps = 0;
-	dap->mode = 0;
 
-	cmsis_dap_handle = dap;
-
-	/* allocate default packet buffer, may be changed later.
-	 * currently with HIDAPI we have no way of getting the output report length
+	/* currently with HIDAPI we have no way of getting the output report length
 	 * without this info we cannot communicate with the adapter.
 	 * For the moment we ahve to hard code the packet size */
 
-	int packet_size = PACKET_SIZE;
+	dap->packet_size = PACKET_SIZE;
 
 	/* atmel cmsis-dap uses 512 byte reports */
 	/* TODO: HID report descriptor should be parsed instead of
 	 * hardcoding a match by VID */
 	if (target_vid == 0x03eb)
-		packet_size = 512 + 1;
-
-	cmsis_dap_handle->packet_buffer = malloc(packet_size);
-	cmsis_dap_handle->packet_size = packet_size;
-
-	if (cmsis_dap_handle->packet_buffer == NULL) {
-		LOG_ERROR("unable to allocate memory");
-		return ERROR_FAIL;
-	}
+		dap->packet_size = 512 + 1;
 
 	return ERROR_OK;
 }
 
-static void cmsis_dap_usb_close(struct cmsis_dap *dap)
+static void cmsis_dap_hid_close(struct cmsis_dap *dap)
 {
 	hid_close(dap->dev_handle);
 	hid_exit();
-
-	free(cmsis_dap_handle->packet_buffer);
-	free(cmsis_dap_handle);
-	cmsis_dap_handle = NULL;
-	free(cmsis_dap_serial);
-	cmsis_dap_serial = NULL;
-	free(pending_transfers);
-	pending_transfers = NULL;
-
-	return;
 }
 
-/* Send a message and receive the reply */
-static int cmsis_dap_usb_xfer(struct cmsis_dap *dap, int txlen)
+static int cmsis_dap_hid_write(struct cmsis_dap *dap, int txlen)
 {
 	/* Pad the rest of the TX buffer with 0's */
 	memset(dap->packet_buffer + txlen, 0, dap->packet_size - txlen);
@@ -316,8 +330,12 @@ static int cmsis_dap_usb_xfer(struct cmsis_dap *dap, int txlen)
 		return ERROR_FAIL;
 	}
 
-	/* get reply */
-	retval = hid_read_timeout(dap->dev_handle, dap->packet_buffer, dap->packet_size, USB_TIMEOUT);
+	return ERROR_OK;
+}
+
+static int cmsis_dap_hid_read(struct cmsis_dap *dap)
+{
+	int retval = hid_read_timeout(dap->dev_handle, dap->packet_buffer, dap->packet_size, USB_TIMEOUT);
 	if (retval == -1 || retval == 0) {
 		LOG_DEBUG("error reading data: %ls", hid_error(dap->dev_handle));
 		return ERROR_FAIL;
@@ -326,6 +344,253 @@ static int cmsis_dap_usb_xfer(struct cmsis_dap *dap, int txlen)
 	return ERROR_OK;
 }
 
+static const struct cmsis_dap_backend cmsis_dap_hid_backend = {
+	.name = "hid",
+	.open = cmsis_dap_hid_open,
+	.close = cmsis_dap_hid_close,
+	.write = cmsis_dap_hid_write,
+	.read = cmsis_dap_hid_read,
+};
+
+/*
+ * The socket backend talks to a software CMSIS-DAP, such as
+ * contrib/cmsis-dap/cmsis_dap_sim.c, over TCP or a unix socket.  Each
+ * command and each response is sent as a u16 little endian length
+ * followed by that many bytes, without the HID report number.
+ */
+
+static int cmsis_dap_socket_write(struct cmsis_dap *dap, const uint8_t *data, size_t size)
+{
+	while (size > 0) {
+		int n = write_socket(dap->sockfd, data, size);
+		if (n <= 0) {
+			LOG_ERROR("CMSIS-DAP socket: write failed: %s", strerror(errno));
+			return ERROR_FAIL;
+		}
+		data += n;
+		size -= n;
+	}
+	return ERROR_OK;
+}
+
+static int cmsis_dap_socket_read(struct cmsis_dap *dap, uint8_t *data, size_t size)
+{
+	while (size > 0) {
+		int n = read_socket(dap->sockfd, data, size);
+		if (n <= 0) {
+			if (n == 0)
+				LOG_ERROR("CMSIS-DAP socket: connection closed");
+			else
+				LOG_ERROR("CMSIS-DAP socket: read failed: %s", strerror(errno));
+			return ERROR_FAIL;
+		}
+		data += n;
+		size -= n;
+	}
+	return ERROR_OK;
+}
+
+static int cmsis_dap_socket_connect_tcp(void)
+{
+	struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+	struct addrinfo *result, *rp;
+	int fd = -1;
+	int flag = 1;
+
+	LOG_INFO("CMSIS-DAP: connecting to %s:%s",
+			cmsis_dap_socket_host ? cmsis_dap_socket_host : "localhost",
+			cmsis_dap_socket_port);
+
+	int s = getaddrinfo(cmsis_dap_socket_host, cmsis_dap_socket_port, &hints, &result);
+	if (s != 0) {
+		LOG_ERROR("getaddrinfo: %s", gai_strerror(s));
+		return -1;
+	}
+
+	for (rp = result; rp != NULL; rp = rp->ai_next) {
+		fd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+		if (fd == -1)
+			continue;
+
+		if (connect(fd, rp->ai_addr, rp->ai_addrlen) != -1)
+			break;
+
+		close_socket(fd);
+		fd = -1;
+	}
+
+	freeaddrinfo(result);
+
+	if (fd < 0) {
+		LOG_ERROR("Failed to connect: %s", strerror(errno));
+		return -1;
+	}
+
+	/* one packet in flight at a time, don't hold it back */
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char *)&flag, sizeof(flag));
+
+	return fd;
+}
+
+static int cmsis_dap_socket_connect_unix(void)
+{
+#ifdef _WIN32
+	LOG_ERROR("CMSIS-DAP socket: unix sockets are not supported, set a port");
+	return -1;
+#else
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+	LOG_INFO("CMSIS-DAP: connecting to unix socket %s", cmsis_dap_socket_host);
+
+	int fd = socket(PF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		LOG_ERROR("socket: %s", strerror(errno));
+		return -1;
+	}
+
+	strncpy(addr.sun_path, cmsis_dap_socket_host, sizeof(addr.sun_path) - 1);
+
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		LOG_ERROR("connect: %s", strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+#endif
+}
+
+static int cmsis_dap_socket_open(struct cmsis_dap *dap)
+{
+	if (!cmsis_dap_socket_port && !cmsis_dap_socket_host) {
+		LOG_ERROR("CMSIS-DAP socket: no host or port given, "
+				"see 'cmsis_dap_socket_host' and 'cmsis_dap_socket_port'");
+		return ERROR_FAIL;
+	}
+
+	/* without a port the host names a unix socket, as with remote_bitbang */
+	if (cmsis_dap_socket_port)
+		dap->sockfd = cmsis_dap_socket_connect_tcp();
+	else
+		dap->sockfd = cmsis_dap_socket_connect_unix();
+	if (dap->sockfd < 0)
+		return ERROR_FAIL;
+
+	/* the real packet size is asked for with DAP_Info */
+	dap->packet_size = PACKET_SIZE;
+
+	return ERROR_OK;
+}
+
+static void cmsis_dap_socket_close(struct cmsis_dap *dap)
+{
+	if (dap->sockfd >= 0)
+		close_socket(dap->sockfd);
+	dap->sockfd = -1;
+}
+
+static int cmsis_dap_socket_send(struct cmsis_dap *dap, int txlen)
+{
+	uint8_t header[2];
+
+	if (dap->sockfd < 0)
+		return ERROR_FAIL;
+
+	/* the report number isn't sent */
+	h_u16_to_le(header, txlen - 1);
+	int retval = cmsis_dap_socket_write(dap, header, sizeof(header));
+	if (retval == ERROR_OK)
+		retval = cmsis_dap_socket_write(dap, dap->packet_buffer + 1, txlen - 1);
+	return retval;
+}
+
+static int cmsis_dap_socket_receive(struct cmsis_dap *dap)
+{
+	uint8_t header[2];
+
+	if (dap->sockfd < 0)
+		return ERROR_FAIL;
+
+	int retval = cmsis_dap_socket_read(dap, header, sizeof(header));
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* as with HID, the response starts at packet_buffer[0] */
+	unsigned rxlen = le_to_h_u16(header);
+	if (rxlen == 0 || rxlen > dap->packet_size - 1u) {
+		LOG_ERROR("CMSIS-DAP socket: bad response length %u", rxlen);
+		return ERROR_FAIL;
+	}
+
+	memset(dap->packet_buffer + rxlen, 0, dap->packet_size - rxlen);
+	return cmsis_dap_socket_read(dap, dap->packet_buffer, rxlen);
+}
+
+static const struct cmsis_dap_backend cmsis_dap_socket_backend = {
+	.name = "socket",
+	.open = cmsis_dap_socket_open,
+	.close = cmsis_dap_socket_close,
+	.write = cmsis_dap_socket_send,
+	.read = cmsis_dap_socket_receive,
+};
+
+static int cmsis_dap_open(void)
+{
+	struct cmsis_dap *dap = calloc(1, sizeof(struct cmsis_dap));
+	if (dap == NULL) {
+		LOG_ERROR("unable to allocate memory");
+		return ERROR_FAIL;
+	}
+
+	dap->backend = cmsis_dap_backend;
+	dap->sockfd = -1;
+
+	int retval = dap->backend->open(dap);
+	if (retval != ERROR_OK) {
+		free(dap);
+		return retval;
+	}
+
+	/* allocate default packet buffer, may be changed later */
+	dap->packet_buffer = malloc(dap->packet_size);
+	if (dap->packet_buffer == NULL) {
+		LOG_ERROR("unable to allocate memory");
+		dap->backend->close(dap);
+		free(dap);
+		return ERROR_FAIL;
+	}
+
+	cmsis_dap_handle = dap;
+	return ERROR_OK;
+}
+
+static void cmsis_dap_close(struct cmsis_dap *dap)
+{
+	dap->backend->close(dap);
+
+	free(cmsis_dap_handle->packet_buffer);
+	free(cmsis_dap_handle);
+	cmsis_dap_handle = NULL;
+	free(cmsis_dap_serial);
+	cmsis_dap_serial = NULL;
+	free(pending_transfers);
+	pending_transfers = NULL;
+	free(pending_packets);
+	pending_packets = NULL;
+
+	return;
+}
+
+/* Send a message and receive the reply */
+static int cmsis_dap_xfer(struct cmsis_dap *dap, int txlen)
+{
+	int retval = dap->backend->write(dap, txlen);
+	if (retval != ERROR_OK)
+		return retval;
+
+	return dap->backend->read(dap);
+}
+
 static int cmsis_dap_cmd_DAP_SWJ_Pins(uint8_t pins, uint8_t mask, uint32_t delay, uint8_t *input)
 {
 	int retval;
@@ -339,7 +604,7 @@ static int cmsis_dap_cmd_DAP_SWJ_Pins(uint8_t pins, uint8_t mask, uint32_t delay
 	buffer[5] = (delay >> 8) & 0xff;
 	buffer[6] = (delay >> 16) & 0xff;
 	buffer[7] = (delay >> 24) & 0xff;
-	retval = cmsis_dap_usb_xfer(cmsis_dap_handle, 8);
+	retval = cmsis_dap_xfer(cmsis_dap_handle, 8);
 
 	if (retval != ERROR_OK) {
 		LOG_ERROR("CMSIS-DAP command CMD_DAP_SWJ_PINS failed.");
@@ -365,7 +630,7 @@ static int cmsis_dap_cmd_DAP_SWJ_Clock(uint32_t swj_clock)
 	buffer[3] = (swj_clock >> 8) & 0xff;
 	buffer[4] = (swj_clock >> 16) & 0xff;
 	buffer[5] = (swj_clock >> 24) & 0xff;
-	retval = cmsis_dap_usb_xfer(cmsis_dap_handle, 6);
+	retval = cmsis_dap_xfer(cmsis_dap_handle, 6);
 
 	if (retval != ERROR_OK || buffer[1] != DAP_OK) {
 		LOG_ERROR("CMSIS-DAP command CMD_DAP_SWJ_CLOCK failed.");
@@ -383,7 +648,7 @@ static int cmsis_dap_cmd_DAP_Info(uint8_t info, uint8_t **data)
 	buffer[0] = 0;	/* report number */
 	buffer[1] = CMD_DAP_INFO;
 	buffer[2] = info;
-	retval = cmsis_dap_usb_xfer(cmsis_dap_handle, 3);
+	retval = cmsis_dap_xfer(cmsis_dap_handle, 3);
 
 	if (retval != ERROR_OK) {
 		LOG_ERROR("CMSIS-DAP command CMD_INFO failed.");
@@ -404,7 +669,7 @@ static int cmsis_dap_cmd_DAP_LED(uint8_t leds)
 	buffer[1] = CMD_DAP_LED;
 	buffer[2] = 0x00;
 	buffer[3] = leds;
-	retval = cmsis_dap_usb_xfer(cmsis_dap_handle, 4);
+	retval = cmsis_dap_xfer(cmsis_dap_handle, 4);
 
 	if (retval != ERROR_OK || buffer[1] != 0x00) {
 		LOG_ERROR("CMSIS-DAP command CMD_LED failed.");
@@ -422,7 +687,7 @@ static int cmsis_dap_cmd_DAP_Connect(uint8_t mode)
 	buffer[0] = 0;	/* report number */
 	buffer[1] = CMD_DAP_CONNECT;
 	buffer[2] = mode;
-	retval = cmsis_dap_usb_xfer(cmsis_dap_handle, 3);
+	retval = cmsis_dap_xfer(cmsis_dap_handle, 3);
 
 	if (retval != ERROR_OK) {
 		LOG_ERROR("CMSIS-DAP command CMD_CONNECT failed.");
@@ -444,7 +709,7 @@ static int cmsis_dap_cmd_DAP_Disconnect(void)
 
 	buffer[0] = 0;	/* report number */
 	buffer[1] = CMD_DAP_DISCONNECT;
-	retval = cmsis_dap_usb_xfer(cmsis_dap_handle, 2);
+	retval = cmsis_dap_xfer(cmsis_dap_handle, 2);
 
 	if (retval != ERROR_OK || buffer[1] != DAP_OK) {
 		LOG_ERROR("CMSIS-DAP command CMD_DISCONNECT failed.");
@@ -466,7 +731,7 @@ static int cmsis_dap_cmd_DAP_TFER_Configure(uint8_t idle, uint16_t retry_count,
 	buffer[4] = (retry_count >> 8) & 0xff;
 	buffer[5] = match_retry & 0xff;
 	buffer[6] = (match_retry >> 8) & 0xff;
-	retval = cmsis_dap_usb_xfer(cmsis_dap_handle, 7);
+	retval = cmsis_dap_xfer(cmsis_dap_handle, 7);
 
 	if (retval != ERROR_OK || buffer[1] != DAP_OK) {
 		LOG_ERROR("CMSIS-DAP command CMD_TFER_Configure failed.");
@@ -484,7 +749,7 @@ static int cmsis_dap_cmd_DAP_SWD_Configure(uint8_t cfg)
 	buffer[0] = 0;	/* report number */
 	buffer[1] = CMD_DAP_SWD_CONFIGURE;
 	buffer[2] = cfg;
-	retval = cmsis_dap_usb_xfer(cmsis_dap_handle, 3);
+	retval = cmsis_dap_xfer(cmsis_dap_handle, 3);
 
 	if (retval != ERROR_OK || buffer[1] != DAP_OK) {
 		LOG_ERROR("CMSIS-DAP command CMD_SWD_Configure failed.");
@@ -504,7 +769,7 @@ static int cmsis_dap_cmd_DAP_Delay(uint16_t delay_us)
 	buffer[1] = CMD_DAP_DELAY;
 	buffer[2] = delay_us & 0xff;
 	buffer[3] = (delay_us >> 8) & 0xff;
-	retval = cmsis_dap_usb_xfer(cmsis_dap_handle, 4);
+	retval = cmsis_dap_xfer(cmsis_dap_handle, 4);
 
 	if (retval != ERROR_OK || buffer[1] != DAP_OK) {
 		LOG_ERROR("CMSIS-DAP command CMD_Delay failed.");
@@ -515,82 +780,172 @@ static int cmsis_dap_cmd_DAP_Delay(uint16_t delay_us)
 }
 #endif
 
-static int cmsis_dap_swd_run_queue(struct adiv5_dap *dap)
+/* the bytes of a packet available to a command or its response */
+static unsigned cmsis_dap_packet_room(void)
 {
-	uint8_t *buffer = cmsis_dap_handle->packet_buffer;
+	return cmsis_dap_handle->packet_size - 1;
+}
 
-	LOG_DEBUG("Executing %d queued transactions", pending_transfer_count);
+/* number of transfers from @a first on with the same request */
+static int cmsis_dap_run_length(int first)
+{
+	int i = first + 1;
 
-	if (queued_retval != ERROR_OK) {
-		LOG_DEBUG("Skipping due to previous errors: %d", queued_retval);
-		goto skip;
-	}
+	while (i < pending_transfer_count && pending_transfers[i].cmd == pending_transfers[first].cmd)
+		i++;
+	return i - first;
+}
 
-	if (!pending_transfer_count)
-		goto skip;
+/* how many transfers of @a cmd a DAP_TransferBlock / a DAP_Transfer
+ * of their own could carry */
+static int cmsis_dap_block_capacity(uint8_t cmd)
+{
+	unsigned room = cmsis_dap_packet_room();
+
+	/* 4 bytes of header, 5 for the command, 4 per transfer */
+	return (cmd & SWD_CMD_RnW) ? (room - 4) / 4 : (room - 5) / 4;
+}
+
+static int cmsis_dap_tfer_capacity(uint8_t cmd)
+{
+	unsigned room = cmsis_dap_packet_room();
+
+	/* 3 bytes of header, 1 byte per request plus 4 per data word */
+	return MIN((cmd & SWD_CMD_RnW) ? (room - 3) / 4 : (room - 3) / 5, 255u);
+}
 
+/* whether a run is worth a DAP_TransferBlock, i.e. one packet moves
+ * more of it than a DAP_Transfer would */
+static bool cmsis_dap_use_block(int first, int run)
+{
+	uint8_t cmd = pending_transfers[first].cmd;
+	int tfer = cmsis_dap_tfer_capacity(cmd);
+
+	return run > tfer && cmsis_dap_block_capacity(cmd) > tfer;
+}
+
+static void cmsis_dap_log_transfer(int i)
+{
+	uint8_t cmd = pending_transfers[i].cmd;
+
+	LOG_DEBUG("%s %s reg %x %"PRIx32,
+			cmd & SWD_CMD_APnDP ? "AP" : "DP",
+			cmd & SWD_CMD_RnW ? "read" : "write",
+		  (cmd & SWD_CMD_A32) >> 1, pending_transfers[i].data);
+}
+
+/* encodes the next packet of the pending queue, from @a first on */
+static size_t cmsis_dap_encode_packet(int first, struct pending_packet *pkt)
+{
+	uint8_t *buffer = cmsis_dap_handle->packet_buffer;
+	unsigned room = cmsis_dap_packet_room();
+	int run = cmsis_dap_run_length(first);
 	size_t idx = 0;
+
+	pkt->first = first;
 	buffer[idx++] = 0;	/* report number */
+
+	if (cmsis_dap_use_block(first, run)) {
+		uint8_t cmd = pending_transfers[first].cmd;
+		int count = MIN(run, cmsis_dap_block_capacity(cmd));
+
+		buffer[idx++] = CMD_DAP_TFER_BLOCK;
+		buffer[idx++] = 0x00;	/* DAP Index */
+		buffer[idx++] = count & 0xff;
+		buffer[idx++] = (count >> 8) & 0xff;
+		buffer[idx++] = (cmd >> 1) & 0x0f;
+
+		for (int i = first; i < first + count; i++) {
+			cmsis_dap_log_transfer(i);
+			if (!(cmd & SWD_CMD_RnW)) {
+				h_u32_to_le(&buffer[idx], pending_transfers[i].data);
+				idx += 4;
+			}
+		}
+
+		pkt->count = count;
+		pkt->block = true;
+		return idx;
+	}
+
 	buffer[idx++] = CMD_DAP_TFER;
 	buffer[idx++] = 0x00;	/* DAP Index */
-	buffer[idx++] = pending_transfer_count;
+	buffer[idx++] = 0;	/* count, below */
 
-	for (int i = 0; i < pending_transfer_count; i++) {
+	/* 3 bytes of header in each direction */
+	unsigned request_size = 3, response_size = 3;
+	int i;
+
+	for (i = first; i < pending_transfer_count && i - first < 255; i++) {
 		uint8_t cmd = pending_transfers[i].cmd;
-		uint32_t data = pending_transfers[i].data;
-
-		LOG_DEBUG("%s %s reg %x %"PRIx32,
-				cmd & SWD_CMD_APnDP ? "AP" : "DP",
-				cmd & SWD_CMD_RnW ? "read" : "write",
-			  (cmd & SWD_CMD_A32) >> 1, data);
-
-		/* When proper WAIT handling is implemented in the
-		 * common SWD framework, this kludge can be
-		 * removed. However, this might lead to minor
-		 * performance degradation as the adapter wouldn't be
-		 * able to automatically retry anything (because ARM
-		 * has forgotten to implement sticky error flags
-		 * clearing). See also comments regarding
-		 * cmsis_dap_cmd_DAP_TFER_Configure() and
-		 * cmsis_dap_cmd_DAP_SWD_Configure() in
-		 * cmsis_dap_init().
-		 */
-		if (!(cmd & SWD_CMD_RnW) &&
-		    !(cmd & SWD_CMD_APnDP) &&
-		    (cmd & SWD_CMD_A32) >> 1 == DP_CTRL_STAT &&
-		    (data & CORUNDETECT)) {
-			LOG_DEBUG("refusing to enable sticky overrun detection");
-			data &= ~CORUNDETECT;
+		bool read = cmd & SWD_CMD_RnW;
+
+		if (request_size + (read ? 1 : 5) > room || response_size + (read ? 4 : 0) > room)
+			break;
+
+		/* a long run goes to a packet of its own when a block moves
+		 * more of it than fits in here */
+		if (i > first && pending_transfers[i].cmd != pending_transfers[i - 1].cmd) {
+			run = cmsis_dap_run_length(i);
+			if (cmsis_dap_use_block(i, run))
+				break;
 		}
 
+		cmsis_dap_log_transfer(i);
+
 		buffer[idx++] = (cmd >> 1) & 0x0f;
-		if (!(cmd & SWD_CMD_RnW)) {
-			buffer[idx++] = (data) & 0xff;
-			buffer[idx++] = (data >> 8) & 0xff;
-			buffer[idx++] = (data >> 16) & 0xff;
-			buffer[idx++] = (data >> 24) & 0xff;
+		request_size++;
+		if (read) {
+			response_size += 4;
+		} else {
+			h_u32_to_le(&buffer[idx], pending_transfers[i].data);
+			idx += 4;
+			request_size += 4;
 		}
 	}
 
-	queued_retval = cmsis_dap_usb_xfer(cmsis_dap_handle, idx);
-	if (queued_retval != ERROR_OK)
-		goto skip;
+	buffer[3] = i - first;
+	pkt->count = i - first;
+	pkt->block = false;
+	return idx;
+}
 
-	idx = 2;
-	uint8_t ack = buffer[idx] & 0x07;
-	if (ack != SWD_ACK_OK || (buffer[idx] & 0x08)) {
-		LOG_DEBUG("SWD ack not OK: %d %s", buffer[idx-1],
-			  ack == SWD_ACK_WAIT ? "WAIT" : ack == SWD_ACK_FAULT ? "FAULT" : "JUNK");
-		queued_retval = ack == SWD_ACK_WAIT ? ERROR_WAIT : ERROR_FAIL;
-		goto skip;
+/* hands out the results of the packet just read */
+static int cmsis_dap_decode_packet(const struct pending_packet *pkt)
+{
+	const uint8_t *buffer = cmsis_dap_handle->packet_buffer;
+	size_t idx;
+	int count;
+	uint8_t ack;
+
+	if (pkt->block) {
+		count = le_to_h_u16(&buffer[1]);
+		ack = buffer[3];
+		idx = 4;
+	} else {
+		count = buffer[1];
+		ack = buffer[2];
+		idx = 3;
 	}
-	idx++;
 
-	if (pending_transfer_count != buffer[1])
+	if (buffer[0] != (pkt->block ? CMD_DAP_TFER_BLOCK : CMD_DAP_TFER)) {
+		LOG_ERROR("CMSIS-DAP: unexpected response 0x%02x", buffer[0]);
+		return ERROR_FAIL;
+	}
+
+	if ((ack & 0x07) != SWD_ACK_OK || (ack & 0x08)) {
+		LOG_DEBUG("SWD ack not OK: %d %s", count,
+			  (ack & 0x07) == SWD_ACK_WAIT ? "WAIT" : (ack & 0x07) == SWD_ACK_FAULT ? "FAULT" : "JUNK");
+		return (ack & 0x07) == SWD_ACK_WAIT ? ERROR_WAIT : ERROR_FAIL;
+	}
+
+	if (pkt->count != count) {
 		LOG_ERROR("CMSIS-DAP transfer count mismatch: expected %d, got %d",
-			  pending_transfer_count, buffer[1]);
+			  pkt->count, count);
+		return ERROR_FAIL;
+	}
 
-	for (int i = 0; i < buffer[1]; i++) {
+	for (int i = pkt->first; i < pkt->first + count; i++) {
 		if (pending_transfers[i].cmd & SWD_CMD_RnW) {
 			static uint32_t last_read;
 			uint32_t data = le_to_h_u32(&buffer[idx]);
@@ -611,9 +966,59 @@ static int cmsis_dap_swd_run_queue(struct adiv5_dap *dap)
 		}
 	}
 
+	return ERROR_OK;
+}
+
+static int cmsis_dap_swd_run_queue(struct adiv5_dap *dap)
+{
+	struct pending_packet *in_flight = pending_packets;
+	int max_in_flight = MAX(cmsis_dap_handle->packet_count, 1);
+	int head = 0, num_in_flight = 0;
+	int next = 0;
+	int retval;
+
+	LOG_DEBUG("Executing %d queued transactions", pending_transfer_count);
+
+	if (queued_retval != ERROR_OK) {
+		LOG_DEBUG("Skipping due to previous errors: %d", queued_retval);
+		goto skip;
+	}
+
+	/* keep as many packets on their way as the adapter can buffer, so
+	 * it doesn't sit idle waiting for the host between them */
+	while (next < pending_transfer_count || num_in_flight > 0) {
+		while (queued_retval == ERROR_OK && next < pending_transfer_count
+				&& num_in_flight < max_in_flight) {
+			struct pending_packet *pkt = &in_flight[(head + num_in_flight) % max_in_flight];
+			size_t idx = cmsis_dap_encode_packet(next, pkt);
+
+			retval = cmsis_dap_handle->backend->write(cmsis_dap_handle, idx);
+			if (retval != ERROR_OK) {
+				queued_retval = retval;
+				break;
+			}
+			next += pkt->count;
+			num_in_flight++;
+		}
+
+		if (num_in_flight == 0)
+			break;
+
+		/* replies to packets written after a failure still have to be
+		 * read, they are dropped */
+		retval = cmsis_dap_handle->backend->read(cmsis_dap_handle);
+		if (retval == ERROR_OK && queued_retval == ERROR_OK)
+			retval = cmsis_dap_decode_packet(&in_flight[head]);
+		if (retval != ERROR_OK && queued_retval == ERROR_OK)
+			queued_retval = retval;
+
+		head = (head + 1) % max_in_flight;
+		num_in_flight--;
+	}
+
 skip:
 	pending_transfer_count = 0;
-	int retval = queued_retval;
+	retval = queued_retval;
 	queued_retval = ERROR_OK;
 
 	return retval;
@@ -629,6 +1034,25 @@ static void cmsis_dap_swd_queue_cmd(struct adiv5_dap *dap, uint8_t cmd, uint32_t
 	if (queued_retval != ERROR_OK)
 		return;
 
+	/* When proper WAIT handling is implemented in the
+	 * common SWD framework, this kludge can be
+	 * removed. However, this might lead to minor
+	 * performance degradation as the adapter wouldn't be
+	 * able to automatically retry anything (because ARM
+	 * has forgotten to implement sticky error flags
+	 * clearing). See also comments regarding
+	 * cmsis_dap_cmd_DAP_TFER_Configure() and
+	 * cmsis_dap_cmd_DAP_SWD_Configure() in
+	 * cmsis_dap_init().
+	 */
+	if (!(cmd & SWD_CMD_RnW) &&
+	    !(cmd & SWD_CMD_APnDP) &&
+	    (cmd & SWD_CMD_A32) >> 1 == DP_CTRL_STAT &&
+	    (data & CORUNDETECT)) {
+		LOG_DEBUG("refusing to enable sticky overrun detection");
+		data &= ~CORUNDETECT;
+	}
+
 	pending_transfers[pending_transfer_count].data = data;
 	pending_transfers[pending_transfer_count].cmd = cmd;
 	if (cmd & SWD_CMD_RnW) {
@@ -750,7 +1174,7 @@ static int cmsis_dap_swd_switch_seq(struct adiv5_dap *dap, enum swd_special_seq
 	buffer[2] = s_len;
 	bit_copy(&buffer[3], 0, s, 0, s_len);
 
-	retval = cmsis_dap_usb_xfer(cmsis_dap_handle, DIV_ROUND_UP(s_len, 8) + 3);
+	retval = cmsis_dap_xfer(cmsis_dap_handle, DIV_ROUND_UP(s_len, 8) + 3);
 
 	if (retval != ERROR_OK || buffer[1] != DAP_OK)
 		return ERROR_FAIL;
@@ -764,7 +1188,7 @@ static int cmsis_dap_swd_open(void)
 
 	if (cmsis_dap_handle == NULL) {
 		/* SWD init */
-		retval = cmsis_dap_usb_open();
+		retval = cmsis_dap_open();
 		if (retval != ERROR_OK)
 			return retval;
 
@@ -802,7 +1226,7 @@ static int cmsis_dap_init(void)
 	if (cmsis_dap_handle == NULL) {
 
 		/* JTAG init */
-		retval = cmsis_dap_usb_open();
+		retval = cmsis_dap_open();
 		if (retval != ERROR_OK)
 			return retval;
 
@@ -835,16 +1259,6 @@ static int cmsis_dap_init(void)
 	if (data[0] == 2) {  /* short */
 		uint16_t pkt_sz = data[1] + (data[2] << 8);
 
-		/* 4 bytes of command header + 5 bytes per register
-		 * write. For bulk read sequences just 4 bytes are
-		 * needed per transfer, so this is suboptimal. */
-		pending_queue_len = (pkt_sz - 4) / 5;
-		pending_transfers = malloc(pending_queue_len * sizeof(*pending_transfers));
-		if (!pending_transfers) {
-			LOG_ERROR("Unable to allocate memory for CMSIS-DAP queue");
-			return ERROR_FAIL;
-		}
-
 		if (cmsis_dap_handle->packet_size != pkt_sz + 1) {
 			/* reallocate buffer */
 			cmsis_dap_handle->packet_size = pkt_sz + 1;
@@ -870,6 +1284,17 @@ static int cmsis_dap_init(void)
 		LOG_DEBUG("CMSIS-DAP: Packet Count = %" PRId16, pkt_cnt);
 	}
 
+	/* enough transfers to fill every packet the adapter can buffer,
+	 * at 4 bytes per transfer in a DAP_TransferBlock */
+	unsigned pkt_cnt = MAX(cmsis_dap_handle->packet_count, 1);
+	pending_queue_len = pkt_cnt * ((cmsis_dap_handle->packet_size - 1 - 5) / 4);
+	pending_transfers = malloc(pending_queue_len * sizeof(*pending_transfers));
+	pending_packets = malloc(pkt_cnt * sizeof(*pending_packets));
+	if (!pending_transfers || !pending_packets) {
+		LOG_ERROR("Unable to allocate memory for CMSIS-DAP queue");
+		return ERROR_FAIL;
+	}
+
 	retval = cmsis_dap_get_status();
 	if (retval != ERROR_OK)
 		return ERROR_FAIL;
@@ -926,7 +1351,7 @@ static int cmsis_dap_quit(void)
 	cmsis_dap_cmd_DAP_Disconnect();
 	cmsis_dap_cmd_DAP_LED(0x00);		/* Both LEDs off */
 
-	cmsis_dap_usb_close(cmsis_dap_handle);
+	cmsis_dap_close(cmsis_dap_handle);
 
 	return ERROR_OK;
 }
@@ -1069,6 +1494,51 @@ COMMAND_HANDLER(cmsis_dap_handle_serial_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(cmsis_dap_handle_backend_command)
+{
+	static const struct cmsis_dap_backend * const backends[] = {
+		&cmsis_dap_hid_backend,
+		&cmsis_dap_socket_backend,
+	};
+
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	for (unsigned i = 0; i < ARRAY_SIZE(backends); i++) {
+		if (strcmp(CMD_ARGV[0], backends[i]->name) == 0) {
+			cmsis_dap_backend = backends[i];
+			return ERROR_OK;
+		}
+	}
+
+	LOG_ERROR("unknown CMSIS-DAP backend '%s'", CMD_ARGV[0]);
+	return ERROR_COMMAND_SYNTAX_ERROR;
+}
+
+COMMAND_HANDLER(cmsis_dap_handle_socket_host_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	free(cmsis_dap_socket_host);
+	cmsis_dap_socket_host = strdup(CMD_ARGV[0]);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(cmsis_dap_handle_socket_port_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	uint16_t port;
+	COMMAND_PARSE_NUMBER(u16, CMD_ARGV[0], port);
+	free(cmsis_dap_socket_port);
+	cmsis_dap_socket_port = strdup(CMD_ARGV[0]);
+
+	return ERROR_OK;
+}
+
 static const struct command_registration cmsis_dap_subcommand_handlers[] = {
 	{
 		.name = "info",
@@ -1102,6 +1572,29 @@ static const struct command_registration cmsis_dap_command_handlers[] = {
 		.help = "set the serial number of the adapter",
 		.usage = "serial_string",
 	},
+	{
+		.name = "cmsis_dap_backend",
+		.handler = &cmsis_dap_handle_backend_command,
+		.mode = COMMAND_CONFIG,
+		.help = "set how to talk to the adapter: 'hid' for USB HID, "
+			"'socket' for a software CMSIS-DAP",
+		.usage = "('hid'|'socket')",
+	},
+	{
+		.name = "cmsis_dap_socket_host",
+		.handler = &cmsis_dap_handle_socket_host_command,
+		.mode = COMMAND_CONFIG,
+		.help = "set the host of the socket backend, or the path of "
+			"its unix socket if no port is given",
+		.usage = "host_name|socket_path",
+	},
+	{
+		.name = "cmsis_dap_socket_port",
+		.handler = &cmsis_dap_handle_socket_port_command,
+		.mode = COMMAND_CONFIG,
+		.help = "set the TCP port of the socket backend",
+		.usage = "port_number",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -37,6 +37,12 @@
 #include <jtag/commands.h>
 #include <jtag/minidriver.h>
 #include <helper/command.h>
+#include <helper/time_support.h>
+#include "jtag_record.h"
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 struct jtag_callback_entry {
 	struct jtag_callback_entry *next;
@@ -126,11 +132,14 @@ int interface_jtag_add_ir_scan(struct jtag_tap *active,
 }
 
 /**
- * see jtag_add_dr_scan()
+ * Queue a DR scan command for @a active, with the fields of all bypassed
+ * TAPs filled in.
  *
+ * @returns the first of the @a in_num_fields fields belonging to
+ * @a active, for the caller to fill in.
  */
-int interface_jtag_add_dr_scan(struct jtag_tap *active, int in_num_fields,
-		const struct scan_field *in_fields, tap_state_t state)
+static struct scan_field *cmd_queue_add_dr_scan(struct jtag_tap *active,
+		int in_num_fields, tap_state_t state)
 {
 	/* count devices in bypass */
 
@@ -144,6 +153,7 @@ int interface_jtag_add_dr_scan(struct jtag_tap *active, int in_num_fields,
 	struct jtag_command *cmd = cmd_queue_alloc(sizeof(struct jtag_command));
 	struct scan_command *scan = cmd_queue_alloc(sizeof(struct scan_command));
 	struct scan_field *out_fields = cmd_queue_alloc((in_num_fields + bypass_devices) * sizeof(struct scan_field));
+	struct scan_field *active_fields = out_fields;
 
 	jtag_queue_command(cmd);
 
@@ -160,22 +170,15 @@ int interface_jtag_add_dr_scan(struct jtag_tap *active, int in_num_fields,
 	/* loop over all enabled TAPs */
 
 	for (struct jtag_tap *tap = jtag_tap_next_enabled(NULL); tap != NULL; tap = jtag_tap_next_enabled(tap)) {
-		/* if TAP is not bypassed insert matching input fields */
+		/* if TAP is not bypassed reserve room for the input fields */
 
 		if (!tap->bypass) {
 			assert(active == tap);
-#ifndef NDEBUG
-			/* remember initial position for assert() */
-			struct scan_field *start_field = field;
-#endif /* NDEBUG */
+			/* must have at least one input field per not bypassed TAP */
+			assert(in_num_fields > 0);
 
-			for (int j = 0; j < in_num_fields; j++) {
-				cmd_queue_scan_field_clone(field, in_fields + j);
-
-				field++;
-			}
-
-			assert(field > start_field);	/* must have at least one input field per not bypassed TAP */
+			active_fields = field;
+			field += in_num_fields;
 		}
 
 		/* if a TAP is bypassed, generated a dummy bit*/
@@ -190,6 +193,154 @@ int interface_jtag_add_dr_scan(struct jtag_tap *active, int in_num_fields,
 
 	assert(field == out_fields + scan->num_fields); /* no superfluous input fields permitted */
 
+	return active_fields;
+}
+
+/**
+ * see jtag_add_dr_scan()
+ *
+ */
+int interface_jtag_add_dr_scan(struct jtag_tap *active, int in_num_fields,
+		const struct scan_field *in_fields, tap_state_t state)
+{
+	struct scan_field *field = cmd_queue_add_dr_scan(active, in_num_fields, state);
+
+	for (int j = 0; j < in_num_fields; j++)
+		cmd_queue_scan_field_clone(field + j, in_fields + j);
+
+	return ERROR_OK;
+}
+
+/**
+ * Where a word oriented scan field wants its captured value delivered.
+ * The conversion to host order is done by a single callback per scan
+ * once the queue has been executed.
+ */
+struct scan_word_capture {
+	const uint8_t *captured;
+	void *dest;
+	int num_bits;
+};
+
+static int jtag_scan_u32_capture(jtag_callback_data_t data0,
+		jtag_callback_data_t data1,
+		jtag_callback_data_t data2,
+		jtag_callback_data_t data3)
+{
+	const struct scan_word_capture *capture = (const struct scan_word_capture *)data0;
+	int count = (int)data1;
+
+	for (int i = 0; i < count; i++, capture++)
+		*(uint32_t *)capture->dest = le_to_h_u32(capture->captured)
+				& (0xffffffff >> (32 - capture->num_bits));
+
+	return ERROR_OK;
+}
+
+static int jtag_scan_u64_capture(jtag_callback_data_t data0,
+		jtag_callback_data_t data1,
+		jtag_callback_data_t data2,
+		jtag_callback_data_t data3)
+{
+	const struct scan_word_capture *capture = (const struct scan_word_capture *)data0;
+	int count = (int)data1;
+
+	for (int i = 0; i < count; i++, capture++)
+		*(uint64_t *)capture->dest = le_to_h_u64(capture->captured)
+				& (0xffffffffffffffffULL >> (64 - capture->num_bits));
+
+	return ERROR_OK;
+}
+
+/**
+ * see jtag_add_dr_scan_u32()
+ *
+ */
+int interface_jtag_add_dr_scan_u32(struct jtag_tap *active, int in_num_fields,
+		const struct scan_field_u32 *in_fields, tap_state_t state)
+{
+	struct scan_field *field = cmd_queue_add_dr_scan(active, in_num_fields, state);
+	struct scan_word_capture *capture = NULL;
+	int num_captures = 0;
+
+	for (int j = 0; j < in_num_fields; j++) {
+		if (in_fields[j].in_value)
+			num_captures++;
+	}
+	if (num_captures)
+		capture = cmd_queue_alloc(num_captures * sizeof(*capture));
+	num_captures = 0;
+
+	for (int j = 0; j < in_num_fields; j++, field++) {
+		int num_bits = in_fields[j].num_bits;
+		uint8_t *out = cmd_queue_alloc(sizeof(uint32_t));
+
+		assert(num_bits > 0 && num_bits <= 32);
+		h_u32_to_le(out, in_fields[j].out_value & (0xffffffff >> (32 - num_bits)));
+
+		field->num_bits = num_bits;
+		field->out_value = out;
+		field->in_value = NULL;
+
+		if (in_fields[j].in_value) {
+			field->in_value = memset(cmd_queue_alloc(sizeof(uint32_t)), 0, sizeof(uint32_t));
+			capture[num_captures].captured = field->in_value;
+			capture[num_captures].dest = in_fields[j].in_value;
+			capture[num_captures].num_bits = num_bits;
+			num_captures++;
+		}
+	}
+
+	if (num_captures)
+		interface_jtag_add_callback4(jtag_scan_u32_capture,
+				(jtag_callback_data_t)capture, num_captures, 0, 0);
+
+	return ERROR_OK;
+}
+
+/**
+ * see jtag_add_dr_scan_u64()
+ *
+ */
+int interface_jtag_add_dr_scan_u64(struct jtag_tap *active, int in_num_fields,
+		const struct scan_field_u64 *in_fields, tap_state_t state)
+{
+	struct scan_field *field = cmd_queue_add_dr_scan(active, in_num_fields, state);
+	struct scan_word_capture *capture = NULL;
+	int num_captures = 0;
+
+	for (int j = 0; j < in_num_fields; j++) {
+		if (in_fields[j].in_value)
+			num_captures++;
+	}
+	if (num_captures)
+		capture = cmd_queue_alloc(num_captures * sizeof(*capture));
+	num_captures = 0;
+
+	for (int j = 0; j < in_num_fields; j++, field++) {
+		int num_bits = in_fields[j].num_bits;
+		uint8_t *out = cmd_queue_alloc(sizeof(uint64_t));
+
+		assert(num_bits > 0 && num_bits <= 64);
+		h_u64_to_le(out, in_fields[j].out_value & (0xffffffffffffffffULL >> (64 - num_bits)));
+
+		field->num_bits = num_bits;
+		field->out_value = out;
+		field->in_value = NULL;
+
+		if (in_fields[j].in_value) {
+			field->in_value = memset(cmd_queue_alloc(sizeof(uint64_t)), 0, sizeof(uint64_t));
+			capture[num_captures].captured = field->in_value;
+			capture[num_captures].dest = in_fields[j].in_value;
+			capture[num_captures].num_bits = num_bits;
+			num_captures++;
+		}
+	}
+
+	if (num_captures)
+		interface_jtag_add_callback4(jtag_scan_u64_capture,
+				(jtag_callback_data_t)capture, num_captures, 0, 0);
+
 	return ERROR_OK;
 }
 
@@ -373,25 +524,221 @@ void interface_jtag_add_callback4(jtag_callback_t callback,
 	}
 }
 
-int interface_jtag_execute_queue(void)
+/* a flushed queue, the callbacks queued with it and the driver's verdict */
+struct jtag_queue_batch {
+	struct jtag_command_batch commands;
+	struct jtag_callback_entry *callbacks;
+	int retval;
+};
+
+static void jtag_queue_batch_detach(struct jtag_queue_batch *batch)
 {
-	static int reentry;
+	jtag_command_queue_optimize();
+	jtag_command_queue_detach(&batch->commands);
 
-	assert(reentry == 0);
-	reentry++;
+	batch->callbacks = jtag_callback_queue_head;
+	batch->retval = ERROR_OK;
+	jtag_callback_queue_reset();
+}
+
+static void jtag_queue_batch_run(struct jtag_queue_batch *batch)
+{
+	jtag_command_queue = batch->commands.commands;
+	batch->retval = default_interface_jtag_execute_queue();
+	jtag_record_queue(jtag_command_queue, batch->retval);
+	jtag_command_queue = NULL;
+}
+
+/* run the callbacks of an executed batch, then release its memory */
+static int jtag_queue_batch_retire(struct jtag_queue_batch *batch)
+{
+	int retval = batch->retval;
 
-	int retval = default_interface_jtag_execute_queue();
 	if (retval == ERROR_OK) {
 		struct jtag_callback_entry *entry;
-		for (entry = jtag_callback_queue_head; entry != NULL; entry = entry->next) {
+		for (entry = batch->callbacks; entry != NULL; entry = entry->next) {
 			retval = entry->callback(entry->data0, entry->data1, entry->data2, entry->data3);
 			if (retval != ERROR_OK)
 				break;
 		}
 	}
 
-	jtag_command_queue_reset();
-	jtag_callback_queue_reset();
+	jtag_command_batch_free(&batch->commands);
+	batch->callbacks = NULL;
+
+	return retval;
+}
+
+#ifdef HAVE_PTHREAD_H
+
+/*
+ * Pipelined execution: a worker thread runs the driver on one batch while
+ * the caller builds the next one.  At most one batch is in flight; its
+ * callbacks run on the main thread when it is retired, i.e. when the next
+ * batch is submitted or at the next jtag_execute_queue().
+ *
+ * Drivers run on the worker thread.  Their LOG_* output is held back by
+ * the log module and printed on the main thread when it waits for or
+ * retires the batch; keep_alive() is a no-op there, the waiting main
+ * thread sends the keep-alives instead.
+ */
+enum jtag_pipeline_slot {
+	JTAG_PIPELINE_EMPTY,
+	JTAG_PIPELINE_QUEUED,
+	JTAG_PIPELINE_DONE,
+};
+
+static struct jtag_pipeline {
+	bool running;
+	bool quit;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	/* only the main thread moves the slot to or from EMPTY */
+	enum jtag_pipeline_slot slot;
+	struct jtag_queue_batch batch;
+} jtag_pipeline = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void *jtag_pipeline_worker(void *arg)
+{
+	pthread_mutex_lock(&jtag_pipeline.lock);
+	while (!jtag_pipeline.quit) {
+		if (jtag_pipeline.slot != JTAG_PIPELINE_QUEUED) {
+			pthread_cond_wait(&jtag_pipeline.cond, &jtag_pipeline.lock);
+			continue;
+		}
+		pthread_mutex_unlock(&jtag_pipeline.lock);
+
+		jtag_queue_batch_run(&jtag_pipeline.batch);
+
+		pthread_mutex_lock(&jtag_pipeline.lock);
+		jtag_pipeline.slot = JTAG_PIPELINE_DONE;
+		pthread_cond_broadcast(&jtag_pipeline.cond);
+	}
+	pthread_mutex_unlock(&jtag_pipeline.lock);
+
+	return NULL;
+}
+
+/* wait for the batch in flight, if any, and retire it */
+static int jtag_pipeline_retire(void)
+{
+	if (jtag_pipeline.slot == JTAG_PIPELINE_EMPTY)
+		return ERROR_OK;
+
+	pthread_mutex_lock(&jtag_pipeline.lock);
+	while (jtag_pipeline.slot == JTAG_PIPELINE_QUEUED) {
+		struct timeval now;
+		struct timespec deadline;
+
+		/* the worker can't talk to GDB; keep it alive from here */
+		gettimeofday(&now, NULL);
+		timeval_add_time(&now, 0, 100000);
+		deadline.tv_sec = now.tv_sec;
+		deadline.tv_nsec = now.tv_usec * 1000;
+		pthread_cond_timedwait(&jtag_pipeline.cond, &jtag_pipeline.lock, &deadline);
+
+		pthread_mutex_unlock(&jtag_pipeline.lock);
+		log_flush_deferred();
+		keep_alive();
+		pthread_mutex_lock(&jtag_pipeline.lock);
+	}
+	pthread_mutex_unlock(&jtag_pipeline.lock);
+
+	log_flush_deferred();
+	jtag_pipeline.slot = JTAG_PIPELINE_EMPTY;
+	return jtag_queue_batch_retire(&jtag_pipeline.batch);
+}
+
+static int jtag_pipeline_submit(void)
+{
+	int retval = jtag_pipeline_retire();
+
+	jtag_queue_batch_detach(&jtag_pipeline.batch);
+
+	pthread_mutex_lock(&jtag_pipeline.lock);
+	jtag_pipeline.slot = JTAG_PIPELINE_QUEUED;
+	pthread_cond_broadcast(&jtag_pipeline.cond);
+	pthread_mutex_unlock(&jtag_pipeline.lock);
+
+	return retval;
+}
+
+int interface_jtag_set_pipelined(bool enable)
+{
+	if (enable == jtag_pipeline.running)
+		return ERROR_OK;
+
+	if (enable) {
+		jtag_pipeline.quit = false;
+		if (pthread_create(&jtag_pipeline.thread, NULL, jtag_pipeline_worker, NULL) != 0) {
+			LOG_ERROR("failed to start the JTAG queue worker thread");
+			return ERROR_FAIL;
+		}
+		jtag_pipeline.running = true;
+		return ERROR_OK;
+	}
+
+	int retval = jtag_pipeline_retire();
+
+	pthread_mutex_lock(&jtag_pipeline.lock);
+	jtag_pipeline.quit = true;
+	pthread_cond_broadcast(&jtag_pipeline.cond);
+	pthread_mutex_unlock(&jtag_pipeline.lock);
+
+	pthread_join(jtag_pipeline.thread, NULL);
+	jtag_pipeline.running = false;
+
+	return retval;
+}
+
+#else
+
+static int jtag_pipeline_retire(void)
+{
+	return ERROR_OK;
+}
+
+int interface_jtag_set_pipelined(bool enable)
+{
+	if (!enable)
+		return ERROR_OK;
+
+	LOG_ERROR("pipelined JTAG queue execution needs thread support");
+	return ERROR_JTAG_NOT_IMPLEMENTED;
+}
+
+#endif
+
+int interface_jtag_submit_queue(void)
+{
+#ifdef HAVE_PTHREAD_H
+	if (jtag_pipeline.running)
+		return jtag_pipeline_submit();
+#endif
+	return interface_jtag_execute_queue();
+}
+
+int interface_jtag_execute_queue(void)
+{
+	static int reentry;
+	struct jtag_queue_batch batch;
+
+	assert(reentry == 0);
+	reentry++;
+
+	/* the batch in flight goes first, its callbacks included */
+	int retval = jtag_pipeline_retire();
+
+	jtag_queue_batch_detach(&batch);
+	jtag_queue_batch_run(&batch);
+
+	int retire = jtag_queue_batch_retire(&batch);
+	if (retval == ERROR_OK)
+		retval = retire;
 
 	reentry--;
 
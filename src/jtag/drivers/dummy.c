@@ -35,50 +35,394 @@ static int clock_count;		/* count clocks in any stable state, only stable states
 
 static uint32_t dummy_data;
 
+/* all rising edges of TCK, for "dummy tck_count" */
+static uint64_t dummy_tck_count;
+
+/*
+ * Simulated scan chain, set up with "dummy tap" and "dummy dap".  Each
+ * TAP has the standard IR and BYPASS, optionally IDCODE, data registers
+ * defined with "dummy dr" and, for a "dummy dap", the JTAG-DP registers
+ * of an ADIv5 DAP whose MEM-AP 0 is backed by sparse memory.  With no
+ * TAPs, TDO just returns dummy_data as it always did.
+ */
+
+#define DUMMY_DR_MAX_BITS	64
+
+/* JTAG-DP instructions and ACK, see adi_v5_jtag.c */
+#define DUMMY_DP_ABORT		0x8
+#define DUMMY_DP_IDCODE		0xE
+#define DUMMY_ACK_OK_FAULT	0x2
+
+#define DUMMY_MEM_PAGE_SIZE	4096
+#define DUMMY_MEM_HASH_SIZE	1024
+
+struct dummy_dr {
+	uint32_t instruction;
+	unsigned length;
+	uint64_t value;
+	struct dummy_dr *next;
+};
+
+struct dummy_mem_page {
+	uint32_t address;
+	struct dummy_mem_page *next;
+	uint8_t data[DUMMY_MEM_PAGE_SIZE];
+};
+
+struct dummy_dap {
+	uint32_t ctrl_stat;
+	uint32_t select;
+	/* captured by the next DPACC/APACC scan */
+	uint32_t read_result;
+
+	/* MEM-AP 0 */
+	uint32_t csw;
+	uint32_t tar;
+	struct dummy_mem_page *mem[DUMMY_MEM_HASH_SIZE];
+};
+
+struct dummy_tap {
+	unsigned ir_length;
+	uint32_t idcode;		/* 0 if the TAP has no IDCODE register */
+	uint32_t idcode_instruction;
+	uint32_t ir;
+
+	/* the register between TDI and TDO while shifting */
+	uint64_t shift;
+	unsigned shift_length;
+
+	struct dummy_dr *drs;
+	struct dummy_dap *dap;
+};
+
+/* the TAP nearest to TDO comes first, as with "jtag newtap" */
+static struct dummy_tap **dummy_taps;
+static unsigned dummy_num_taps;
+
+static uint64_t dummy_mask(unsigned bits)
+{
+	return bits >= 64 ? ~0ULL : (1ULL << bits) - 1;
+}
+
+static uint8_t *dummy_mem_byte(struct dummy_dap *dap, uint32_t address, bool create)
+{
+	uint32_t page_address = address & ~(DUMMY_MEM_PAGE_SIZE - 1);
+	unsigned hash = (page_address / DUMMY_MEM_PAGE_SIZE) % DUMMY_MEM_HASH_SIZE;
+	struct dummy_mem_page *page;
+
+	for (page = dap->mem[hash]; page; page = page->next)
+		if (page->address == page_address)
+			return &page->data[address - page_address];
+
+	if (!create)
+		return NULL;
+
+	page = calloc(1, sizeof(*page));
+	if (!page) {
+		LOG_ERROR("dummy: out of memory");
+		return NULL;
+	}
+	page->address = page_address;
+	page->next = dap->mem[hash];
+	dap->mem[hash] = page;
+
+	return &page->data[address - page_address];
+}
+
+/* memory never written reads as zero */
+static uint32_t dummy_mem_read(struct dummy_dap *dap, uint32_t address, unsigned size)
+{
+	uint32_t value = 0;
+
+	for (unsigned i = 0; i < size; i++) {
+		uint8_t *p = dummy_mem_byte(dap, address + i, false);
+		if (p)
+			value |= *p << (8 * i);
+	}
+
+	return value;
+}
+
+static void dummy_mem_write(struct dummy_dap *dap, uint32_t address, unsigned size, uint32_t value)
+{
+	for (unsigned i = 0; i < size; i++) {
+		uint8_t *p = dummy_mem_byte(dap, address + i, true);
+		if (p)
+			*p = value >> (8 * i);
+	}
+}
+
+/* DRW: the data sits on the byte lanes of the address */
+static uint32_t dummy_mem_ap_drw(struct dummy_dap *dap, bool read, uint32_t value)
+{
+	unsigned size = MIN(1u << (dap->csw & 7), 4u);
+	unsigned lane = dap->tar & 3 & ~(size - 1);
+	uint32_t address = dap->tar & ~(size - 1);
+
+	if (read)
+		value = dummy_mem_read(dap, address, size) << (8 * lane);
+	else
+		dummy_mem_write(dap, address, size, value >> (8 * lane));
+
+	/* the TAR increments only within 1kB */
+	if ((dap->csw & CSW_ADDRINC_MASK) != CSW_ADDRINC_OFF)
+		dap->tar = (dap->tar & ~0x3ffu) | ((dap->tar + size) & 0x3ff);
+
+	return value;
+}
+
+static uint32_t dummy_mem_ap_access(struct dummy_dap *dap, unsigned reg, bool read, uint32_t value)
+{
+	switch (reg) {
+		case AP_REG_CSW:
+			if (!read) {
+				/* no packed transfers */
+				if ((value & CSW_ADDRINC_MASK) == CSW_ADDRINC_PACKED)
+					value = (value & ~CSW_ADDRINC_MASK) | CSW_ADDRINC_SINGLE;
+				dap->csw = value & ~(CSW_DEVICE_EN | CSW_TRIN_PROG);
+			}
+			return dap->csw | CSW_DEVICE_EN;
+		case AP_REG_TAR:
+			if (!read)
+				dap->tar = value;
+			return dap->tar;
+		case AP_REG_DRW:
+			return dummy_mem_ap_drw(dap, read, value);
+		case AP_REG_BD0:
+		case AP_REG_BD1:
+		case AP_REG_BD2:
+		case AP_REG_BD3:
+		{
+			uint32_t address = (dap->tar & ~0xfu) | (reg & 0xc);
+			if (read)
+				return dummy_mem_read(dap, address, 4);
+			dummy_mem_write(dap, address, 4, value);
+			return value;
+		}
+		case AP_REG_BASE:
+			/* no debug entries */
+			return 0xffffffff;
+		case AP_REG_IDR:
+			/* an AHB-AP */
+			return 0x24770011;
+		default:
+			return 0;
+	}
+}
+
+static uint32_t dummy_dap_transaction(struct dummy_dap *dap, bool ap, unsigned reg,
+		bool read, uint32_t value)
+{
+	if (ap) {
+		/* there is only MEM-AP 0 */
+		if (dap->select >> 24)
+			return 0;
+		return dummy_mem_ap_access(dap, (dap->select & 0xf0) | reg, read, value);
+	}
+
+	switch (reg) {
+		case DP_CTRL_STAT:
+			if (!read) {
+				/* power up requests are granted at once */
+				value &= ~(CDBGPWRUPACK | CSYSPWRUPACK | CDBGRSTACK);
+				value |= (value & (CDBGPWRUPREQ | CSYSPWRUPREQ | CDBGRSTREQ)) << 1;
+				dap->ctrl_stat = value;
+			}
+			return dap->ctrl_stat;
+		case DP_SELECT:
+			if (!read)
+				dap->select = value;
+			return dap->select;
+		default:
+			return 0;
+	}
+}
+
+static struct dummy_dr *dummy_find_dr(struct dummy_tap *tap)
+{
+	for (struct dummy_dr *dr = tap->drs; dr; dr = dr->next)
+		if (dr->instruction == tap->ir)
+			return dr;
+	return NULL;
+}
+
+static void dummy_capture(bool ir)
+{
+	for (unsigned i = 0; i < dummy_num_taps; i++) {
+		struct dummy_tap *tap = dummy_taps[i];
+		struct dummy_dr *dr;
+
+		if (ir) {
+			/* IEEE 1149.1 wants 01 in the low bits */
+			tap->shift = 1;
+			tap->shift_length = tap->ir_length;
+		} else if (tap->ir == dummy_mask(tap->ir_length)) {
+			tap->shift = 0;
+			tap->shift_length = 1;
+		} else if (tap->dap && (tap->ir == JTAG_DP_DPACC || tap->ir == JTAG_DP_APACC)) {
+			tap->shift = ((uint64_t)tap->dap->read_result << 3) | DUMMY_ACK_OK_FAULT;
+			tap->shift_length = 35;
+		} else if (tap->dap && tap->ir == DUMMY_DP_ABORT) {
+			tap->shift = 0;
+			tap->shift_length = 35;
+		} else if (tap->idcode && tap->ir == tap->idcode_instruction) {
+			tap->shift = tap->idcode;
+			tap->shift_length = 32;
+		} else if ((dr = dummy_find_dr(tap))) {
+			tap->shift = dr->value;
+			tap->shift_length = dr->length;
+		} else {
+			/* unknown instructions select BYPASS */
+			tap->shift = 0;
+			tap->shift_length = 1;
+		}
+	}
+}
+
+static void dummy_update(bool ir)
+{
+	for (unsigned i = 0; i < dummy_num_taps; i++) {
+		struct dummy_tap *tap = dummy_taps[i];
+		struct dummy_dr *dr;
+
+		if (ir) {
+			tap->ir = tap->shift;
+			continue;
+		}
+
+		if (tap->dap && (tap->ir == JTAG_DP_DPACC || tap->ir == JTAG_DP_APACC)) {
+			bool read = tap->shift & 1;
+			unsigned reg = (tap->shift & 6) << 1;
+			uint32_t value = tap->shift >> 3;
+
+			value = dummy_dap_transaction(tap->dap, tap->ir == JTAG_DP_APACC,
+					reg, read, value);
+			tap->dap->read_result = read ? value : 0;
+		} else if ((dr = dummy_find_dr(tap)) && dr->length == tap->shift_length)
+			dr->value = tap->shift;
+	}
+}
+
+static void dummy_shift(int tdi)
+{
+	uint64_t bit = tdi ? 1 : 0;
+
+	/* TDI enters the TAP furthest from TDO */
+	for (unsigned i = dummy_num_taps; i-- > 0; ) {
+		struct dummy_tap *tap = dummy_taps[i];
+		uint64_t out = tap->shift & 1;
+
+		tap->shift = (tap->shift >> 1) | (bit << (tap->shift_length - 1));
+		bit = out;
+	}
+}
+
+static void dummy_reset_taps(void)
+{
+	for (unsigned i = 0; i < dummy_num_taps; i++) {
+		struct dummy_tap *tap = dummy_taps[i];
+
+		if (tap->idcode)
+			tap->ir = tap->idcode_instruction;
+		else
+			tap->ir = dummy_mask(tap->ir_length);
+	}
+}
+
 static int dummy_read(void)
 {
+	if (dummy_num_taps) {
+		if (dummy_state == TAP_DRSHIFT || dummy_state == TAP_IRSHIFT)
+			return dummy_taps[0]->shift & 1;
+		return 0;
+	}
+
 	int data = 1 & dummy_data;
 	dummy_data = (dummy_data >> 1) | (1 << 31);
 	return data;
 }
 
-static void dummy_write(int tck, int tms, int tdi)
+/* TAP standard: "state transitions occur on rising edge of clock" */
+static void dummy_rising_edge(int tms, int tdi)
 {
-	/* TAP standard: "state transitions occur on rising edge of clock" */
-	if (tck != dummy_clock) {
-		if (tck) {
-			tap_state_t old_state = dummy_state;
-			dummy_state = tap_state_transition(old_state, tms);
-
-			if (old_state != dummy_state) {
-				if (clock_count) {
-					LOG_DEBUG("dummy_tap: %d stable clocks", clock_count);
-					clock_count = 0;
-				}
+	tap_state_t old_state = dummy_state;
+	dummy_state = tap_state_transition(old_state, tms);
+	dummy_tck_count++;
+
+	if (dummy_num_taps) {
+		if (old_state == TAP_DRCAPTURE || old_state == TAP_IRCAPTURE)
+			dummy_capture(old_state == TAP_IRCAPTURE);
+		else if (old_state == TAP_DRSHIFT || old_state == TAP_IRSHIFT)
+			dummy_shift(tdi);
 
-				LOG_DEBUG("dummy_tap: %s", tap_state_name(dummy_state));
+		if (dummy_state == TAP_DRUPDATE || dummy_state == TAP_IRUPDATE)
+			dummy_update(dummy_state == TAP_IRUPDATE);
+		else if (dummy_state == TAP_RESET && old_state != TAP_RESET)
+			dummy_reset_taps();
+	}
+
+	if (old_state != dummy_state) {
+		if (clock_count) {
+			LOG_DEBUG("dummy_tap: %d stable clocks", clock_count);
+			clock_count = 0;
+		}
+
+		LOG_DEBUG("dummy_tap: %s", tap_state_name(dummy_state));
 
 #if defined(DEBUG)
-				if (dummy_state == TAP_DRCAPTURE)
-					dummy_data = 0x01255043;
+		if (dummy_state == TAP_DRCAPTURE)
+			dummy_data = 0x01255043;
 #endif
-			} else {
-				/* this is a stable state clock edge, no change of state here,
-				 * simply increment clock_count for subsequent logging
-				 */
-				++clock_count;
-			}
-		}
+	} else {
+		/* this is a stable state clock edge, no change of state here,
+		 * simply increment clock_count for subsequent logging
+		 */
+		++clock_count;
+	}
+}
+
+static void dummy_write(int tck, int tms, int tdi)
+{
+	if (tck != dummy_clock) {
+		if (tck)
+			dummy_rising_edge(tms, tdi);
 		dummy_clock = tck;
 	}
 }
 
+static void dummy_tms_seq(const uint8_t *bits, unsigned offset, unsigned num_bits)
+{
+	for (unsigned i = offset; i < offset + num_bits; i++)
+		dummy_rising_edge((bits[i / 8] >> (i % 8)) & 1, 0);
+	dummy_clock = 0;
+}
+
+static void dummy_shift_buf(const uint8_t *tdi, uint8_t *tdo, unsigned offset,
+		unsigned num_bits, bool exit)
+{
+	for (unsigned i = offset; i < offset + num_bits; i++) {
+		int tms = exit && i == offset + num_bits - 1;
+		int bit = tdi ? (tdi[i / 8] >> (i % 8)) & 1 : 0;
+
+		if (tdo) {
+			if (dummy_read())
+				tdo[i / 8] |= 1 << (i % 8);
+			else
+				tdo[i / 8] &= ~(1 << (i % 8));
+		}
+		dummy_rising_edge(tms, bit);
+	}
+	dummy_clock = 1;
+}
+
 static void dummy_reset(int trst, int srst)
 {
 	dummy_clock = 0;
 
-	if (trst || (srst && (jtag_get_reset_config() & RESET_SRST_PULLS_TRST)))
+	if (trst || (srst && (jtag_get_reset_config() & RESET_SRST_PULLS_TRST))) {
 		dummy_state = TAP_RESET;
+		dummy_reset_taps();
+	}
 
 	LOG_DEBUG("reset to: %s", tap_state_name(dummy_state));
 }
@@ -92,6 +436,8 @@ static struct bitbang_interface dummy_bitbang = {
 		.write = &dummy_write,
 		.reset = &dummy_reset,
 		.blink = &dummy_led,
+		.tms_seq = &dummy_tms_seq,
+		.shift_buf = &dummy_shift_buf,
 	};
 
 static int dummy_khz(int khz, int *jtag_speed)
@@ -127,16 +473,207 @@ static int dummy_init(void)
 
 static int dummy_quit(void)
 {
+	for (unsigned i = 0; i < dummy_num_taps; i++) {
+		struct dummy_tap *tap = dummy_taps[i];
+
+		while (tap->drs) {
+			struct dummy_dr *dr = tap->drs;
+			tap->drs = dr->next;
+			free(dr);
+		}
+
+		if (tap->dap) {
+			for (unsigned j = 0; j < DUMMY_MEM_HASH_SIZE; j++) {
+				while (tap->dap->mem[j]) {
+					struct dummy_mem_page *page = tap->dap->mem[j];
+					tap->dap->mem[j] = page->next;
+					free(page);
+				}
+			}
+			free(tap->dap);
+		}
+		free(tap);
+	}
+
+	free(dummy_taps);
+	dummy_taps = NULL;
+	dummy_num_taps = 0;
+
 	return ERROR_OK;
 }
 
+static struct dummy_tap *dummy_add_tap(unsigned ir_length, uint32_t idcode,
+		uint32_t idcode_instruction)
+{
+	struct dummy_tap **taps = realloc(dummy_taps, (dummy_num_taps + 1) * sizeof(*taps));
+	if (!taps)
+		return NULL;
+	dummy_taps = taps;
+
+	struct dummy_tap *tap = calloc(1, sizeof(*tap));
+	if (!tap)
+		return NULL;
+
+	tap->ir_length = ir_length;
+	tap->idcode = idcode;
+	tap->idcode_instruction = idcode_instruction;
+	tap->shift_length = 1;
+	tap->ir = idcode ? idcode_instruction : dummy_mask(ir_length);
+
+	dummy_taps[dummy_num_taps++] = tap;
+	return tap;
+}
+
+COMMAND_HANDLER(dummy_handle_tap_command)
+{
+	unsigned ir_length;
+	uint32_t idcode = 0, idcode_instruction = 1;
+
+	if (CMD_ARGC < 1 || CMD_ARGC > 3)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], ir_length);
+	if (CMD_ARGC > 1)
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], idcode);
+	if (CMD_ARGC > 2)
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[2], idcode_instruction);
+
+	if (ir_length < 2 || ir_length > 32) {
+		command_print(CMD_CTX, "IR length must be 2 to 32 bits");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+	if (idcode && !(idcode & 1)) {
+		command_print(CMD_CTX, "an IDCODE has bit 0 set");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	if (!dummy_add_tap(ir_length, idcode, idcode_instruction)) {
+		LOG_ERROR("dummy: out of memory");
+		return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(dummy_handle_dap_command)
+{
+	uint32_t idcode = 0x4ba00477;
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	if (CMD_ARGC == 1)
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], idcode);
+
+	struct dummy_tap *tap = dummy_add_tap(4, idcode, DUMMY_DP_IDCODE);
+	if (tap)
+		tap->dap = calloc(1, sizeof(*tap->dap));
+	if (!tap || !tap->dap) {
+		LOG_ERROR("dummy: out of memory");
+		return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(dummy_handle_dr_command)
+{
+	unsigned index, length;
+	uint32_t instruction;
+	uint64_t value = 0;
+
+	if (CMD_ARGC < 3 || CMD_ARGC > 4)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], index);
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], instruction);
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[2], length);
+	if (CMD_ARGC > 3)
+		COMMAND_PARSE_NUMBER(u64, CMD_ARGV[3], value);
+
+	if (index >= dummy_num_taps) {
+		command_print(CMD_CTX, "no TAP %u in the simulated chain", index);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+	if (length < 1 || length > DUMMY_DR_MAX_BITS) {
+		command_print(CMD_CTX, "DR length must be 1 to %d bits", DUMMY_DR_MAX_BITS);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	struct dummy_dr *dr = calloc(1, sizeof(*dr));
+	if (!dr) {
+		LOG_ERROR("dummy: out of memory");
+		return ERROR_FAIL;
+	}
+	dr->instruction = instruction;
+	dr->length = length;
+	dr->value = value & dummy_mask(length);
+	dr->next = dummy_taps[index]->drs;
+	dummy_taps[index]->drs = dr;
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(dummy_handle_tck_count_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "reset") != 0)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		dummy_tck_count = 0;
+	}
+
+	command_print(CMD_CTX, "%" PRIu64, dummy_tck_count);
+	return ERROR_OK;
+}
+
+static const struct command_registration dummy_subcommand_handlers[] = {
+	{
+		.name = "tap",
+		.handler = &dummy_handle_tap_command,
+		.mode = COMMAND_CONFIG,
+		.help = "add a TAP to the simulated scan chain, after the ones "
+			"added before, as seen from TDO",
+		.usage = "ir_length [idcode [idcode_instruction]]",
+	},
+	{
+		.name = "dap",
+		.handler = &dummy_handle_dap_command,
+		.mode = COMMAND_CONFIG,
+		.help = "add an ADIv5 JTAG-DP to the simulated scan chain, "
+			"with a MEM-AP backed by memory",
+		.usage = "[idcode]",
+	},
+	{
+		.name = "dr",
+		.handler = &dummy_handle_dr_command,
+		.mode = COMMAND_CONFIG,
+		.help = "add a data register to a simulated TAP, "
+			"selected by an instruction",
+		.usage = "tap_index instruction length [value]",
+	},
+	{
+		.name = "tck_count",
+		.handler = &dummy_handle_tck_count_command,
+		.mode = COMMAND_ANY,
+		.help = "show the number of TCK cycles so far, "
+			"optionally starting again from zero",
+		.usage = "['reset']",
+	},
+	{
+		.chain = hello_command_handlers,
+	},
+	COMMAND_REGISTRATION_DONE,
+};
+
 static const struct command_registration dummy_command_handlers[] = {
 	{
 		.name = "dummy",
 		.mode = COMMAND_ANY,
 		.help = "dummy interface driver commands",
 
-		.chain = hello_command_handlers,
+		.chain = dummy_subcommand_handlers,
 	},
 	COMMAND_REGISTRATION_DONE,
 };
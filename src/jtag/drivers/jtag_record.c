@@ -0,0 +1,238 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.           *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <jtag/jtag.h>
+#include <jtag/commands.h>
+#include <helper/command.h>
+#include "jtag_record.h"
+
+static FILE *jtag_record_file;
+static char *jtag_record_name;
+static struct jtag_record_buf jtag_record_buffer;
+
+uint8_t *jtag_record_reserve(struct jtag_record_buf *buf, size_t size)
+{
+	if (buf->failed)
+		return NULL;
+
+	if (buf->used + size > buf->size) {
+		size_t new_size = MAX(MAX(2 * buf->size, buf->used + size), 4096u);
+		uint8_t *data = realloc(buf->data, new_size);
+		if (!data) {
+			buf->failed = true;
+			return NULL;
+		}
+		buf->data = data;
+		buf->size = new_size;
+	}
+
+	uint8_t *p = buf->data + buf->used;
+	buf->used += size;
+	return p;
+}
+
+static void jtag_record_u8(struct jtag_record_buf *buf, uint8_t value)
+{
+	uint8_t *p = jtag_record_reserve(buf, 1);
+	if (p)
+		*p = value;
+}
+
+static void jtag_record_u32(struct jtag_record_buf *buf, uint32_t value)
+{
+	uint8_t *p = jtag_record_reserve(buf, 4);
+	if (p)
+		h_u32_to_le(p, value);
+}
+
+static void jtag_record_bits(struct jtag_record_buf *buf,
+		const uint8_t *bits, unsigned num_bits)
+{
+	uint8_t *p = jtag_record_reserve(buf, DIV_ROUND_UP(num_bits, 8));
+	if (p)
+		memcpy(p, bits, DIV_ROUND_UP(num_bits, 8));
+}
+
+static void jtag_record_scan(struct jtag_record_buf *buf,
+		const struct scan_command *scan, bool captured)
+{
+	jtag_record_u8(buf, scan->ir_scan ? JTAG_RECORD_SCAN_IR : 0);
+	jtag_record_u8(buf, scan->end_state);
+	jtag_record_u32(buf, scan->num_fields);
+
+	for (int i = 0; i < scan->num_fields; i++) {
+		const struct scan_field *field = &scan->fields[i];
+		uint8_t flags = 0;
+
+		if (field->out_value)
+			flags |= JTAG_RECORD_FIELD_OUT;
+		if (field->in_value)
+			flags |= JTAG_RECORD_FIELD_IN;
+
+		jtag_record_u32(buf, field->num_bits);
+		jtag_record_u8(buf, flags);
+		if (field->out_value)
+			jtag_record_bits(buf, field->out_value, field->num_bits);
+		if (field->in_value && captured)
+			jtag_record_bits(buf, field->in_value, field->num_bits);
+	}
+}
+
+int jtag_record_encode(struct jtag_record_buf *buf, const struct jtag_command *cmd,
+		bool captured, int retval)
+{
+	for (; cmd; cmd = cmd->next) {
+		switch (cmd->type) {
+			case JTAG_SCAN:
+				jtag_record_u8(buf, JTAG_RECORD_SCAN);
+				jtag_record_scan(buf, cmd->cmd.scan, captured);
+				break;
+			case JTAG_TLR_RESET:
+				jtag_record_u8(buf, JTAG_RECORD_TLR_RESET);
+				jtag_record_u8(buf, cmd->cmd.statemove->end_state);
+				break;
+			case JTAG_RUNTEST:
+				jtag_record_u8(buf, JTAG_RECORD_RUNTEST);
+				jtag_record_u32(buf, cmd->cmd.runtest->num_cycles);
+				jtag_record_u8(buf, cmd->cmd.runtest->end_state);
+				break;
+			case JTAG_RESET:
+				jtag_record_u8(buf, JTAG_RECORD_RESET);
+				jtag_record_u8(buf, cmd->cmd.reset->trst);
+				jtag_record_u8(buf, cmd->cmd.reset->srst);
+				break;
+			case JTAG_PATHMOVE:
+				jtag_record_u8(buf, JTAG_RECORD_PATHMOVE);
+				jtag_record_u32(buf, cmd->cmd.pathmove->num_states);
+				for (int i = 0; i < cmd->cmd.pathmove->num_states; i++)
+					jtag_record_u8(buf, cmd->cmd.pathmove->path[i]);
+				break;
+			case JTAG_SLEEP:
+				jtag_record_u8(buf, JTAG_RECORD_SLEEP);
+				jtag_record_u32(buf, cmd->cmd.sleep->us);
+				break;
+			case JTAG_STABLECLOCKS:
+				jtag_record_u8(buf, JTAG_RECORD_STABLECLOCKS);
+				jtag_record_u32(buf, cmd->cmd.stableclocks->num_cycles);
+				break;
+			case JTAG_TMS:
+				jtag_record_u8(buf, JTAG_RECORD_TMS);
+				jtag_record_u32(buf, cmd->cmd.tms->num_bits);
+				jtag_record_bits(buf, cmd->cmd.tms->bits, cmd->cmd.tms->num_bits);
+				break;
+			default:
+				LOG_ERROR("BUG: unknown JTAG command type 0x%X encountered", cmd->type);
+				break;
+		}
+	}
+
+	jtag_record_u8(buf, JTAG_RECORD_FLUSH);
+	jtag_record_u32(buf, retval);
+
+	if (buf->failed) {
+		LOG_ERROR("out of memory");
+		return ERROR_FAIL;
+	}
+	return ERROR_OK;
+}
+
+void jtag_record_buf_free(struct jtag_record_buf *buf)
+{
+	free(buf->data);
+	buf->data = NULL;
+	buf->size = 0;
+	buf->used = 0;
+	buf->failed = false;
+}
+
+static void jtag_record_stop(void)
+{
+	if (!jtag_record_file)
+		return;
+
+	if (fclose(jtag_record_file) != 0)
+		LOG_ERROR("error writing JTAG trace '%s'", jtag_record_name);
+
+	jtag_record_file = NULL;
+	free(jtag_record_name);
+	jtag_record_name = NULL;
+	jtag_record_buf_free(&jtag_record_buffer);
+}
+
+void jtag_record_queue(const struct jtag_command *cmd, int retval)
+{
+	struct jtag_record_buf *buf = &jtag_record_buffer;
+
+	if (!jtag_record_file)
+		return;
+
+	buf->used = 0;
+	if (jtag_record_encode(buf, cmd, true, retval) != ERROR_OK
+			|| fwrite(buf->data, 1, buf->used, jtag_record_file) != buf->used) {
+		LOG_ERROR("error writing JTAG trace '%s', recording stopped", jtag_record_name);
+		jtag_record_stop();
+	}
+}
+
+COMMAND_HANDLER(handle_jtag_record_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		/* don't mix commands queued before and after the switch */
+		int retval = jtag_execute_queue();
+		if (retval != ERROR_OK)
+			return retval;
+
+		jtag_record_stop();
+
+		if (strcmp(CMD_ARGV[0], "off") != 0) {
+			jtag_record_file = fopen(CMD_ARGV[0], "wb");
+			if (!jtag_record_file) {
+				LOG_ERROR("can't open '%s' for writing", CMD_ARGV[0]);
+				return ERROR_FAIL;
+			}
+			jtag_record_name = strdup(CMD_ARGV[0]);
+			fwrite(JTAG_RECORD_MAGIC, 1, strlen(JTAG_RECORD_MAGIC), jtag_record_file);
+		}
+	}
+
+	if (jtag_record_file)
+		command_print(CMD_CTX, "recording JTAG queues to '%s'", jtag_record_name);
+	else
+		command_print(CMD_CTX, "JTAG queues are not recorded");
+
+	return ERROR_OK;
+}
+
+const struct command_registration jtag_record_command_handlers[] = {
+	{
+		.name = "record",
+		.mode = COMMAND_EXEC,
+		.handler = handle_jtag_record_command,
+		.help = "Write every executed JTAG command, with the data "
+			"it captured, to a binary trace file; "
+			"'off' stops recording.",
+		.usage = "[filename|'off']",
+	},
+	COMMAND_REGISTRATION_DONE
+};
@@ -0,0 +1,103 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.           *
+ ***************************************************************************/
+
+#ifndef JTAG_RECORD_H
+#define JTAG_RECORD_H
+
+/**
+ * @file
+ * Binary trace of executed JTAG command queues, written by "jtag record"
+ * and read back by the replay interface driver.
+ *
+ * The file starts with JTAG_RECORD_MAGIC, followed by one record per
+ * command and a JTAG_RECORD_FLUSH record closing each executed queue.
+ * A record is a type byte and its payload; multi-byte numbers are
+ * little endian, bit buffers take DIV_ROUND_UP(num_bits, 8) bytes:
+ *
+ * - SCAN: u8 flags (JTAG_RECORD_SCAN_IR), u8 end state, u32 field count,
+ *   then per field: u32 num_bits, u8 flags (JTAG_RECORD_FIELD_*),
+ *   the bits shifted out if FIELD_OUT and, in traces, the bits captured
+ *   if FIELD_IN
+ * - TLR_RESET: u8 end state
+ * - RUNTEST: u32 cycles, u8 end state
+ * - RESET: s8 trst, s8 srst
+ * - PATHMOVE: u32 state count, u8 per state
+ * - SLEEP: u32 microseconds
+ * - STABLECLOCKS: u32 cycles
+ * - TMS: u32 num_bits, the bits
+ * - FLUSH: s32 value returned by the driver for the queue
+ *
+ * The remote_jtag driver ships queues to a "jtag_server" with the same
+ * records.  The client sends JTAG_RECORD_MAGIC once, then per queue a u32
+ * length and the queue encoded without captured bits.  The server runs
+ * the queue on its own adapter and answers with a u32 length, the s32
+ * result and the bits captured for each FIELD_IN field, in queue order.
+ */
+
+#define JTAG_RECORD_MAGIC "OCDJTRC1"
+
+enum jtag_record_type {
+	JTAG_RECORD_SCAN = 1,
+	JTAG_RECORD_TLR_RESET = 2,
+	JTAG_RECORD_RUNTEST = 3,
+	JTAG_RECORD_RESET = 4,
+	JTAG_RECORD_PATHMOVE = 5,
+	JTAG_RECORD_SLEEP = 6,
+	JTAG_RECORD_STABLECLOCKS = 7,
+	JTAG_RECORD_TMS = 8,
+	JTAG_RECORD_FLUSH = 0xff,
+};
+
+#define JTAG_RECORD_SCAN_IR     0x01
+
+#define JTAG_RECORD_FIELD_OUT   0x01
+#define JTAG_RECORD_FIELD_IN    0x02
+
+/** Upper bound for messages exchanged with a jtag_server. */
+#define JTAG_RECORD_MESSAGE_MAX (64 * 1024 * 1024)
+
+struct jtag_command;
+
+/** Growable buffer that commands are encoded into. */
+struct jtag_record_buf {
+	uint8_t *data;
+	size_t size;
+	size_t used;
+	/* set once an allocation failed */
+	bool failed;
+};
+
+/**
+ * Appends records for the commands of a queue to @a buf, closed by a
+ * FLUSH record holding @a retval.  The bits captured by scans are only
+ * included if @a captured is set, i.e. once the queue has executed.
+ */
+int jtag_record_encode(struct jtag_record_buf *buf, const struct jtag_command *cmd,
+		bool captured, int retval);
+/** @returns room for @a size more bytes at the end of @a buf, or NULL. */
+uint8_t *jtag_record_reserve(struct jtag_record_buf *buf, size_t size);
+void jtag_record_buf_free(struct jtag_record_buf *buf);
+
+/**
+ * Appends the commands of a queue just executed by the interface driver
+ * to the trace, with the data captured by its scans, if recording.
+ */
+void jtag_record_queue(const struct jtag_command *cmd, int retval);
+
+extern const struct command_registration jtag_record_command_handlers[];
+
+#endif /* JTAG_RECORD_H */
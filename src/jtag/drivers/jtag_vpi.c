@@ -41,12 +41,26 @@
 #define CMD_SCAN_CHAIN_FLIP_TMS	3
 #define CMD_STOP_SIMU		4
 
+/*
+ * The compact protocol sends a command as two little endian 32 bit
+ * words, cmd and nb_bits, followed by DIV_ROUND_UP(nb_bits, 8) bytes of
+ * TMS or TDI data.  Scans are answered with just as many bytes of TDO,
+ * and are not waited for: the answers are read once the queue has been
+ * sent, or when JTAG_VPI_PENDING_MAX bytes of them are outstanding.
+ */
+#define COMPACT_HEADER_SIZE	8
+
+/* keeps the server from blocking on a full socket while we still write */
+#define JTAG_VPI_PENDING_MAX	(32 * 1024)
+
 int server_port = SERVER_PORT;
 char *server_address;
 
 int sockfd;
 struct sockaddr_in serv_addr;
 
+static bool jtag_vpi_compact;
+
 struct vpi_cmd {
 	int cmd;
 	unsigned char buffer_out[XFERT_MAX_SIZE];
@@ -55,8 +69,77 @@ struct vpi_cmd {
 	int nb_bits;
 };
 
+/* scan answers not read yet, in the order they will arrive */
+struct jtag_vpi_pending_read {
+	uint8_t *bits;
+	int nb_bytes;
+};
+
+static struct jtag_vpi_pending_read *pending_reads;
+static unsigned pending_reads_count;
+static unsigned pending_reads_max;
+static unsigned pending_bytes;
+
+/* scans waiting for their answers before jtag_read_buffer() */
+struct jtag_vpi_pending_scan {
+	struct scan_command *cmd;
+	uint8_t *buf;
+};
+
+static struct jtag_vpi_pending_scan *pending_scans;
+static unsigned pending_scans_count;
+static unsigned pending_scans_max;
+
+static int jtag_vpi_write(const void *data, int size)
+{
+	const uint8_t *p = data;
+
+	while (size > 0) {
+		int retval = write_socket(sockfd, p, size);
+		if (retval <= 0)
+			return ERROR_FAIL;
+		p += retval;
+		size -= retval;
+	}
+
+	return ERROR_OK;
+}
+
+static int jtag_vpi_read(void *data, int size)
+{
+	uint8_t *p = data;
+
+	while (size > 0) {
+		int retval = read_socket(sockfd, p, size);
+		if (retval <= 0)
+			return ERROR_FAIL;
+		p += retval;
+		size -= retval;
+	}
+
+	return ERROR_OK;
+}
+
 static int jtag_vpi_send_cmd(struct vpi_cmd *vpi)
 {
+	if (jtag_vpi_compact) {
+		uint8_t frame[COMPACT_HEADER_SIZE + XFERT_MAX_SIZE];
+		int nb_bytes = 0;
+
+		if (vpi->cmd == CMD_TMS_SEQ || vpi->cmd == CMD_SCAN_CHAIN
+				|| vpi->cmd == CMD_SCAN_CHAIN_FLIP_TMS)
+			nb_bytes = DIV_ROUND_UP(vpi->nb_bits, 8);
+
+		h_u32_to_le(frame, vpi->cmd);
+		h_u32_to_le(frame + 4, nb_bytes ? vpi->nb_bits : 0);
+		memcpy(frame + COMPACT_HEADER_SIZE, vpi->buffer_out, nb_bytes);
+
+		if (jtag_vpi_write(frame, COMPACT_HEADER_SIZE + nb_bytes) != ERROR_OK)
+			return ERROR_FAIL;
+
+		return ERROR_OK;
+	}
+
 	int retval = write_socket(sockfd, vpi, sizeof(struct vpi_cmd));
 	if (retval <= 0)
 		return ERROR_FAIL;
@@ -73,6 +156,93 @@ static int jtag_vpi_receive_cmd(struct vpi_cmd *vpi)
 	return ERROR_OK;
 }
 
+/**
+ * jtag_vpi_receive_pending - read the answers of all scans sent so far
+ */
+static int jtag_vpi_receive_pending(void)
+{
+	uint8_t discard[XFERT_MAX_SIZE];
+
+	for (unsigned i = 0; i < pending_reads_count; i++) {
+		struct jtag_vpi_pending_read *r = &pending_reads[i];
+
+		if (jtag_vpi_read(r->bits ? r->bits : discard, r->nb_bytes) != ERROR_OK) {
+			pending_reads_count = 0;
+			pending_bytes = 0;
+			return ERROR_FAIL;
+		}
+	}
+
+	pending_reads_count = 0;
+	pending_bytes = 0;
+	return ERROR_OK;
+}
+
+static int jtag_vpi_add_pending_read(uint8_t *bits, int nb_bytes)
+{
+	if (pending_reads_count == pending_reads_max) {
+		unsigned max = pending_reads_max ? 2 * pending_reads_max : 64;
+		struct jtag_vpi_pending_read *reads = realloc(pending_reads,
+				max * sizeof(*reads));
+		if (!reads) {
+			LOG_ERROR("out of memory");
+			return ERROR_FAIL;
+		}
+		pending_reads = reads;
+		pending_reads_max = max;
+	}
+
+	pending_reads[pending_reads_count].bits = bits;
+	pending_reads[pending_reads_count].nb_bytes = nb_bytes;
+	pending_reads_count++;
+	pending_bytes += nb_bytes;
+
+	if (pending_bytes > JTAG_VPI_PENDING_MAX)
+		return jtag_vpi_receive_pending();
+
+	return ERROR_OK;
+}
+
+/**
+ * jtag_vpi_flush - complete all scans still waiting for their answers
+ */
+static int jtag_vpi_flush(void)
+{
+	int retval = jtag_vpi_receive_pending();
+
+	for (unsigned i = 0; i < pending_scans_count; i++) {
+		struct jtag_vpi_pending_scan *p = &pending_scans[i];
+
+		if (retval == ERROR_OK)
+			retval = jtag_read_buffer(p->buf, p->cmd);
+		free(p->buf);
+	}
+
+	pending_scans_count = 0;
+	return retval;
+}
+
+static int jtag_vpi_defer_scan(struct scan_command *cmd, uint8_t *buf)
+{
+	if (pending_scans_count == pending_scans_max) {
+		unsigned max = pending_scans_max ? 2 * pending_scans_max : 16;
+		struct jtag_vpi_pending_scan *scans = realloc(pending_scans,
+				max * sizeof(*scans));
+		if (!scans) {
+			LOG_ERROR("out of memory");
+			return ERROR_FAIL;
+		}
+		pending_scans = scans;
+		pending_scans_max = max;
+	}
+
+	pending_scans[pending_scans_count].cmd = cmd;
+	pending_scans[pending_scans_count].buf = buf;
+	pending_scans_count++;
+
+	return ERROR_OK;
+}
+
 /**
  * jtag_vpi_reset - ask to reset the JTAG device
  * @trst: 1 if TRST is to be asserted
@@ -184,6 +354,9 @@ static int jtag_vpi_queue_tdi_xfer(uint8_t *bits, int nb_bits, int tap_shift)
 	if (retval != ERROR_OK)
 		return retval;
 
+	if (jtag_vpi_compact)
+		return jtag_vpi_add_pending_read(bits, nb_bytes);
+
 	retval = jtag_vpi_receive_cmd(&vpi);
 	if (retval != ERROR_OK)
 		return retval;
@@ -292,12 +465,21 @@ static int jtag_vpi_scan(struct scan_command *cmd)
 			tap_set_state(TAP_DRPAUSE);
 	}
 
-	retval = jtag_read_buffer(buf, cmd);
-	if (retval != ERROR_OK)
-		return retval;
+	if (jtag_vpi_compact && buf) {
+		/* buf gets the TDO bits once the answer arrives */
+		retval = jtag_vpi_defer_scan(cmd, buf);
+		if (retval != ERROR_OK) {
+			free(buf);
+			return retval;
+		}
+	} else {
+		retval = jtag_read_buffer(buf, cmd);
+		if (retval != ERROR_OK)
+			return retval;
 
-	if (buf)
-		free(buf);
+		if (buf)
+			free(buf);
+	}
 
 	if (cmd->end_state != TAP_DRSHIFT) {
 		retval = jtag_vpi_state_move(cmd->end_state);
@@ -364,6 +546,11 @@ static int jtag_vpi_execute_queue(void)
 		}
 	}
 
+	/* even after an error, as the deferred scans own buffers */
+	int flush_retval = jtag_vpi_flush();
+	if (retval == ERROR_OK)
+		retval = flush_retval;
+
 	return retval;
 }
 
@@ -397,12 +584,21 @@ static int jtag_vpi_init(void)
 	}
 
 	LOG_INFO("Connection to %s : %u succeed", server_address, server_port);
+	if (jtag_vpi_compact)
+		LOG_INFO("using the compact jtag_vpi protocol");
 
 	return ERROR_OK;
 }
 
 static int jtag_vpi_quit(void)
 {
+	free(pending_reads);
+	pending_reads = NULL;
+	pending_reads_max = 0;
+	free(pending_scans);
+	pending_scans = NULL;
+	pending_scans_max = 0;
+
 	free(server_address);
 	return close(sockfd);
 }
@@ -434,6 +630,21 @@ COMMAND_HANDLER(jtag_vpi_set_address)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(jtag_vpi_set_protocol)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (strcmp(CMD_ARGV[0], "compact") == 0)
+		jtag_vpi_compact = true;
+	else if (strcmp(CMD_ARGV[0], "legacy") == 0)
+		jtag_vpi_compact = false;
+	else
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	return ERROR_OK;
+}
+
 static const struct command_registration jtag_vpi_command_handlers[] = {
 	{
 		.name = "jtag_vpi_set_port",
@@ -449,6 +660,15 @@ static const struct command_registration jtag_vpi_command_handlers[] = {
 		.help = "set the address of the VPI server",
 		.usage = "description_string",
 	},
+	{
+		.name = "jtag_vpi_set_protocol",
+		.handler = &jtag_vpi_set_protocol,
+		.mode = COMMAND_CONFIG,
+		.help = "select the framing understood by the VPI server, "
+			"'compact' sends only the bits of each command and "
+			"doesn't wait for each scan",
+		.usage = "('legacy'|'compact')",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -39,18 +39,74 @@
 		exit(-1); \
 	} while (0)
 
+/*
+ * Protocol version 2 adds, on top of the ASCII commands of version 1:
+ *
+ * 'V'  answered with '2' by a version 2 server; a version 1 server
+ *      ignores it, which is how the version is negotiated
+ * 'S'  shift: u16 bit count n (little endian), then three bit vectors
+ *      of (n + 7) / 8 bytes each, LSB first: TMS, TDI and the bits whose
+ *      TDO is to be sampled.  For every bit the server drives TCK low
+ *      with TMS/TDI, samples TDO if asked to, then drives TCK high.  It
+ *      answers with the sampled bits packed the same way, if any.
+ *
+ * With either version, TDO reads are sent ahead and their answers are
+ * only fetched once the whole JTAG queue went out.
+ */
+#define REMOTE_BITBANG_SHIFT_MAX 4096
+
+/* how much of the answers may be left unread, so that neither side
+ * blocks on a full socket while the other is writing */
+#define REMOTE_BITBANG_UNREAD_MAX (16 * 1024)
+
+/* answer to an 'R', rather than a count of packed bits */
+#define REMOTE_BITBANG_ANSWER_ASCII (-1)
+
 static char *remote_bitbang_host;
 static char *remote_bitbang_port;
 
 FILE *remote_bitbang_in;
 FILE *remote_bitbang_out;
 
+static int remote_bitbang_version;
+
+/* the pins as last written, whether the server hasn't seen them yet,
+ * and a TDO sample to take before TCK rises */
+static int remote_bitbang_tck, remote_bitbang_tms, remote_bitbang_tdi;
+static bool remote_bitbang_levels_pending;
+static bool remote_bitbang_sample_pending;
+
+/* clock cycles not sent yet, as a version 2 shift */
+static uint8_t remote_bitbang_shift_tms[REMOTE_BITBANG_SHIFT_MAX / 8];
+static uint8_t remote_bitbang_shift_tdi[REMOTE_BITBANG_SHIFT_MAX / 8];
+static uint8_t remote_bitbang_shift_sample[REMOTE_BITBANG_SHIFT_MAX / 8];
+static unsigned remote_bitbang_shift_bits;
+static unsigned remote_bitbang_shift_samples;
+
+/* answers the server still owes, oldest first */
+static int *remote_bitbang_answers;
+static unsigned remote_bitbang_answers_count;
+static unsigned remote_bitbang_answers_max;
+static size_t remote_bitbang_unread;
+
+/* TDO samples received but not handed to bitbang.c yet, one per byte */
+static uint8_t *remote_bitbang_samples;
+static size_t remote_bitbang_samples_count;
+static size_t remote_bitbang_samples_pos;
+static size_t remote_bitbang_samples_max;
+
 static void remote_bitbang_putc(int c)
 {
 	if (EOF == fputc(c, remote_bitbang_out))
 		REMOTE_BITBANG_RAISE_ERROR("remote_bitbang_putc: %s", strerror(errno));
 }
 
+static void remote_bitbang_fwrite(const void *data, size_t size)
+{
+	if (fwrite(data, 1, size, remote_bitbang_out) != size)
+		REMOTE_BITBANG_RAISE_ERROR("remote_bitbang_fwrite: %s", strerror(errno));
+}
+
 static int remote_bitbang_quit(void)
 {
 	if (EOF == fputc('Q', remote_bitbang_out)) {
@@ -72,6 +128,15 @@ static int remote_bitbang_quit(void)
 
 	free(remote_bitbang_host);
 	free(remote_bitbang_port);
+	free(remote_bitbang_answers);
+	remote_bitbang_answers = NULL;
+	remote_bitbang_answers_count = 0;
+	remote_bitbang_answers_max = 0;
+	free(remote_bitbang_samples);
+	remote_bitbang_samples = NULL;
+	remote_bitbang_samples_count = 0;
+	remote_bitbang_samples_pos = 0;
+	remote_bitbang_samples_max = 0;
 
 	LOG_INFO("remote_bitbang interface quit");
 	return ERROR_OK;
@@ -98,27 +163,217 @@ static int remote_bitbang_rread(void)
 	}
 }
 
+static void remote_bitbang_add_sample(int value)
+{
+	if (remote_bitbang_samples_count == remote_bitbang_samples_max) {
+		size_t max = remote_bitbang_samples_max ? 2 * remote_bitbang_samples_max : 1024;
+		uint8_t *samples = realloc(remote_bitbang_samples, max);
+		if (!samples) {
+			remote_bitbang_quit();
+			REMOTE_BITBANG_RAISE_ERROR("remote_bitbang: out of memory");
+		}
+		remote_bitbang_samples = samples;
+		remote_bitbang_samples_max = max;
+	}
+	remote_bitbang_samples[remote_bitbang_samples_count++] = value;
+}
+
+/* Read all answers the server owes. */
+static void remote_bitbang_receive(void)
+{
+	if (EOF == fflush(remote_bitbang_out)) {
+		remote_bitbang_quit();
+		REMOTE_BITBANG_RAISE_ERROR("fflush: %s", strerror(errno));
+	}
+
+	for (unsigned i = 0; i < remote_bitbang_answers_count; i++) {
+		int answer = remote_bitbang_answers[i];
+
+		if (answer == REMOTE_BITBANG_ANSWER_ASCII) {
+			remote_bitbang_add_sample(remote_bitbang_rread());
+			continue;
+		}
+
+		uint8_t bits[REMOTE_BITBANG_SHIFT_MAX / 8];
+		size_t size = DIV_ROUND_UP(answer, 8);
+		if (fread(bits, 1, size, remote_bitbang_in) != size) {
+			remote_bitbang_quit();
+			REMOTE_BITBANG_RAISE_ERROR("remote_bitbang: short shift answer");
+		}
+		for (int bit = 0; bit < answer; bit++)
+			remote_bitbang_add_sample((bits[bit / 8] >> (bit % 8)) & 1);
+	}
+
+	remote_bitbang_answers_count = 0;
+	remote_bitbang_unread = 0;
+}
+
+static void remote_bitbang_expect(int answer)
+{
+	if (remote_bitbang_answers_count == remote_bitbang_answers_max) {
+		unsigned max = remote_bitbang_answers_max ? 2 * remote_bitbang_answers_max : 64;
+		int *answers = realloc(remote_bitbang_answers, max * sizeof(*answers));
+		if (!answers) {
+			remote_bitbang_quit();
+			REMOTE_BITBANG_RAISE_ERROR("remote_bitbang: out of memory");
+		}
+		remote_bitbang_answers = answers;
+		remote_bitbang_answers_max = max;
+	}
+	remote_bitbang_answers[remote_bitbang_answers_count++] = answer;
+
+	remote_bitbang_unread += answer == REMOTE_BITBANG_ANSWER_ASCII ? 1 : DIV_ROUND_UP(answer, 8);
+	if (remote_bitbang_unread > REMOTE_BITBANG_UNREAD_MAX)
+		remote_bitbang_receive();
+}
+
+static void remote_bitbang_putc_write(int tck, int tms, int tdi)
+{
+	char c = '0' + ((tck ? 0x4 : 0x0) | (tms ? 0x2 : 0x0) | (tdi ? 0x1 : 0x0));
+	remote_bitbang_putc(c);
+}
+
+/* Send the clock cycles gathered so far, followed by the pin levels
+ * written after the last rising edge of TCK. */
+static void remote_bitbang_send_shift(void)
+{
+	unsigned n = remote_bitbang_shift_bits;
+	size_t size = DIV_ROUND_UP(n, 8);
+	uint8_t header[3];
+
+	if (n == 0)
+		goto levels;
+
+	header[0] = 'S';
+	h_u16_to_le(header + 1, n);
+	remote_bitbang_fwrite(header, sizeof(header));
+	remote_bitbang_fwrite(remote_bitbang_shift_tms, size);
+	remote_bitbang_fwrite(remote_bitbang_shift_tdi, size);
+	remote_bitbang_fwrite(remote_bitbang_shift_sample, size);
+
+	if (remote_bitbang_shift_samples)
+		remote_bitbang_expect(remote_bitbang_shift_samples);
+
+	memset(remote_bitbang_shift_tms, 0, size);
+	memset(remote_bitbang_shift_tdi, 0, size);
+	memset(remote_bitbang_shift_sample, 0, size);
+	remote_bitbang_shift_bits = 0;
+	remote_bitbang_shift_samples = 0;
+
+levels:
+	if (remote_bitbang_levels_pending) {
+		remote_bitbang_putc_write(remote_bitbang_tck, remote_bitbang_tms,
+				remote_bitbang_tdi);
+		remote_bitbang_levels_pending = false;
+	}
+	if (remote_bitbang_sample_pending) {
+		remote_bitbang_putc('R');
+		remote_bitbang_expect(REMOTE_BITBANG_ANSWER_ASCII);
+		remote_bitbang_sample_pending = false;
+	}
+}
+
+static void remote_bitbang_sample(void)
+{
+	/* a shift samples once per cycle, before TCK rises */
+	if (remote_bitbang_version >= 2 && !remote_bitbang_tck
+			&& !remote_bitbang_sample_pending) {
+		remote_bitbang_sample_pending = true;
+		return;
+	}
+
+	remote_bitbang_send_shift();
+	remote_bitbang_putc('R');
+	remote_bitbang_expect(REMOTE_BITBANG_ANSWER_ASCII);
+}
+
+static int remote_bitbang_read_sample(void)
+{
+	if (remote_bitbang_samples_pos == remote_bitbang_samples_count) {
+		remote_bitbang_samples_pos = 0;
+		remote_bitbang_samples_count = 0;
+		remote_bitbang_send_shift();
+		remote_bitbang_receive();
+		if (remote_bitbang_samples_count == 0) {
+			remote_bitbang_quit();
+			REMOTE_BITBANG_RAISE_ERROR("BUG: remote_bitbang: read without a sample");
+		}
+	}
+
+	return remote_bitbang_samples[remote_bitbang_samples_pos++];
+}
+
+static void remote_bitbang_flush(void)
+{
+	remote_bitbang_send_shift();
+
+	if (EOF == fflush(remote_bitbang_out)) {
+		remote_bitbang_quit();
+		REMOTE_BITBANG_RAISE_ERROR("fflush: %s", strerror(errno));
+	}
+}
+
 static int remote_bitbang_read(void)
 {
+	remote_bitbang_send_shift();
 	remote_bitbang_putc('R');
-	return remote_bitbang_rread();
+	remote_bitbang_expect(REMOTE_BITBANG_ANSWER_ASCII);
+	return remote_bitbang_read_sample();
 }
 
 static void remote_bitbang_write(int tck, int tms, int tdi)
 {
-	char c = '0' + ((tck ? 0x4 : 0x0) | (tms ? 0x2 : 0x0) | (tdi ? 0x1 : 0x0));
-	remote_bitbang_putc(c);
+	int old_tck = remote_bitbang_tck;
+
+	remote_bitbang_tck = tck;
+	remote_bitbang_tms = tms;
+	remote_bitbang_tdi = tdi;
+
+	if (remote_bitbang_version < 2) {
+		remote_bitbang_putc_write(tck, tms, tdi);
+		return;
+	}
+
+	/* levels with TCK low only matter once it rises */
+	if (!tck) {
+		remote_bitbang_levels_pending = true;
+		return;
+	}
+
+	if (old_tck) {
+		remote_bitbang_levels_pending = true;
+		remote_bitbang_send_shift();
+		return;
+	}
+
+	unsigned bit = remote_bitbang_shift_bits++;
+	uint8_t mask = 1 << (bit % 8);
+	if (tms)
+		remote_bitbang_shift_tms[bit / 8] |= mask;
+	if (tdi)
+		remote_bitbang_shift_tdi[bit / 8] |= mask;
+	if (remote_bitbang_sample_pending) {
+		remote_bitbang_shift_sample[bit / 8] |= mask;
+		remote_bitbang_shift_samples++;
+		remote_bitbang_sample_pending = false;
+	}
+	remote_bitbang_levels_pending = false;
+
+	if (remote_bitbang_shift_bits == REMOTE_BITBANG_SHIFT_MAX)
+		remote_bitbang_send_shift();
 }
 
 static void remote_bitbang_reset(int trst, int srst)
 {
 	char c = 'r' + ((trst ? 0x2 : 0x0) | (srst ? 0x1 : 0x0));
+	remote_bitbang_send_shift();
 	remote_bitbang_putc(c);
 }
 
 static void remote_bitbang_blink(int on)
 {
 	char c = on ? 'B' : 'b';
+	remote_bitbang_send_shift();
 	remote_bitbang_putc(c);
 }
 
@@ -127,8 +382,33 @@ static struct bitbang_interface remote_bitbang_bitbang = {
 	.write = &remote_bitbang_write,
 	.reset = &remote_bitbang_reset,
 	.blink = &remote_bitbang_blink,
+	.sample = &remote_bitbang_sample,
+	.read_sample = &remote_bitbang_read_sample,
+	.flush = &remote_bitbang_flush,
 };
 
+/* Ask for version 2: its 'V' is answered before the 'R' that follows,
+ * a version 1 server only answers the 'R'. */
+static void remote_bitbang_negotiate(void)
+{
+	remote_bitbang_putc('V');
+	remote_bitbang_putc('R');
+	if (EOF == fflush(remote_bitbang_out))
+		REMOTE_BITBANG_RAISE_ERROR("fflush: %s", strerror(errno));
+
+	int c = fgetc(remote_bitbang_in);
+	if (c == '2') {
+		remote_bitbang_version = 2;
+		c = fgetc(remote_bitbang_in);
+	} else
+		remote_bitbang_version = 1;
+
+	if (c != '0' && c != '1')
+		REMOTE_BITBANG_RAISE_ERROR("remote_bitbang: invalid read response: %c(%i)", c, c);
+
+	LOG_INFO("remote_bitbang protocol version %d", remote_bitbang_version);
+}
+
 static int remote_bitbang_init_tcp(void)
 {
 	struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
@@ -227,6 +507,8 @@ static int remote_bitbang_init(void)
 		return ERROR_FAIL;
 	}
 
+	remote_bitbang_negotiate();
+
 	LOG_INFO("remote_bitbang driver initialized");
 	return ERROR_OK;
 }
@@ -0,0 +1,308 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.           *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef _WIN32
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+#include <jtag/interface.h>
+#include <jtag/commands.h>
+#include "jtag_record.h"
+
+/*
+ * The remote_jtag driver sends each whole queue to another OpenOCD
+ * running a "jtag_server" and gets back only what the scans captured,
+ * so a flush costs one round trip however many bits it shifts.  The
+ * message format is described in jtag_record.h.
+ */
+
+static char *remote_jtag_host;
+static char *remote_jtag_port;
+static int remote_jtag_fd = -1;
+
+static struct jtag_record_buf remote_jtag_request;
+static uint8_t *remote_jtag_reply;
+static size_t remote_jtag_reply_size;
+
+static int remote_jtag_write(const void *data, size_t size)
+{
+	const uint8_t *p = data;
+
+	while (size > 0) {
+		int n = write_socket(remote_jtag_fd, p, size);
+		if (n <= 0) {
+			LOG_ERROR("remote_jtag: write failed: %s", strerror(errno));
+			return ERROR_FAIL;
+		}
+		p += n;
+		size -= n;
+	}
+	return ERROR_OK;
+}
+
+static int remote_jtag_read(void *data, size_t size)
+{
+	uint8_t *p = data;
+
+	while (size > 0) {
+		int n = read_socket(remote_jtag_fd, p, size);
+		if (n <= 0) {
+			if (n == 0)
+				LOG_ERROR("remote_jtag: server closed the connection");
+			else
+				LOG_ERROR("remote_jtag: read failed: %s", strerror(errno));
+			return ERROR_FAIL;
+		}
+		p += n;
+		size -= n;
+	}
+	return ERROR_OK;
+}
+
+/* hand the captured bits of the reply to the scans that asked for them */
+static int remote_jtag_scatter(const uint8_t *bits, size_t size)
+{
+	size_t offset = 0;
+
+	for (struct jtag_command *cmd = jtag_command_queue; cmd; cmd = cmd->next) {
+		if (cmd->type != JTAG_SCAN)
+			continue;
+
+		struct scan_command *scan = cmd->cmd.scan;
+		for (int i = 0; i < scan->num_fields; i++) {
+			struct scan_field *field = &scan->fields[i];
+			size_t bytes = DIV_ROUND_UP(field->num_bits, 8);
+
+			if (!field->in_value)
+				continue;
+			if (offset + bytes > size) {
+				LOG_ERROR("remote_jtag: reply too short");
+				return ERROR_FAIL;
+			}
+			buf_set_buf(bits + offset, 0, field->in_value, 0, field->num_bits);
+			offset += bytes;
+		}
+	}
+
+	if (offset != size) {
+		LOG_ERROR("remote_jtag: reply too long");
+		return ERROR_FAIL;
+	}
+	return ERROR_OK;
+}
+
+static int remote_jtag_execute_queue(void)
+{
+	struct jtag_record_buf *req = &remote_jtag_request;
+	uint8_t header[4];
+	uint32_t size;
+	int retval;
+
+	if (remote_jtag_fd < 0)
+		return ERROR_FAIL;
+
+	/* length first, filled in once the queue is encoded */
+	req->used = 0;
+	if (!jtag_record_reserve(req, 4))
+		return ERROR_FAIL;
+
+	retval = jtag_record_encode(req, jtag_command_queue, false, ERROR_OK);
+	if (retval != ERROR_OK)
+		return retval;
+	h_u32_to_le(req->data, req->used - 4);
+
+	retval = remote_jtag_write(req->data, req->used);
+	if (retval == ERROR_OK)
+		retval = remote_jtag_read(header, sizeof(header));
+	if (retval != ERROR_OK)
+		return retval;
+
+	size = le_to_h_u32(header);
+	if (size < 4 || size > JTAG_RECORD_MESSAGE_MAX) {
+		LOG_ERROR("remote_jtag: bad reply length %" PRIu32, size);
+		return ERROR_FAIL;
+	}
+
+	if (size > remote_jtag_reply_size) {
+		uint8_t *reply = realloc(remote_jtag_reply, size);
+		if (!reply) {
+			LOG_ERROR("out of memory");
+			return ERROR_FAIL;
+		}
+		remote_jtag_reply = reply;
+		remote_jtag_reply_size = size;
+	}
+
+	retval = remote_jtag_read(remote_jtag_reply, size);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = remote_jtag_scatter(remote_jtag_reply + 4, size - 4);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* whatever the queue returned on the server */
+	return (int32_t)le_to_h_u32(remote_jtag_reply);
+}
+
+static int remote_jtag_speed(int speed)
+{
+	return ERROR_OK;
+}
+
+static int remote_jtag_khz(int khz, int *jtag_speed)
+{
+	*jtag_speed = khz;
+	return ERROR_OK;
+}
+
+static int remote_jtag_speed_div(int speed, int *khz)
+{
+	*khz = speed;
+	return ERROR_OK;
+}
+
+static int remote_jtag_init(void)
+{
+	struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+	struct addrinfo *result, *rp;
+	int flag = 1;
+
+	if (!remote_jtag_port) {
+		LOG_ERROR("remote_jtag: no server port given, see 'remote_jtag_port'");
+		return ERROR_JTAG_INIT_FAILED;
+	}
+
+	LOG_INFO("Connecting to jtag_server at %s:%s",
+			remote_jtag_host ? remote_jtag_host : "localhost",
+			remote_jtag_port);
+
+	int s = getaddrinfo(remote_jtag_host, remote_jtag_port, &hints, &result);
+	if (s != 0) {
+		LOG_ERROR("getaddrinfo: %s", gai_strerror(s));
+		return ERROR_JTAG_INIT_FAILED;
+	}
+
+	for (rp = result; rp != NULL; rp = rp->ai_next) {
+		remote_jtag_fd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+		if (remote_jtag_fd == -1)
+			continue;
+
+		if (connect(remote_jtag_fd, rp->ai_addr, rp->ai_addrlen) != -1)
+			break;
+
+		close_socket(remote_jtag_fd);
+		remote_jtag_fd = -1;
+	}
+
+	freeaddrinfo(result);
+
+	if (remote_jtag_fd < 0) {
+		LOG_ERROR("Failed to connect: %s", strerror(errno));
+		return ERROR_JTAG_INIT_FAILED;
+	}
+
+	/* each queue is one message and one reply, don't hold them back */
+	setsockopt(remote_jtag_fd, IPPROTO_TCP, TCP_NODELAY, (char *)&flag, sizeof(flag));
+
+	if (remote_jtag_write(JTAG_RECORD_MAGIC, strlen(JTAG_RECORD_MAGIC)) != ERROR_OK) {
+		close_socket(remote_jtag_fd);
+		remote_jtag_fd = -1;
+		return ERROR_JTAG_INIT_FAILED;
+	}
+
+	return ERROR_OK;
+}
+
+static int remote_jtag_quit(void)
+{
+	if (remote_jtag_fd >= 0) {
+		close_socket(remote_jtag_fd);
+		remote_jtag_fd = -1;
+	}
+
+	jtag_record_buf_free(&remote_jtag_request);
+	free(remote_jtag_reply);
+	remote_jtag_reply = NULL;
+	remote_jtag_reply_size = 0;
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(remote_jtag_handle_port_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	uint16_t port;
+	COMMAND_PARSE_NUMBER(u16, CMD_ARGV[0], port);
+	free(remote_jtag_port);
+	remote_jtag_port = strdup(CMD_ARGV[0]);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(remote_jtag_handle_host_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	free(remote_jtag_host);
+	remote_jtag_host = strdup(CMD_ARGV[0]);
+
+	return ERROR_OK;
+}
+
+static const struct command_registration remote_jtag_command_handlers[] = {
+	{
+		.name = "remote_jtag_port",
+		.handler = remote_jtag_handle_port_command,
+		.mode = COMMAND_CONFIG,
+		.help = "Set the TCP port of the jtag_server to connect to.",
+		.usage = "port_number",
+	},
+	{
+		.name = "remote_jtag_host",
+		.handler = remote_jtag_handle_host_command,
+		.mode = COMMAND_CONFIG,
+		.help = "Set the host running the jtag_server to connect to.",
+		.usage = "host_name",
+	},
+	COMMAND_REGISTRATION_DONE,
+};
+
+struct jtag_interface remote_jtag_interface = {
+	.name = "remote_jtag",
+
+	.supported = DEBUG_CAP_TMS_SEQ,
+	.commands = remote_jtag_command_handlers,
+	.transports = jtag_only,
+
+	.execute_queue = &remote_jtag_execute_queue,
+
+	.speed = &remote_jtag_speed,
+	.khz = &remote_jtag_khz,
+	.speed_div = &remote_jtag_speed_div,
+
+	.init = &remote_jtag_init,
+	.quit = &remote_jtag_quit,
+};
@@ -0,0 +1,339 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.           *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <jtag/interface.h>
+#include <jtag/commands.h>
+#include "jtag_record.h"
+
+/*
+ * The replay driver plays back a trace written by "jtag record": every
+ * queued command is matched against the next record and scans get the
+ * data captured when the trace was made.  No hardware is involved, so
+ * the target layer runs at full host speed, and a failure recorded in
+ * the field can be reproduced bit by bit.
+ */
+
+static char *replay_file_name;
+static FILE *replay_file;
+static long replay_queue_count;
+static bool replay_tdi_diverged;
+
+static uint8_t *replay_buf;
+static size_t replay_buf_size;
+
+static int replay_diverged(const char *what)
+{
+	LOG_ERROR("replay: queue %ld doesn't match the trace: %s",
+			replay_queue_count, what);
+	return ERROR_FAIL;
+}
+
+static int replay_read(void *buf, size_t size)
+{
+	if (fread(buf, 1, size, replay_file) != size) {
+		LOG_ERROR("replay: trace '%s' ends in queue %ld",
+				replay_file_name, replay_queue_count);
+		return ERROR_FAIL;
+	}
+	return ERROR_OK;
+}
+
+static int replay_read_u8(uint8_t *value)
+{
+	return replay_read(value, 1);
+}
+
+static int replay_read_u32(uint32_t *value)
+{
+	uint8_t buf[4];
+
+	int retval = replay_read(buf, sizeof(buf));
+	*value = le_to_h_u32(buf);
+	return retval;
+}
+
+/* reads num_bits worth of bytes into replay_buf */
+static int replay_read_bits(unsigned num_bits)
+{
+	size_t size = DIV_ROUND_UP(num_bits, 8);
+
+	if (size > replay_buf_size) {
+		uint8_t *buf = realloc(replay_buf, size);
+		if (!buf) {
+			LOG_ERROR("out of memory");
+			return ERROR_FAIL;
+		}
+		replay_buf = buf;
+		replay_buf_size = size;
+	}
+	return replay_read(replay_buf, size);
+}
+
+static int replay_skip(size_t size)
+{
+	if (fseek(replay_file, size, SEEK_CUR) != 0) {
+		LOG_ERROR("replay: can't seek in trace '%s'", replay_file_name);
+		return ERROR_FAIL;
+	}
+	return ERROR_OK;
+}
+
+static int replay_scan(const struct scan_command *scan)
+{
+	uint8_t flags, end_state;
+	uint32_t num_fields;
+	int retval;
+
+	retval = replay_read_u8(&flags);
+	if (retval == ERROR_OK)
+		retval = replay_read_u8(&end_state);
+	if (retval == ERROR_OK)
+		retval = replay_read_u32(&num_fields);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (!(flags & JTAG_RECORD_SCAN_IR) != !scan->ir_scan)
+		return replay_diverged(scan->ir_scan ? "IR scan instead of DR scan"
+				: "DR scan instead of IR scan");
+	if (num_fields != (uint32_t)scan->num_fields)
+		return replay_diverged("different number of scan fields");
+
+	for (int i = 0; i < scan->num_fields; i++) {
+		struct scan_field *field = &scan->fields[i];
+		uint32_t num_bits;
+		uint8_t field_flags;
+
+		retval = replay_read_u32(&num_bits);
+		if (retval == ERROR_OK)
+			retval = replay_read_u8(&field_flags);
+		if (retval != ERROR_OK)
+			return retval;
+
+		if (num_bits != (uint32_t)field->num_bits)
+			return replay_diverged("different scan field length");
+
+		if (field_flags & JTAG_RECORD_FIELD_OUT) {
+			retval = replay_read_bits(num_bits);
+			if (retval != ERROR_OK)
+				return retval;
+
+			/* what goes out doesn't change what comes back from the
+			 * trace, but it is worth knowing about */
+			if (field->out_value && !replay_tdi_diverged
+					&& buf_cmp(field->out_value, replay_buf, num_bits)) {
+				LOG_WARNING("replay: queue %ld shifts out different data than "
+						"the trace, further differences are not reported",
+						replay_queue_count);
+				replay_tdi_diverged = true;
+			}
+		}
+
+		if (field_flags & JTAG_RECORD_FIELD_IN) {
+			retval = replay_read_bits(num_bits);
+			if (retval != ERROR_OK)
+				return retval;
+			if (field->in_value)
+				buf_set_buf(replay_buf, 0, field->in_value, 0, num_bits);
+		} else if (field->in_value)
+			return replay_diverged("data captured that the trace doesn't have");
+	}
+
+	return ERROR_OK;
+}
+
+static int replay_command(const struct jtag_command *cmd)
+{
+	static const uint8_t record_types[] = {
+		[JTAG_SCAN] = JTAG_RECORD_SCAN,
+		[JTAG_TLR_RESET] = JTAG_RECORD_TLR_RESET,
+		[JTAG_RUNTEST] = JTAG_RECORD_RUNTEST,
+		[JTAG_RESET] = JTAG_RECORD_RESET,
+		[JTAG_PATHMOVE] = JTAG_RECORD_PATHMOVE,
+		[JTAG_SLEEP] = JTAG_RECORD_SLEEP,
+		[JTAG_STABLECLOCKS] = JTAG_RECORD_STABLECLOCKS,
+		[JTAG_TMS] = JTAG_RECORD_TMS,
+	};
+	uint8_t type;
+	uint32_t count;
+
+	int retval = replay_read_u8(&type);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if ((unsigned)cmd->type >= ARRAY_SIZE(record_types)
+			|| record_types[cmd->type] == 0
+			|| record_types[cmd->type] != type)
+		return replay_diverged("different command");
+
+	switch (cmd->type) {
+		case JTAG_SCAN:
+			return replay_scan(cmd->cmd.scan);
+		case JTAG_TLR_RESET:
+			return replay_skip(1);
+		case JTAG_RUNTEST:
+			return replay_skip(5);
+		case JTAG_RESET:
+			return replay_skip(2);
+		case JTAG_PATHMOVE:
+			retval = replay_read_u32(&count);
+			if (retval != ERROR_OK)
+				return retval;
+			return replay_skip(count);
+		case JTAG_SLEEP:
+		case JTAG_STABLECLOCKS:
+			return replay_skip(4);
+		case JTAG_TMS:
+			retval = replay_read_u32(&count);
+			if (retval != ERROR_OK)
+				return retval;
+			return replay_skip(DIV_ROUND_UP(count, 8));
+		default:
+			return replay_diverged("unknown command");
+	}
+}
+
+static int replay_execute_queue(void)
+{
+	struct jtag_command *cmd;
+	uint8_t type;
+	uint32_t retval_recorded;
+	int retval;
+
+	replay_queue_count++;
+
+	for (cmd = jtag_command_queue; cmd; cmd = cmd->next) {
+		retval = replay_command(cmd);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	retval = replay_read_u8(&type);
+	if (retval == ERROR_OK && type != JTAG_RECORD_FLUSH)
+		return replay_diverged("the trace has more commands");
+	if (retval == ERROR_OK)
+		retval = replay_read_u32(&retval_recorded);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* fail where the recorded session failed */
+	return (int32_t)retval_recorded;
+}
+
+static int replay_speed(int speed)
+{
+	return ERROR_OK;
+}
+
+static int replay_khz(int khz, int *jtag_speed)
+{
+	*jtag_speed = khz;
+	return ERROR_OK;
+}
+
+static int replay_speed_div(int speed, int *khz)
+{
+	*khz = speed;
+	return ERROR_OK;
+}
+
+static int replay_init(void)
+{
+	char magic[sizeof(JTAG_RECORD_MAGIC) - 1];
+
+	if (!replay_file_name) {
+		LOG_ERROR("replay: no trace file given, see 'replay_file'");
+		return ERROR_JTAG_INIT_FAILED;
+	}
+
+	replay_file = fopen(replay_file_name, "rb");
+	if (!replay_file) {
+		LOG_ERROR("replay: can't open trace '%s'", replay_file_name);
+		return ERROR_JTAG_INIT_FAILED;
+	}
+
+	if (fread(magic, 1, sizeof(magic), replay_file) != sizeof(magic)
+			|| memcmp(magic, JTAG_RECORD_MAGIC, sizeof(magic)) != 0) {
+		LOG_ERROR("replay: '%s' is not a JTAG trace", replay_file_name);
+		fclose(replay_file);
+		replay_file = NULL;
+		return ERROR_JTAG_INIT_FAILED;
+	}
+
+	replay_queue_count = 0;
+	replay_tdi_diverged = false;
+	LOG_INFO("replaying JTAG trace '%s'", replay_file_name);
+
+	return ERROR_OK;
+}
+
+static int replay_quit(void)
+{
+	if (replay_file) {
+		LOG_INFO("replay: %ld queues replayed", replay_queue_count);
+		fclose(replay_file);
+		replay_file = NULL;
+	}
+
+	free(replay_buf);
+	replay_buf = NULL;
+	replay_buf_size = 0;
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(replay_handle_file_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	free(replay_file_name);
+	replay_file_name = strdup(CMD_ARGV[0]);
+
+	return ERROR_OK;
+}
+
+static const struct command_registration replay_command_handlers[] = {
+	{
+		.name = "replay_file",
+		.handler = replay_handle_file_command,
+		.mode = COMMAND_CONFIG,
+		.help = "Set the JTAG trace, written by 'jtag record', to play back.",
+		.usage = "filename",
+	},
+	COMMAND_REGISTRATION_DONE,
+};
+
+struct jtag_interface replay_interface = {
+	.name = "replay",
+
+	.supported = DEBUG_CAP_TMS_SEQ,
+	.commands = replay_command_handlers,
+	.transports = jtag_only,
+
+	.execute_queue = &replay_execute_queue,
+
+	.speed = &replay_speed,
+	.khz = &replay_khz,
+	.speed_div = &replay_speed_div,
+
+	.init = &replay_init,
+	.quit = &replay_quit,
+};
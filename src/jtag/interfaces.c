@@ -53,6 +53,9 @@ extern struct jtag_interface parport_interface;
 #if BUILD_DUMMY == 1
 extern struct jtag_interface dummy_interface;
 #endif
+#if BUILD_REPLAY == 1
+extern struct jtag_interface replay_interface;
+#endif
 #if BUILD_FT2232_FTD2XX == 1
 extern struct jtag_interface ft2232_interface;
 #endif
@@ -110,6 +113,9 @@ extern struct jtag_interface buspirate_interface;
 #if BUILD_REMOTE_BITBANG == 1
 extern struct jtag_interface remote_bitbang_interface;
 #endif
+#if BUILD_REMOTE_JTAG == 1
+extern struct jtag_interface remote_jtag_interface;
+#endif
 #if BUILD_HLADAPTER == 1
 extern struct jtag_interface hl_interface;
 #endif
@@ -152,6 +158,9 @@ struct jtag_interface *jtag_interfaces[] = {
 #if BUILD_DUMMY == 1
 		&dummy_interface,
 #endif
+#if BUILD_REPLAY == 1
+		&replay_interface,
+#endif
 #if BUILD_FT2232_FTD2XX == 1
 		&ft2232_interface,
 #endif
@@ -209,6 +218,9 @@ struct jtag_interface *jtag_interfaces[] = {
 #if BUILD_REMOTE_BITBANG == 1
 		&remote_bitbang_interface,
 #endif
+#if BUILD_REMOTE_JTAG == 1
+		&remote_jtag_interface,
+#endif
 #if BUILD_HLADAPTER == 1
 		&hl_interface,
 #endif
@@ -120,6 +120,32 @@ struct scan_field {
 	uint8_t *check_mask;
 };
 
+/**
+ * A scan field of at most 32 bits, with its values held as host ordered
+ * integers instead of byte buffers.  See jtag_add_dr_scan_u32().
+ */
+struct scan_field_u32 {
+	/** The number of bits this field specifies (1 to 32) */
+	int num_bits;
+	/** The value to be scanned into the device */
+	uint32_t out_value;
+	/** NULL, or where to store the value scanned out of the device */
+	uint32_t *in_value;
+};
+
+/**
+ * The 64-bit counterpart of struct scan_field_u32.
+ * See jtag_add_dr_scan_u64().
+ */
+struct scan_field_u64 {
+	/** The number of bits this field specifies (1 to 64) */
+	int num_bits;
+	/** The value to be scanned into the device */
+	uint64_t out_value;
+	/** NULL, or where to store the value scanned out of the device */
+	uint64_t *in_value;
+};
+
 struct jtag_tap {
 	char *chip;
 	char *tapname;
@@ -371,6 +397,19 @@ void jtag_add_dr_scan(struct jtag_tap *tap, int num_fields,
 /** A version of jtag_add_dr_scan() that uses the check_value/mask fields */
 void jtag_add_dr_scan_check(struct jtag_tap *tap, int num_fields,
 		struct scan_field *fields, tap_state_t endstate);
+/**
+ * A version of jtag_add_dr_scan() for data registers made of fields of
+ * up to 32 bits.  The values to scan out are passed as integers and the
+ * captured values are stored, in host byte order, to the locations given
+ * by the in_value members once the queue has been executed.  This spares
+ * callers the buf_set_u32()/buf_get_u32() conversions around each scan,
+ * and lets minidrivers queue the words directly.
+ */
+void jtag_add_dr_scan_u32(struct jtag_tap *tap, int num_fields,
+		const struct scan_field_u32 *fields, tap_state_t endstate);
+/** The 64-bit version of jtag_add_dr_scan_u32(). */
+void jtag_add_dr_scan_u64(struct jtag_tap *tap, int num_fields,
+		const struct scan_field_u64 *fields, tap_state_t endstate);
 /**
  * Scan out the bits in ir scan mode.
  *
@@ -571,6 +610,27 @@ int jtag_execute_queue(void);
 /** same as jtag_execute_queue() but does not clear the error flag */
 void jtag_execute_queue_noclear(void);
 
+/**
+ * Hands the queue to the interface without waiting for it to be executed.
+ *
+ * With pipelining enabled the interface runs this queue in the background
+ * while the next one is built; otherwise this is jtag_execute_queue_noclear().
+ * Nothing captured by the submitted scans may be looked at, and no
+ * buffer they refer to may be reused, before the next jtag_execute_queue(),
+ * which waits for everything submitted and runs the pending callbacks.
+ * Errors are reported by that jtag_execute_queue().
+ */
+void jtag_submit_queue(void);
+
+/**
+ * Enable or disable pipelined execution of submitted queues.
+ * @returns ERROR_OK, or an error if the interface can't pipeline, or
+ * if a queue still in flight failed while disabling.
+ */
+int jtag_set_pipelined(bool enable);
+/** @returns True if submitted queues run in the background. */
+bool jtag_is_pipelined(void);
+
 /** @returns the number of times the scan queue has been flushed */
 int jtag_get_flush_queue_count(void);
 
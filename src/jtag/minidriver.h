@@ -62,6 +62,12 @@ int interface_jtag_add_dr_scan(struct jtag_tap *active,
 int interface_jtag_add_plain_dr_scan(
 		int num_bits, const uint8_t *out_bits, uint8_t *in_bits,
 		tap_state_t endstate);
+int interface_jtag_add_dr_scan_u32(struct jtag_tap *active,
+		int num_fields, const struct scan_field_u32 *fields,
+		tap_state_t endstate);
+int interface_jtag_add_dr_scan_u64(struct jtag_tap *active,
+		int num_fields, const struct scan_field_u64 *fields,
+		tap_state_t endstate);
 
 int interface_jtag_add_tlr(void);
 int interface_jtag_add_pathmove(int num_states, const tap_state_t *path);
@@ -83,6 +89,17 @@ int interface_jtag_add_sleep(uint32_t us);
 int interface_jtag_add_clocks(int num_cycles);
 int interface_jtag_execute_queue(void);
 
+/**
+ * Hands the queue to the driver without waiting for it to complete, when
+ * the implementation can overlap execution with building the next queue;
+ * otherwise the same as interface_jtag_execute_queue().  Returns the
+ * outcome of previously submitted queues retired on the way.
+ */
+int interface_jtag_submit_queue(void);
+
+/** Enables or disables execution of submitted queues in the background. */
+int interface_jtag_set_pipelined(bool enable);
+
 /**
  * Calls the interface callback to execute the queue.  This routine
  * is used by the JTAG driver layer and should not be called directly.
@@ -46,6 +46,16 @@ int interface_jtag_execute_queue(void)
 	return ERROR_OK;
 }
 
+int interface_jtag_submit_queue(void)
+{
+	return interface_jtag_execute_queue();
+}
+
+int interface_jtag_set_pipelined(bool enable)
+{
+	return enable ? ERROR_JTAG_NOT_IMPLEMENTED : ERROR_OK;
+}
+
 int interface_jtag_add_ir_scan(struct jtag_tap *active, const struct scan_field *fields,
 		tap_state_t state)
 {
@@ -78,6 +88,22 @@ int interface_jtag_add_plain_dr_scan(int num_bits, const uint8_t *out_bits,
 	return ERROR_OK;
 }
 
+int interface_jtag_add_dr_scan_u32(struct jtag_tap *active, int num_fields,
+		const struct scan_field_u32 *fields, tap_state_t state)
+{
+	/* synchronously do the operation here */
+
+	return ERROR_OK;
+}
+
+int interface_jtag_add_dr_scan_u64(struct jtag_tap *active, int num_fields,
+		const struct scan_field_u64 *fields, tap_state_t state)
+{
+	/* synchronously do the operation here */
+
+	return ERROR_OK;
+}
+
 int interface_jtag_add_tlr()
 {
 	/* synchronously do the operation here */
@@ -37,7 +37,9 @@
 #include "minidriver.h"
 #include "interface.h"
 #include "interfaces.h"
+#include "commands.h"
 #include "tcl.h"
+#include "drivers/jtag_record.h"
 
 #ifdef HAVE_STRINGS_H
 #include <strings.h>
@@ -831,6 +833,25 @@ COMMAND_HANDLER(handle_jtag_init_command)
 	return jtag_init(CMD_CTX);
 }
 
+COMMAND_HANDLER(handle_jtag_pipeline_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		bool enable;
+		COMMAND_PARSE_ENABLE(CMD_ARGV[0], enable);
+		int retval = jtag_set_pipelined(enable);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	const char *status = jtag_is_pipelined() ? "enabled" : "disabled";
+	command_print(CMD_CTX, "pipelined queue execution is %s", status);
+
+	return ERROR_OK;
+}
+
 static const struct command_registration jtag_subcommand_handlers[] = {
 	{
 		.name = "init",
@@ -913,9 +934,29 @@ static const struct command_registration jtag_subcommand_handlers[] = {
 		.jim_handler = jim_jtag_names,
 		.help = "Returns list of all JTAG tap names.",
 	},
+	{
+		.name = "pipeline",
+		.mode = COMMAND_ANY,
+		.handler = handle_jtag_pipeline_command,
+		.help = "Run submitted JTAG queues in the background "
+			"while the next one is built.",
+		.usage = "['enable'|'disable']",
+	},
 	{
 		.chain = jtag_command_handlers_to_move,
 	},
+#if !BUILD_ZY1000
+	{
+		/* the ZY1000 minidriver has no command queue */
+		.chain = cmd_queue_command_handlers,
+	},
+#endif
+#if !BUILD_ZY1000 && !defined(BUILD_MINIDRIVER_DUMMY)
+	{
+		/* recording happens in the standard driver layer */
+		.chain = jtag_record_command_handlers,
+	},
+#endif
 	COMMAND_REGISTRATION_DONE
 };
 
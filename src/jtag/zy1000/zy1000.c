@@ -347,6 +347,17 @@ int interface_jtag_execute_queue(void)
 	return ERROR_OK;
 }
 
+int interface_jtag_submit_queue(void)
+{
+	/* the FPGA already runs while the next commands are written */
+	return interface_jtag_execute_queue();
+}
+
+int interface_jtag_set_pipelined(bool enable)
+{
+	return enable ? ERROR_JTAG_NOT_IMPLEMENTED : ERROR_OK;
+}
+
 static void writeShiftValue(uint8_t *data, int bits);
 
 /* here we shuffle N bits out/in */
@@ -488,6 +499,95 @@ int interface_jtag_add_plain_dr_scan(int num_bits,
 	return ERROR_OK;
 }
 
+/* shift a single field of up to 32 bits, without going through a byte buffer */
+static inline void scanWord(uint32_t value,
+	uint32_t *in_value,
+	int num_bits,
+	tap_state_t shiftState,
+	tap_state_t pause_state)
+{
+	shiftValueInner(shiftState, pause_state, num_bits, value);
+
+	if (in_value != NULL) {
+		uint8_t t[4];
+		writeShiftValue(t, num_bits);
+		*in_value = buf_get_u32(t, 0, num_bits);
+	}
+}
+
+int interface_jtag_add_dr_scan_u32(struct jtag_tap *active,
+	int num_fields,
+	const struct scan_field_u32 *fields,
+	tap_state_t state)
+{
+	struct jtag_tap *tap, *nextTap;
+	tap_state_t pause_state = TAP_DRSHIFT;
+	for (tap = jtag_tap_next_enabled(NULL); tap != NULL; tap = nextTap) {
+		nextTap = jtag_tap_next_enabled(tap);
+		if (nextTap == NULL)
+			pause_state = state;
+
+		if (tap == active) {
+			assert(!tap->bypass);
+
+			for (int i = 0; i < num_fields; i++) {
+				scanWord(fields[i].out_value, fields[i].in_value,
+					fields[i].num_bits, TAP_DRSHIFT,
+					(i == num_fields - 1) ? pause_state : TAP_DRSHIFT);
+			}
+		} else {
+			/* Shift out a 0 for disabled tap's */
+			assert(tap->bypass);
+			shiftValueInner(TAP_DRSHIFT, pause_state, 1, 0);
+		}
+	}
+	return ERROR_OK;
+}
+
+int interface_jtag_add_dr_scan_u64(struct jtag_tap *active,
+	int num_fields,
+	const struct scan_field_u64 *fields,
+	tap_state_t state)
+{
+	struct jtag_tap *tap, *nextTap;
+	tap_state_t pause_state = TAP_DRSHIFT;
+	for (tap = jtag_tap_next_enabled(NULL); tap != NULL; tap = nextTap) {
+		nextTap = jtag_tap_next_enabled(tap);
+		if (nextTap == NULL)
+			pause_state = state;
+
+		if (tap == active) {
+			assert(!tap->bypass);
+
+			for (int i = 0; i < num_fields; i++) {
+				int num_bits = fields[i].num_bits;
+				tap_state_t end = (i == num_fields - 1) ? pause_state : TAP_DRSHIFT;
+				uint32_t lo, hi;
+
+				if (num_bits <= 32) {
+					scanWord(fields[i].out_value, fields[i].in_value ? &lo : NULL,
+						num_bits, TAP_DRSHIFT, end);
+					if (fields[i].in_value)
+						*fields[i].in_value = lo;
+					continue;
+				}
+
+				scanWord(fields[i].out_value, fields[i].in_value ? &lo : NULL,
+					32, TAP_DRSHIFT, TAP_DRSHIFT);
+				scanWord(fields[i].out_value >> 32, fields[i].in_value ? &hi : NULL,
+					num_bits - 32, TAP_DRSHIFT, end);
+				if (fields[i].in_value)
+					*fields[i].in_value = ((uint64_t)hi << 32) | lo;
+			}
+		} else {
+			/* Shift out a 0 for disabled tap's */
+			assert(tap->bypass);
+			shiftValueInner(TAP_DRSHIFT, pause_state, 1, 0);
+		}
+	}
+	return ERROR_OK;
+}
+
 int interface_jtag_add_tlr()
 {
 	setCurrentState(TAP_RESET);
@@ -214,9 +214,14 @@ int rtos_qsymbol(struct connection *connection, char const *packet, int packet_s
 	if (!os)
 		goto done;
 
-	/* Decode any symbol name in the packet*/
-	int len = unhexify(cur_sym, strchr(packet + 8, ':') + 1, strlen(strchr(packet + 8, ':') + 1));
-	cur_sym[len] = 0;
+	/* Decode any symbol name in the packet; packets may be much longer
+	 * than cur_sym with a large gdb_packet_size */
+	const char *hex_sym = strchr(packet + 8, ':');
+	if (hex_sym != NULL) {
+		int len = unhexify(cur_sym, hex_sym + 1,
+				MIN(strlen(hex_sym + 1) / 2, sizeof(cur_sym) - 1));
+		cur_sym[len] = 0;
+	}
 
 	if ((strcmp(packet, "qSymbol::") != 0) &&               /* GDB is not offering symbol lookup for the first time */
 	    (!sscanf(packet, "qSymbol:%" SCNx64 ":", &addr)) && /* GDB did not find an address for a symbol */
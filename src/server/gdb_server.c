@@ -40,6 +40,9 @@
 #include "config.h"
 #endif
 
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
 #include <target/breakpoints.h>
 #include <target/target_request.h>
 #include <target/register.h>
@@ -47,6 +50,7 @@
 #include <flash/nor/core.h>
 #include "gdb_server.h"
 #include <target/image.h>
+#include <target/mem_cache.h>
 #include <jtag/jtag.h>
 #include "rtos/rtos.h"
 #include "target/smp.h"
@@ -60,9 +64,21 @@
  * found in most modern embedded processors.
  */
 
-struct target_desc_format {
+/* XML documents sent to GDB for one target, kept across connections
+ * and rebuilt only when the register caches or flash banks they were
+ * generated from have changed */
+struct gdb_target_xml {
+	struct target *target;
+
 	char *tdesc;
 	uint32_t tdesc_length;
+	unsigned tdesc_generation;
+
+	char *memory_map;
+	int memory_map_length;
+	unsigned memory_map_generation;
+
+	struct gdb_target_xml *next;
 };
 
 /* private connection data for GDB */
@@ -70,9 +86,14 @@ struct gdb_connection {
 	char buffer[GDB_BUFFER_SIZE];
 	char *buf_p;
 	int buf_cnt;
+	/* the packet being received, grown as needed up to gdb_packet_size */
+	char *packet_buffer;
+	int packet_buffer_size;
 	int ctrl_c;
 	enum target_state frontend_state;
 	struct image *vflash_image;
+	/* vFlashWrite data being programmed, with 'gdb_flash_stream' */
+	struct flash_stream *vflash_stream;
 	int closed;
 	int busy;
 	int noack_mode;
@@ -90,8 +111,6 @@ struct gdb_connection {
 	 * normally we reply with a S reply via gdb_last_signal_packet.
 	 * as a side note this behaviour only effects gdb > 6.8 */
 	bool attached;
-	/* temporarily used for target description support */
-	struct target_desc_format target_desc;
 };
 
 #if 0
@@ -100,9 +119,14 @@ struct gdb_connection {
 
 static struct gdb_connection *current_gdb_connection;
 
+static struct gdb_target_xml *gdb_target_xml_list;
+
 static int gdb_breakpoint_override;
 static enum breakpoint_type gdb_breakpoint_override_type;
 
+/* largest packet accepted, advertised to GDB in qSupported */
+static int gdb_packet_size = GDB_BUFFER_SIZE;
+
 static int gdb_error(struct connection *connection, int retval);
 static char *gdb_port;
 static char *gdb_port_next;
@@ -121,6 +145,9 @@ static int gdb_use_memory_map = 1;
 /* enabled by default*/
 static int gdb_flash_program = 1;
 
+/* program vFlashWrite data while GDB sends it, instead of at vFlashDone */
+static int gdb_flash_stream;
+
 /* if set, data aborts cause an error to be reported in memory read packets
  * see the code in gdb_read_memory_packet() for further explanations.
  * Disabled by default.
@@ -345,6 +372,98 @@ static int gdb_write(struct connection *connection, void *data, int len)
 	return ERROR_SERVER_REMOTE_CLOSED;
 }
 
+/* how long a GDB that doesn't read its socket gets before we give up on it */
+#define GDB_WRITE_TIMEOUT_S 10
+
+/* Waits until the socket takes more data.  A GDB that keeps the
+ * connection open but stops reading must not hang the server loop, so
+ * a timeout counts as a closed connection. */
+static int gdb_wait_writable(struct connection *connection)
+{
+	struct timeval tv;
+	fd_set write_fds;
+	int retval;
+
+	FD_ZERO(&write_fds);
+	FD_SET(connection->fd_out, &write_fds);
+
+	tv.tv_sec = GDB_WRITE_TIMEOUT_S;
+	tv.tv_usec = 0;
+	retval = socket_select(connection->fd_out + 1, NULL, &write_fds, NULL, &tv);
+	if (retval > 0 || (retval < 0 && errno == EINTR))
+		return ERROR_OK;
+
+	if (retval == 0)
+		LOG_ERROR("GDB didn't read a packet for %d s, dropping the connection",
+				GDB_WRITE_TIMEOUT_S);
+	return ERROR_SERVER_REMOTE_CLOSED;
+}
+
+/* Writes a packet with its framing, waiting for room in the socket as
+ * big packets don't always fit in one go.  One system call does for
+ * all three parts where writev() is around. */
+static int gdb_write_framed(struct connection *connection,
+		char *head, int head_len, char *data, int data_len,
+		char *tail, int tail_len)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+#ifndef _WIN32
+	struct iovec iov[3] = {
+		{ .iov_base = head, .iov_len = head_len },
+		{ .iov_base = data, .iov_len = data_len },
+		{ .iov_base = tail, .iov_len = tail_len },
+	};
+	struct iovec *v = iov;
+	int count = 3;
+#else
+	char *parts[3] = { head, data, tail };
+	int lens[3] = { head_len, data_len, tail_len };
+	int part = 0;
+#endif
+
+	if (gdb_con->closed)
+		return ERROR_SERVER_REMOTE_CLOSED;
+
+	for (;; ) {
+#ifndef _WIN32
+		ssize_t written = writev(connection->fd_out, v, count);
+		if (written > 0) {
+			while (count > 0 && (size_t)written >= v->iov_len) {
+				written -= v->iov_len;
+				v++;
+				count--;
+			}
+			if (count == 0)
+				return ERROR_OK;
+			v->iov_base = (char *)v->iov_base + written;
+			v->iov_len -= written;
+			continue;
+		}
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written < 0 && errno == EAGAIN &&
+				gdb_wait_writable(connection) == ERROR_OK)
+			continue;
+#else
+		int written = connection_write(connection, parts[part], lens[part]);
+		if (written > 0) {
+			parts[part] += written;
+			lens[part] -= written;
+			while (part < 3 && lens[part] == 0)
+				part++;
+			if (part == 3)
+				return ERROR_OK;
+			continue;
+		}
+		if (written < 0 && WSAGetLastError() == WSAEWOULDBLOCK &&
+				gdb_wait_writable(connection) == ERROR_OK)
+			continue;
+#endif
+		gdb_con->closed = 1;
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+}
+
 static int gdb_put_packet_inner(struct connection *connection,
 		char *buffer, int len)
 {
@@ -405,15 +524,10 @@ static int gdb_put_packet_inner(struct connection *connection,
 				return retval;
 		} else {
 			/* larger packets are transmitted directly from caller supplied buffer
-			 * by several calls to gdb_write() to avoid dynamic allocation */
+			 * with the framing around it to avoid dynamic allocation */
 			snprintf(local_buffer + 1, sizeof(local_buffer) - 1, "#%02x", my_checksum);
-			retval = gdb_write(connection, local_buffer, 1);
-			if (retval != ERROR_OK)
-				return retval;
-			retval = gdb_write(connection, buffer, len);
-			if (retval != ERROR_OK)
-				return retval;
-			retval = gdb_write(connection, local_buffer + 1, 3);
+			retval = gdb_write_framed(connection, local_buffer, 1,
+					buffer, len, local_buffer + 1, 3);
 			if (retval != ERROR_OK)
 				return retval;
 		}
@@ -481,8 +595,27 @@ int gdb_put_packet(struct connection *connection, char *buffer, int len)
 	return retval;
 }
 
+/* grows the packet buffer of a connection to hold at least size bytes
+ * and a terminating zero */
+static int gdb_packet_buffer_grow(struct gdb_connection *gdb_con, int size)
+{
+	if (size >= gdb_packet_size)
+		return ERROR_GDB_BUFFER_TOO_SMALL;
+	if (size < gdb_con->packet_buffer_size)
+		return ERROR_OK;
+
+	int new_size = MIN(MAX(2 * gdb_con->packet_buffer_size, size + 1), gdb_packet_size);
+	char *buffer = realloc(gdb_con->packet_buffer, new_size);
+	if (buffer == NULL)
+		return ERROR_GDB_BUFFER_TOO_SMALL;
+
+	gdb_con->packet_buffer = buffer;
+	gdb_con->packet_buffer_size = new_size;
+	return ERROR_OK;
+}
+
 static inline int fetch_packet(struct connection *connection,
-		int *checksum_ok, int noack, int *len, char *buffer)
+		int *checksum_ok, int noack, int *len)
 {
 	unsigned char my_checksum = 0;
 	char checksum[3];
@@ -494,17 +627,28 @@ static inline int fetch_packet(struct connection *connection,
 	int count = 0;
 	count = 0;
 
+	/* room for the packet, less its terminating zero */
+	char *buffer = gdb_con->packet_buffer;
+	int max = gdb_con->packet_buffer_size - 1;
+
 	/* move this over into local variables to use registers and give the
 	 * more freedom to optimize */
 	char *buf_p = gdb_con->buf_p;
 	int buf_cnt = gdb_con->buf_cnt;
 
 	for (;; ) {
+		/* make room for all that is buffered, if the ceiling allows it */
+		if (buf_cnt + count >= max
+				&& gdb_packet_buffer_grow(gdb_con, buf_cnt + count) == ERROR_OK) {
+			buffer = gdb_con->packet_buffer;
+			max = gdb_con->packet_buffer_size - 1;
+		}
+
 		/* The common case is that we have an entire packet with no escape chars.
 		 * We need to leave at least 2 bytes in the buffer to have
 		 * gdb_get_char() update various bits and bobs correctly.
 		 */
-		if ((buf_cnt > 2) && ((buf_cnt + count) < *len)) {
+		if ((buf_cnt > 2) && ((buf_cnt + count) < max)) {
 			/* The compiler will struggle a bit with constant propagation and
 			 * aliasing, so we help it by showing that these values do not
 			 * change inside the loop
@@ -542,10 +686,14 @@ static inline int fetch_packet(struct connection *connection,
 			if (done)
 				break;
 		}
-		if (count > *len) {
-			LOG_ERROR("packet buffer too small");
-			retval = ERROR_GDB_BUFFER_TOO_SMALL;
-			break;
+		if (count >= max) {
+			if (gdb_packet_buffer_grow(gdb_con, count + 1) != ERROR_OK) {
+				LOG_ERROR("packet buffer too small");
+				retval = ERROR_GDB_BUFFER_TOO_SMALL;
+				break;
+			}
+			buffer = gdb_con->packet_buffer;
+			max = gdb_con->packet_buffer_size - 1;
 		}
 
 		retval = gdb_get_char_fast(connection, &character, &buf_p, &buf_cnt);
@@ -596,8 +744,7 @@ static inline int fetch_packet(struct connection *connection,
 	return ERROR_OK;
 }
 
-static int gdb_get_packet_inner(struct connection *connection,
-		char *buffer, int *len)
+static int gdb_get_packet_inner(struct connection *connection, int *len)
 {
 	int character;
 	int retval;
@@ -650,11 +797,11 @@ static int gdb_get_packet_inner(struct connection *connection,
 		/* explicit code expansion here to get faster inlined code in -O3 by not
 		 * calculating checksum */
 		if (gdb_con->noack_mode) {
-			retval = fetch_packet(connection, &checksum_ok, 1, len, buffer);
+			retval = fetch_packet(connection, &checksum_ok, 1, len);
 			if (retval != ERROR_OK)
 				return retval;
 		} else {
-			retval = fetch_packet(connection, &checksum_ok, 0, len, buffer);
+			retval = fetch_packet(connection, &checksum_ok, 0, len);
 			if (retval != ERROR_OK)
 				return retval;
 		}
@@ -676,11 +823,11 @@ static int gdb_get_packet_inner(struct connection *connection,
 	return ERROR_OK;
 }
 
-static int gdb_get_packet(struct connection *connection, char *buffer, int *len)
+static int gdb_get_packet(struct connection *connection, int *len)
 {
 	struct gdb_connection *gdb_con = connection->priv;
 	gdb_con->busy = 1;
-	int retval = gdb_get_packet_inner(connection, buffer, len);
+	int retval = gdb_get_packet_inner(connection, len);
 	gdb_con->busy = 0;
 	return retval;
 }
@@ -925,17 +1072,24 @@ static int gdb_new_connection(struct connection *connection)
 	/* initialize gdb connection information */
 	gdb_connection->buf_p = gdb_connection->buffer;
 	gdb_connection->buf_cnt = 0;
+	gdb_connection->packet_buffer = NULL;
+	gdb_connection->packet_buffer_size = 0;
+	if (gdb_packet_buffer_grow(gdb_connection,
+			MIN(GDB_BUFFER_SIZE, gdb_packet_size) - 1) != ERROR_OK) {
+		free(gdb_connection);
+		connection->priv = NULL;
+		return ERROR_CONNECTION_REJECTED;
+	}
 	gdb_connection->ctrl_c = 0;
 	gdb_connection->frontend_state = TARGET_HALTED;
 	gdb_connection->vflash_image = NULL;
+	gdb_connection->vflash_stream = NULL;
 	gdb_connection->closed = 0;
 	gdb_connection->busy = 0;
 	gdb_connection->noack_mode = 0;
 	gdb_connection->sync = false;
 	gdb_connection->mem_write_error = false;
 	gdb_connection->attached = true;
-	gdb_connection->target_desc.tdesc = NULL;
-	gdb_connection->target_desc.tdesc_length = 0;
 
 	/* send ACK to GDB for debug request */
 	gdb_write(connection, "+", 1);
@@ -1026,10 +1180,21 @@ static int gdb_connection_closed(struct connection *connection)
 		gdb_connection->vflash_image = NULL;
 	}
 
+	/* drop what an unfinished vFlash stream holds, don't program it; part
+	 * of it may be written already, so end the write for the handlers */
+	if (gdb_connection->vflash_stream) {
+		free(gdb_connection->vflash_stream->buffer);
+		free(gdb_connection->vflash_stream);
+		gdb_connection->vflash_stream = NULL;
+		target_call_event_callbacks(gdb_service->target,
+				TARGET_EVENT_GDB_FLASH_WRITE_END);
+	}
+
 	/* if this connection registered a debug-message receiver delete it */
 	delete_debug_msg_receiver(connection->cmd_ctx, gdb_service->target);
 
 	if (connection->priv) {
+		free(gdb_connection->packet_buffer);
 		free(connection->priv);
 		connection->priv = NULL;
 	} else
@@ -1348,6 +1513,24 @@ static int gdb_error(struct connection *connection, int retval)
  *
  * 8191 bytes by the looks of it. Why 8191 bytes instead of 8192?????
  */
+/* escapes binary data for a packet as the 'X' packet expects it,
+ * returns the escaped length, at most twice the input's */
+static int gdb_escape_binary(char *out, const uint8_t *data, uint32_t len)
+{
+	char *p = out;
+
+	for (uint32_t i = 0; i < len; i++) {
+		uint8_t c = data[i];
+		if (c == '#' || c == '$' || c == '}' || c == '*') {
+			*p++ = '}';
+			c ^= 0x20;
+		}
+		*p++ = c;
+	}
+
+	return p - out;
+}
+
 static int gdb_read_memory_packet(struct connection *connection,
 		char const *packet, int packet_size)
 {
@@ -1361,6 +1544,9 @@ static int gdb_read_memory_packet(struct connection *connection,
 
 	int retval = ERROR_OK;
 
+	/* 'x' is the same as 'm', with the reply in binary */
+	bool binary = packet[0] == 'x';
+
 	/* skip command character */
 	packet++;
 
@@ -1374,16 +1560,25 @@ static int gdb_read_memory_packet(struct connection *connection,
 	len = strtoul(separator + 1, NULL, 16);
 
 	if (!len) {
+		if (binary) {
+			/* an empty 'x' reply would say we don't support it */
+			gdb_put_packet(connection, "b", 1);
+			return ERROR_OK;
+		}
 		LOG_WARNING("invalid read memory packet received (len == 0)");
 		gdb_put_packet(connection, NULL, 0);
 		return ERROR_OK;
 	}
 
 	buffer = malloc(len);
+	if (buffer == NULL) {
+		LOG_ERROR("unable to allocate memory for a %" PRIu32 " byte read", len);
+		return ERROR_GDB_BUFFER_TOO_SMALL;
+	}
 
 	LOG_DEBUG("addr: 0x%8.8" PRIx32 ", len: 0x%8.8" PRIx32 "", addr, len);
 
-	retval = target_read_buffer(target, addr, len, buffer);
+	retval = mem_cache_read(target, addr, len, buffer);
 
 	if ((retval != ERROR_OK) && !gdb_report_data_abort) {
 		/* TODO : Here we have to lie and send back all zero's lest stack traces won't work.
@@ -1406,7 +1601,12 @@ static int gdb_read_memory_packet(struct connection *connection,
 	if (retval == ERROR_OK) {
 		hex_buffer = malloc(len * 2 + 1);
 
-		int pkt_len = hexify(hex_buffer, (char *)buffer, len, len * 2 + 1);
+		int pkt_len;
+		if (binary) {
+			hex_buffer[0] = 'b';
+			pkt_len = 1 + gdb_escape_binary(hex_buffer + 1, buffer, len);
+		} else
+			pkt_len = hexify(hex_buffer, (char *)buffer, len, len * 2 + 1);
 
 		gdb_put_packet(connection, hex_buffer, pkt_len);
 
@@ -1448,6 +1648,10 @@ static int gdb_write_memory_packet(struct connection *connection,
 	}
 
 	buffer = malloc(len);
+	if (buffer == NULL) {
+		LOG_ERROR("unable to allocate memory for a %" PRIu32 " byte write", len);
+		return ERROR_GDB_BUFFER_TOO_SMALL;
+	}
 
 	LOG_DEBUG("addr: 0x%8.8" PRIx32 ", len: 0x%8.8" PRIx32 "", addr, len);
 
@@ -1721,36 +1925,44 @@ static int compare_bank(const void *a, const void *b)
 		return -1;
 }
 
-static int gdb_memory_map(struct connection *connection,
-		char const *packet, int packet_size)
+static struct gdb_target_xml *gdb_get_target_xml(struct target *target)
+{
+	struct gdb_target_xml *x;
+
+	for (x = gdb_target_xml_list; x; x = x->next) {
+		if (x->target == target)
+			return x;
+	}
+
+	x = calloc(1, sizeof(*x));
+	if (x == NULL) {
+		LOG_ERROR("Unable to allocate memory");
+		return NULL;
+	}
+	x->target = target;
+	x->next = gdb_target_xml_list;
+	gdb_target_xml_list = x;
+
+	return x;
+}
+
+static int gdb_generate_memory_map(struct target *target, char **xml_out, int *length_out)
 {
 	/* We get away with only specifying flash here. Regions that are not
 	 * specified are treated as if we provided no memory map(if not we
 	 * could detect the holes and mark them as RAM).
-	 * Normally we only execute this code once, but no big deal if we
-	 * have to regenerate it a couple of times.
 	 */
 
-	struct target *target = get_target_from_connection(connection);
 	struct flash_bank *p;
 	char *xml = NULL;
 	int size = 0;
 	int pos = 0;
 	int retval = ERROR_OK;
 	struct flash_bank **banks;
-	int offset;
-	int length;
-	char *separator;
 	uint32_t ram_start = 0;
 	int i;
 	int target_flash_banks = 0;
 
-	/* skip command character */
-	packet += 23;
-
-	offset = strtoul(packet, &separator, 16);
-	length = strtoul(separator + 1, &separator, 16);
-
 	xml_printf(&retval, &xml, &pos, &size, "<memory-map>\n");
 
 	/* Sort banks in ascending order.  We need to report non-flash
@@ -1769,7 +1981,7 @@ static int gdb_memory_map(struct connection *connection,
 		retval = get_flash_bank_by_num(i, &p);
 		if (retval != ERROR_OK) {
 			free(banks);
-			gdb_error(connection, retval);
+			free(xml);
 			return retval;
 		}
 		banks[target_flash_banks++] = p;
@@ -1850,20 +2062,68 @@ static int gdb_memory_map(struct connection *connection,
 	xml_printf(&retval, &xml, &pos, &size, "</memory-map>\n");
 
 	if (retval != ERROR_OK) {
-		gdb_error(connection, retval);
+		free(xml);
 		return retval;
 	}
 
-	if (offset + length > pos)
-		length = pos - offset;
+	*xml_out = xml;
+	*length_out = pos;
+	return ERROR_OK;
+}
+
+static int gdb_memory_map(struct connection *connection,
+		char const *packet, int packet_size)
+{
+	struct target *target = get_target_from_connection(connection);
+	struct gdb_target_xml *x = gdb_get_target_xml(target);
+	unsigned long offset;
+	unsigned long length;
+	char *separator;
+	int retval;
+
+	if (x == NULL) {
+		gdb_error(connection, ERROR_FAIL);
+		return ERROR_FAIL;
+	}
+
+	/* skip command character */
+	packet += 23;
+
+	offset = strtoul(packet, &separator, 16);
+	length = strtoul(separator + 1, &separator, 16);
+
+	/* GDB reads the map in pieces, and again on every connection */
+	unsigned generation = flash_get_bank_generation();
+	if (x->memory_map == NULL || x->memory_map_generation != generation) {
+		free(x->memory_map);
+		x->memory_map = NULL;
+
+		retval = gdb_generate_memory_map(target, &x->memory_map,
+				&x->memory_map_length);
+		if (retval != ERROR_OK) {
+			gdb_error(connection, retval);
+			return retval;
+		}
+		x->memory_map_generation = generation;
+	}
+
+	/* clamp to the map, without forming offset + length */
+	unsigned long map_length = x->memory_map_length;
+	if (offset > map_length)
+		offset = map_length;
+	if (length > map_length - offset)
+		length = map_length - offset;
 
 	char *t = malloc(length + 1);
+	if (t == NULL) {
+		gdb_error(connection, ERROR_FAIL);
+		return ERROR_FAIL;
+	}
 	t[0] = 'l';
-	memcpy(t + 1, xml + offset, length);
+	memcpy(t + 1, x->memory_map + offset, length);
 	gdb_put_packet(connection, t, length + 1);
 
 	free(t);
-	free(xml);
 	return ERROR_OK;
 }
 
@@ -2171,27 +2431,36 @@ error:
 	return retval;
 }
 
-static int gdb_get_target_description_chunk(struct target *target, struct target_desc_format *target_desc,
+static int gdb_get_target_description_chunk(struct target *target,
 		char **chunk, int32_t offset, uint32_t length)
 {
-	if (target_desc == NULL) {
+	struct gdb_target_xml *x = gdb_get_target_xml(target);
+	if (x == NULL) {
 		LOG_ERROR("Unable to Generate Target Description");
 		return ERROR_FAIL;
 	}
 
-	char *tdesc = target_desc->tdesc;
-	uint32_t tdesc_length = target_desc->tdesc_length;
+	unsigned generation = register_cache_generation();
+	if (x->tdesc == NULL || x->tdesc_generation != generation) {
+		free(x->tdesc);
+		x->tdesc = NULL;
 
-	if (tdesc == NULL) {
-		int retval = gdb_generate_target_description(target, &tdesc);
+		int retval = gdb_generate_target_description(target, &x->tdesc);
 		if (retval != ERROR_OK) {
 			LOG_ERROR("Unable to Generate Target Description");
 			return ERROR_FAIL;
 		}
 
-		tdesc_length = strlen(tdesc);
+		x->tdesc_length = strlen(x->tdesc);
+		x->tdesc_generation = generation;
 	}
 
+	char *tdesc = x->tdesc;
+	uint32_t tdesc_length = x->tdesc_length;
+
+	if (offset < 0 || (uint32_t)offset > tdesc_length)
+		offset = tdesc_length;
+
 	char transfer_type;
 
 	if (length < (tdesc_length - offset))
@@ -2212,16 +2481,8 @@ static int gdb_get_target_description_chunk(struct target *target, struct target
 	} else {
 		strncpy((*chunk) + 1, tdesc + offset, tdesc_length - offset);
 		(*chunk)[1 + (tdesc_length - offset)] = '\0';
-
-		/* After gdb-server sends out last chunk, invalidate tdesc. */
-		free(tdesc);
-		tdesc = NULL;
-		tdesc_length = 0;
 	}
 
-	target_desc->tdesc = tdesc;
-	target_desc->tdesc_length = tdesc_length;
-
 	return ERROR_OK;
 }
 
@@ -2332,7 +2593,7 @@ static int gdb_query_packet(struct connection *connection,
 		}
 	} else if (strncmp(packet, "qSupported", 10) == 0) {
 		/* we currently support packet size and qXfer:memory-map:read (if enabled)
-		 * qXfer:features:read is supported for some targets */
+		 * qXfer:features:read is supported for some targets, and 'x' packets */
 		int retval = ERROR_OK;
 		char *buffer = NULL;
 		int pos = 0;
@@ -2357,8 +2618,9 @@ static int gdb_query_packet(struct connection *connection,
 			&buffer,
 			&pos,
 			&size,
-			"PacketSize=%x;qXfer:memory-map:read%c;qXfer:features:read%c;QStartNoAckMode+",
-			(GDB_BUFFER_SIZE - 1),
+			"PacketSize=%x;qXfer:memory-map:read%c;qXfer:features:read%c;"
+			"QStartNoAckMode+;binary-upload+",
+			(gdb_packet_size - 1),
 			((gdb_use_memory_map == 1) && (flash_get_bank_count() > 0)) ? '+' : '-',
 			(gdb_target_desc_supported == 1) ? '+' : '-');
 
@@ -2394,8 +2656,7 @@ static int gdb_query_packet(struct connection *connection,
 		 * there are *more* chunks to transfer. 'l' for it is the *last*
 		 * chunk of target description.
 		 */
-		retval = gdb_get_target_description_chunk(target, &gdb_connection->target_desc,
-				&xml, offset, length);
+		retval = gdb_get_target_description_chunk(target, &xml, offset, length);
 		if (retval != ERROR_OK) {
 			gdb_error(connection, retval);
 			return retval;
@@ -2502,6 +2763,27 @@ static int gdb_v_packet(struct connection *connection,
 		}
 		length = packet_size - (parse - packet);
 
+		if (gdb_flash_stream) {
+			struct flash_stream *stream = gdb_connection->vflash_stream;
+
+			if (stream == NULL) {
+				stream = malloc(sizeof(*stream));
+				if (stream == NULL)
+					return ERROR_FAIL;
+				flash_stream_init(stream, gdb_service->target);
+				gdb_connection->vflash_stream = stream;
+				target_call_event_callbacks(gdb_service->target,
+						TARGET_EVENT_GDB_FLASH_WRITE_START);
+			}
+
+			/* reply first so the next packet is on its way while this
+			 * one is programmed; errors are reported by vFlashDone */
+			gdb_put_packet(connection, "OK", 2);
+			flash_stream_write(stream, addr, (uint8_t const *)parse, length);
+
+			return ERROR_OK;
+		}
+
 		/* create a new image if there isn't already one */
 		if (gdb_connection->vflash_image == NULL) {
 			gdb_connection->vflash_image = malloc(sizeof(struct image));
@@ -2522,11 +2804,18 @@ static int gdb_v_packet(struct connection *connection,
 	if (strncmp(packet, "vFlashDone", 10) == 0) {
 		uint32_t written;
 
-		/* process the flashing buffer. No need to erase as GDB
-		 * always issues a vFlashErase first. */
-		target_call_event_callbacks(gdb_service->target,
-				TARGET_EVENT_GDB_FLASH_WRITE_START);
-		result = flash_write(gdb_service->target, gdb_connection->vflash_image, &written, 0);
+		if (gdb_connection->vflash_stream) {
+			/* program what is left of the stream */
+			result = flash_stream_done(gdb_connection->vflash_stream, &written);
+			free(gdb_connection->vflash_stream);
+			gdb_connection->vflash_stream = NULL;
+		} else {
+			/* process the flashing buffer. No need to erase as GDB
+			 * always issues a vFlashErase first. */
+			target_call_event_callbacks(gdb_service->target,
+					TARGET_EVENT_GDB_FLASH_WRITE_START);
+			result = flash_write(gdb_service->target, gdb_connection->vflash_image, &written, 0);
+		}
 		target_call_event_callbacks(gdb_service->target, TARGET_EVENT_GDB_FLASH_WRITE_END);
 		if (result != ERROR_OK) {
 			if (result == ERROR_FLASH_DST_OUT_OF_BANK)
@@ -2538,9 +2827,11 @@ static int gdb_v_packet(struct connection *connection,
 			gdb_put_packet(connection, "OK", 2);
 		}
 
-		image_close(gdb_connection->vflash_image);
-		free(gdb_connection->vflash_image);
-		gdb_connection->vflash_image = NULL;
+		if (gdb_connection->vflash_image) {
+			image_close(gdb_connection->vflash_image);
+			free(gdb_connection->vflash_image);
+			gdb_connection->vflash_image = NULL;
+		}
 
 		return ERROR_OK;
 	}
@@ -2629,12 +2920,9 @@ static void gdb_sig_halted(struct connection *connection)
 
 static int gdb_input_inner(struct connection *connection)
 {
-	/* Do not allocate this on the stack */
-	static char gdb_packet_buffer[GDB_BUFFER_SIZE];
-
 	struct gdb_service *gdb_service = connection->service->priv;
 	struct target *target = gdb_service->target;
-	char const *packet = gdb_packet_buffer;
+	char const *packet;
 	int packet_size;
 	int retval;
 	struct gdb_connection *gdb_con = connection->priv;
@@ -2652,13 +2940,13 @@ static int gdb_input_inner(struct connection *connection)
 	 * drain the rest of the buffer.
 	 */
 	do {
-		packet_size = GDB_BUFFER_SIZE-1;
-		retval = gdb_get_packet(connection, gdb_packet_buffer, &packet_size);
+		retval = gdb_get_packet(connection, &packet_size);
 		if (retval != ERROR_OK)
 			return retval;
 
 		/* terminate with zero */
-		gdb_packet_buffer[packet_size] = '\0';
+		gdb_con->packet_buffer[packet_size] = '\0';
+		packet = gdb_con->packet_buffer;
 
 		if (LOG_LEVEL_IS(LOG_LVL_DEBUG)) {
 			if (packet[0] == 'X') {
@@ -2702,6 +2990,7 @@ static int gdb_input_inner(struct connection *connection)
 					retval = gdb_set_register_packet(connection, packet, packet_size);
 					break;
 				case 'm':
+				case 'x':
 					retval = gdb_read_memory_packet(connection, packet, packet_size);
 					break;
 				case 'M':
@@ -3007,6 +3296,15 @@ COMMAND_HANDLER(handle_gdb_flash_program_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_gdb_flash_stream_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_ENABLE(CMD_ARGV[0], gdb_flash_stream);
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_gdb_report_data_abort_command)
 {
 	if (CMD_ARGC != 1)
@@ -3016,6 +3314,25 @@ COMMAND_HANDLER(handle_gdb_report_data_abort_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_gdb_packet_size_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		int size;
+		COMMAND_PARSE_NUMBER(int, CMD_ARGV[0], size);
+		if (size < 1024 || size > GDB_MAX_PACKET_SIZE) {
+			LOG_ERROR("packet size must be between 1024 and %d", GDB_MAX_PACKET_SIZE);
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+		gdb_packet_size = size;
+	}
+
+	command_print(CMD_CTX, "%d", gdb_packet_size);
+	return ERROR_OK;
+}
+
 /* gdb_breakpoint_override */
 COMMAND_HANDLER(handle_gdb_breakpoint_override_command)
 {
@@ -3130,6 +3447,14 @@ static const struct command_registration gdb_command_handlers[] = {
 		.help = "enable or disable flash program",
 		.usage = "('enable'|'disable')"
 	},
+	{
+		.name = "gdb_flash_stream",
+		.handler = handle_gdb_flash_stream_command,
+		.mode = COMMAND_CONFIG,
+		.help = "enable or disable programming flash while GDB "
+			"is still sending the data",
+		.usage = "('enable'|'disable')"
+	},
 	{
 		.name = "gdb_report_data_abort",
 		.handler = handle_gdb_report_data_abort_command,
@@ -3137,6 +3462,13 @@ static const struct command_registration gdb_command_handlers[] = {
 		.help = "enable or disable reporting data aborts",
 		.usage = "('enable'|'disable')"
 	},
+	{
+		.name = "gdb_packet_size",
+		.handler = handle_gdb_packet_size_command,
+		.mode = COMMAND_CONFIG,
+		.help = "largest packet GDB may send, in bytes",
+		.usage = "[size]"
+	},
 	{
 		.name = "gdb_breakpoint_override",
 		.handler = handle_gdb_breakpoint_override_command,
@@ -0,0 +1,509 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.           *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "jtag_server.h"
+#include <jtag/jtag.h>
+#include <jtag/interface.h>
+#include <jtag/minidriver.h>
+#include <jtag/drivers/jtag_record.h>
+#include <helper/binarybuffer.h>
+
+/*
+ * The jtag_server runs queues sent by a remote_jtag client on the local
+ * adapter, one message per queue, and answers with the captured bits
+ * only.  See jtag_record.h for the message format.
+ */
+
+#define JTAG_SERVER_READ_SIZE (64 * 1024)
+
+struct jtag_server_connection {
+	bool magic_seen;
+	uint8_t *in;
+	size_t in_used;
+	size_t in_size;
+};
+
+/* bits a scan captured into its buffer that go back to the client */
+struct jtag_server_capture {
+	const uint8_t *bits;
+	unsigned offset;
+	unsigned num_bits;
+};
+
+/* state of decoding one message */
+struct jtag_server_message {
+	const uint8_t *p;
+	size_t left;
+	bool error;
+	/* only validate, queue nothing */
+	bool check;
+
+	/* buffers handed to the JTAG layer, freed after the flush */
+	void **allocs;
+	unsigned num_allocs;
+	unsigned max_allocs;
+
+	struct jtag_server_capture *captures;
+	unsigned num_captures;
+	unsigned max_captures;
+	size_t capture_bytes;
+};
+
+static char *jtag_server_port;
+
+static const uint8_t *jtag_server_get(struct jtag_server_message *msg, size_t size)
+{
+	if (msg->error || size > msg->left) {
+		msg->error = true;
+		return NULL;
+	}
+
+	const uint8_t *p = msg->p;
+	msg->p += size;
+	msg->left -= size;
+	return p;
+}
+
+static uint8_t jtag_server_get_u8(struct jtag_server_message *msg)
+{
+	const uint8_t *p = jtag_server_get(msg, 1);
+	return p ? *p : 0;
+}
+
+static uint32_t jtag_server_get_u32(struct jtag_server_message *msg)
+{
+	const uint8_t *p = jtag_server_get(msg, 4);
+	return p ? le_to_h_u32(p) : 0;
+}
+
+static tap_state_t jtag_server_get_state(struct jtag_server_message *msg)
+{
+	return (tap_state_t)(int8_t)jtag_server_get_u8(msg);
+}
+
+static void *jtag_server_alloc(struct jtag_server_message *msg, size_t size)
+{
+	if (msg->num_allocs == msg->max_allocs) {
+		unsigned max = msg->max_allocs ? 2 * msg->max_allocs : 64;
+		void **allocs = realloc(msg->allocs, max * sizeof(*allocs));
+		if (!allocs) {
+			msg->error = true;
+			return NULL;
+		}
+		msg->allocs = allocs;
+		msg->max_allocs = max;
+	}
+
+	void *p = calloc(1, size ? size : 1);
+	if (!p) {
+		msg->error = true;
+		return NULL;
+	}
+	msg->allocs[msg->num_allocs++] = p;
+	return p;
+}
+
+static void jtag_server_add_capture(struct jtag_server_message *msg,
+		const uint8_t *bits, unsigned offset, unsigned num_bits)
+{
+	if (msg->num_captures == msg->max_captures) {
+		unsigned max = msg->max_captures ? 2 * msg->max_captures : 64;
+		struct jtag_server_capture *captures = realloc(msg->captures,
+				max * sizeof(*captures));
+		if (!captures) {
+			msg->error = true;
+			return;
+		}
+		msg->captures = captures;
+		msg->max_captures = max;
+	}
+
+	struct jtag_server_capture *c = &msg->captures[msg->num_captures++];
+	c->bits = bits;
+	c->offset = offset;
+	c->num_bits = num_bits;
+	msg->capture_bytes += DIV_ROUND_UP(num_bits, 8);
+}
+
+/* end states coming from the network must not trip the asserts of the
+ * JTAG layer */
+static bool jtag_server_scan_state_ok(tap_state_t state)
+{
+	return tap_is_state_stable(state) && state != TAP_RESET;
+}
+
+static int jtag_server_scan(struct jtag_server_message *msg)
+{
+	uint8_t flags = jtag_server_get_u8(msg);
+	tap_state_t end_state = jtag_server_get_state(msg);
+	uint32_t num_fields = jtag_server_get_u32(msg);
+
+	if (msg->error || !jtag_server_scan_state_ok(end_state))
+		return ERROR_FAIL;
+
+	/* first pass: the length of the whole scan */
+	const uint8_t *start = msg->p;
+	size_t start_left = msg->left;
+	unsigned total_bits = 0;
+	bool capture = false;
+
+	for (uint32_t i = 0; i < num_fields && !msg->error; i++) {
+		uint32_t num_bits = jtag_server_get_u32(msg);
+		uint8_t field_flags = jtag_server_get_u8(msg);
+
+		if (num_bits == 0 || num_bits > JTAG_RECORD_MESSAGE_MAX * 8u - total_bits)
+			return ERROR_FAIL;
+		if (field_flags & JTAG_RECORD_FIELD_OUT)
+			jtag_server_get(msg, DIV_ROUND_UP(num_bits, 8));
+		if (field_flags & JTAG_RECORD_FIELD_IN)
+			capture = true;
+		total_bits += num_bits;
+	}
+	if (msg->error || total_bits == 0)
+		return ERROR_FAIL;
+	if (msg->check)
+		return ERROR_OK;
+
+	uint8_t *out = jtag_server_alloc(msg, DIV_ROUND_UP(total_bits, 8));
+	uint8_t *in = capture ? jtag_server_alloc(msg, DIV_ROUND_UP(total_bits, 8)) : NULL;
+	if (msg->error)
+		return ERROR_FAIL;
+
+	/* second pass: one buffer for the whole chain, fields without
+	 * data shift out zeroes */
+	msg->p = start;
+	msg->left = start_left;
+	unsigned offset = 0;
+
+	for (uint32_t i = 0; i < num_fields; i++) {
+		uint32_t num_bits = jtag_server_get_u32(msg);
+		uint8_t field_flags = jtag_server_get_u8(msg);
+
+		if (field_flags & JTAG_RECORD_FIELD_OUT) {
+			const uint8_t *bits = jtag_server_get(msg, DIV_ROUND_UP(num_bits, 8));
+			buf_set_buf(bits, 0, out, offset, num_bits);
+		}
+		if (field_flags & JTAG_RECORD_FIELD_IN)
+			jtag_server_add_capture(msg, in, offset, num_bits);
+		offset += num_bits;
+	}
+	if (msg->error)
+		return ERROR_FAIL;
+
+	if (flags & JTAG_RECORD_SCAN_IR)
+		jtag_add_plain_ir_scan(total_bits, out, in, end_state);
+	else
+		jtag_add_plain_dr_scan(total_bits, out, in, end_state);
+
+	return ERROR_OK;
+}
+
+static int jtag_server_command(struct jtag_server_message *msg, uint8_t type)
+{
+	uint32_t count;
+	tap_state_t state;
+
+	switch (type) {
+		case JTAG_RECORD_SCAN:
+			return jtag_server_scan(msg);
+		case JTAG_RECORD_TLR_RESET:
+			jtag_server_get_u8(msg);
+			if (!msg->check)
+				jtag_add_tlr();
+			break;
+		case JTAG_RECORD_RUNTEST:
+			count = jtag_server_get_u32(msg);
+			state = jtag_server_get_state(msg);
+			if (msg->error || !jtag_server_scan_state_ok(state))
+				return ERROR_FAIL;
+			if (!msg->check)
+				jtag_add_runtest(count, state);
+			break;
+		case JTAG_RECORD_RESET:
+		{
+			int trst = (int8_t)jtag_server_get_u8(msg);
+			int srst = (int8_t)jtag_server_get_u8(msg);
+			if (msg->error)
+				return ERROR_FAIL;
+			if (msg->check)
+				break;
+			/* the client already applied its reset_config, so drive
+			 * the lines as told and keep only the state tracking */
+			jtag_set_error(interface_jtag_add_reset(trst, srst));
+			if (trst == 1)
+				cmd_queue_cur_state = TAP_RESET;
+			break;
+		}
+		case JTAG_RECORD_PATHMOVE:
+		{
+			count = jtag_server_get_u32(msg);
+			const uint8_t *states = jtag_server_get(msg, count);
+			if (msg->error || count == 0 || cmd_queue_cur_state == TAP_INVALID)
+				return ERROR_FAIL;
+			if (msg->check)
+				break;
+			tap_state_t *path = jtag_server_alloc(msg, count * sizeof(*path));
+			if (!path)
+				return ERROR_FAIL;
+			for (uint32_t i = 0; i < count; i++)
+				path[i] = (tap_state_t)(int8_t)states[i];
+			jtag_add_pathmove(count, path);
+			break;
+		}
+		case JTAG_RECORD_SLEEP:
+			count = jtag_server_get_u32(msg);
+			if (!msg->check)
+				jtag_add_sleep(count);
+			break;
+		case JTAG_RECORD_STABLECLOCKS:
+			count = jtag_server_get_u32(msg);
+			if (!msg->check)
+				jtag_add_clocks(count);
+			break;
+		case JTAG_RECORD_TMS:
+		{
+			count = jtag_server_get_u32(msg);
+			const uint8_t *bits = jtag_server_get(msg, DIV_ROUND_UP(count, 8));
+			if (msg->error)
+				return ERROR_FAIL;
+			if (msg->check)
+				break;
+
+			/* follow the sequence to know where it leaves the TAPs */
+			state = cmd_queue_cur_state;
+			for (uint32_t i = 0; i < count && state != TAP_INVALID; i++)
+				state = tap_state_transition(state, (bits[i / 8] >> (i % 8)) & 1);
+			jtag_set_error(jtag_add_tms_seq(count, bits, state));
+			break;
+		}
+		default:
+			LOG_ERROR("jtag_server: unknown record type %d", type);
+			return ERROR_FAIL;
+	}
+
+	return msg->error ? ERROR_FAIL : ERROR_OK;
+}
+
+static void jtag_server_message_free(struct jtag_server_message *msg)
+{
+	for (unsigned i = 0; i < msg->num_allocs; i++)
+		free(msg->allocs[i]);
+	free(msg->allocs);
+	free(msg->captures);
+}
+
+static int jtag_server_reply(struct connection *connection,
+		const struct jtag_server_message *msg, int queue_retval)
+{
+	size_t size = 8 + msg->capture_bytes;
+	uint8_t *reply = malloc(size);
+	if (!reply)
+		return ERROR_SERVER_REMOTE_CLOSED;
+
+	h_u32_to_le(reply, size - 4);
+	h_u32_to_le(reply + 4, queue_retval);
+
+	uint8_t *p = reply + 8;
+	for (unsigned i = 0; i < msg->num_captures; i++) {
+		const struct jtag_server_capture *c = &msg->captures[i];
+		size_t bytes = DIV_ROUND_UP(c->num_bits, 8);
+
+		memset(p, 0, bytes);
+		buf_set_buf(c->bits, c->offset, p, 0, c->num_bits);
+		p += bytes;
+	}
+
+	int retval = ERROR_OK;
+	if (connection_write(connection, reply, size) != (int)size)
+		retval = ERROR_SERVER_REMOTE_CLOSED;
+	free(reply);
+	return retval;
+}
+
+/* decodes a whole queue, ending with its FLUSH record */
+static int jtag_server_decode(struct jtag_server_message *msg,
+		const uint8_t *data, size_t size)
+{
+	msg->p = data;
+	msg->left = size;
+
+	for (;;) {
+		uint8_t type = jtag_server_get_u8(msg);
+		if (msg->error)
+			return ERROR_FAIL;
+
+		if (type == JTAG_RECORD_FLUSH)
+			break;
+
+		int retval = jtag_server_command(msg, type);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	jtag_server_get_u32(msg);
+	return msg->error || msg->left != 0 ? ERROR_FAIL : ERROR_OK;
+}
+
+static int jtag_server_message(struct connection *connection,
+		const uint8_t *data, size_t size)
+{
+	struct jtag_server_message msg = { .check = true };
+	int retval;
+
+	/* whatever a local user left queued must not be mixed into the
+	 * client's queue */
+	jtag_execute_queue();
+
+	/* a broken message must not get half way to the adapter, so look
+	 * at all of it before queuing anything */
+	retval = jtag_server_decode(&msg, data, size);
+	if (retval == ERROR_OK) {
+		msg.check = false;
+		retval = jtag_server_decode(&msg, data, size);
+	}
+	if (retval != ERROR_OK) {
+		LOG_ERROR("jtag_server: malformed queue from client");
+		jtag_server_message_free(&msg);
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+
+	int queue_retval = jtag_execute_queue();
+
+	retval = jtag_server_reply(connection, &msg, queue_retval);
+	jtag_server_message_free(&msg);
+	return retval;
+}
+
+static int jtag_server_new_connection(struct connection *connection)
+{
+	struct jtag_server_connection *jc = calloc(1, sizeof(*jc));
+	if (!jc)
+		return ERROR_CONNECTION_REJECTED;
+
+	connection->priv = jc;
+	return ERROR_OK;
+}
+
+static int jtag_server_input(struct connection *connection)
+{
+	struct jtag_server_connection *jc = connection->priv;
+
+	if (jc->in_size - jc->in_used < JTAG_SERVER_READ_SIZE) {
+		size_t size = jc->in_size ? 2 * jc->in_size : 2 * JTAG_SERVER_READ_SIZE;
+		uint8_t *in = realloc(jc->in, size);
+		if (!in)
+			return ERROR_SERVER_REMOTE_CLOSED;
+		jc->in = in;
+		jc->in_size = size;
+	}
+
+	int rlen = connection_read(connection, jc->in + jc->in_used, JTAG_SERVER_READ_SIZE);
+	if (rlen <= 0) {
+		if (rlen < 0)
+			LOG_ERROR("error during read: %s", strerror(errno));
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+	jc->in_used += rlen;
+
+	size_t pos = 0;
+	size_t magic_len = strlen(JTAG_RECORD_MAGIC);
+
+	if (!jc->magic_seen) {
+		if (jc->in_used < magic_len)
+			return ERROR_OK;
+		if (memcmp(jc->in, JTAG_RECORD_MAGIC, magic_len) != 0) {
+			LOG_ERROR("jtag_server: client doesn't speak the remote_jtag protocol");
+			return ERROR_SERVER_REMOTE_CLOSED;
+		}
+		jc->magic_seen = true;
+		pos = magic_len;
+	}
+
+	while (jc->in_used - pos >= 4) {
+		uint32_t size = le_to_h_u32(jc->in + pos);
+		if (size > JTAG_RECORD_MESSAGE_MAX) {
+			LOG_ERROR("jtag_server: message too large");
+			return ERROR_SERVER_REMOTE_CLOSED;
+		}
+		if (jc->in_used - pos - 4 < size)
+			break;
+
+		int retval = jtag_server_message(connection, jc->in + pos + 4, size);
+		if (retval != ERROR_OK)
+			return retval;
+		pos += 4 + size;
+	}
+
+	memmove(jc->in, jc->in + pos, jc->in_used - pos);
+	jc->in_used -= pos;
+
+	return ERROR_OK;
+}
+
+static int jtag_server_closed(struct connection *connection)
+{
+	struct jtag_server_connection *jc = connection->priv;
+
+	if (jc) {
+		free(jc->in);
+		free(jc);
+		connection->priv = NULL;
+	}
+
+	return ERROR_OK;
+}
+
+int jtag_server_init(void)
+{
+	if (strcmp(jtag_server_port, "disabled") == 0) {
+		LOG_INFO("jtag server disabled");
+		return ERROR_OK;
+	}
+
+	/* one client at a time, or their queues would interleave */
+	return add_service("jtag", jtag_server_port, 1,
+		&jtag_server_new_connection, &jtag_server_input,
+		&jtag_server_closed, NULL);
+}
+
+COMMAND_HANDLER(handle_jtag_server_port_command)
+{
+	return CALL_COMMAND_HANDLER(server_pipe_command, &jtag_server_port);
+}
+
+static const struct command_registration jtag_server_command_handlers[] = {
+	{
+		.name = "jtag_server_port",
+		.handler = handle_jtag_server_port_command,
+		.mode = COMMAND_ANY,
+		.help = "Specify port on which to listen for remote_jtag "
+			"clients, or 'disabled'.  "
+			"Read help on 'gdb_port'.",
+		.usage = "[port_num]",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+int jtag_server_register_commands(struct command_context *cmd_ctx)
+{
+	jtag_server_port = strdup("disabled");
+	return register_commands(cmd_ctx, NULL, jtag_server_command_handlers);
+}
@@ -34,6 +34,7 @@
 #include <target/openrisc/jsp_server.h>
 #include "openocd.h"
 #include "tcl_server.h"
+#include "jtag_server.h"
 #include "telnet_server.h"
 
 #include <signal.h>
@@ -557,6 +558,10 @@ int server_init(struct command_context *cmd_ctx)
 	if (ERROR_OK != ret)
 		return ret;
 
+	ret = jtag_server_init();
+	if (ERROR_OK != ret)
+		return ret;
+
 	return telnet_init("Open On-Chip Debugger");
 }
 
@@ -666,6 +671,10 @@ int server_register_commands(struct command_context *cmd_ctx)
 	if (ERROR_OK != retval)
 		return retval;
 
+	retval = jtag_server_register_commands(cmd_ctx);
+	if (ERROR_OK != retval)
+		return retval;
+
 	return register_commands(cmd_ctx, NULL, server_command_handlers);
 }
 
@@ -217,6 +217,7 @@ static int svf_check_tdo(void);
 static int svf_add_check_para(uint8_t enabled, int buffer_offset, int bit_len);
 static int svf_run_command(struct command_context *cmd_ctx, char *cmd_str);
 static int svf_execute_tap(void);
+static int svf_submit_tap(void);
 
 static FILE *svf_fd;
 static char *svf_read_line;
@@ -913,6 +914,31 @@ static int svf_execute_tap(void)
 	return ERROR_OK;
 }
 
+/* Scan data is copied into the JTAG queue, so unless TDO has to be
+ * checked the queue refers to none of our buffers and can be handed to
+ * the adapter without waiting for it; see jtag_submit_queue().  Errors
+ * show up at the next svf_execute_tap(). */
+static int svf_submit_tap(void)
+{
+	int i;
+
+	if (!jtag_is_pipelined())
+		return svf_execute_tap();
+
+	for (i = 0; i < svf_check_tdo_para_index; i++) {
+		if (svf_check_tdo_para[i].enabled)
+			return svf_execute_tap();
+	}
+
+	if (!svf_nil)
+		jtag_submit_queue();
+
+	svf_check_tdo_para_index = 0;
+	svf_buffer_index = 0;
+
+	return ERROR_OK;
+}
+
 static int svf_run_command(struct command_context *cmd_ctx, char *cmd_str)
 {
 	char *argus[256], command;
@@ -1557,7 +1583,7 @@ XXR_common:
 				(svf_check_tdo_para_index >= SVF_CHECK_TDO_PARA_SIZE / 2)) && \
 				(((command != STATE) && (command != RUNTEST)) || \
 						((command == STATE) && (num_of_argu == 2))))
-			return svf_execute_tap();
+			return svf_submit_tap();
 	}
 
 	return ERROR_OK;
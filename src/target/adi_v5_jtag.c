@@ -58,6 +58,22 @@ static int jtag_ap_q_abort(struct adiv5_dap *dap, uint8_t *ack);
  *
 ***************************************************************************/
 
+static void adi_jtag_dp_scan_delay(struct adiv5_dap *dap,
+		uint8_t instr, uint8_t reg_addr)
+{
+	/* Add specified number of tck clocks after starting memory bus
+	 * access, giving the hardware time to complete the access.
+	 * They provide more time for the (MEM) AP to complete the read ...
+	 * See "Minimum Response Time" for JTAG-DP, in the ADIv5 spec.
+	 */
+	if ((instr == JTAG_DP_APACC)
+			&& ((reg_addr == AP_REG_DRW)
+				|| ((reg_addr & 0xF0) == AP_REG_BD0))
+			&& (dap->memaccess_tck != 0))
+		jtag_add_runtest(dap->memaccess_tck,
+				TAP_IDLE);
+}
+
 /**
  * Scan DPACC or APACC using target ordered uint8_t buffers.  No endianness
  * conversions are performed.  See section 4.4.3 of the ADIv5 spec, which
@@ -109,56 +125,46 @@ static int adi_jtag_dp_scan(struct adiv5_dap *dap,
 
 	jtag_add_dr_scan(jtag_info->tap, 2, fields, TAP_IDLE);
 
-	/* Add specified number of tck clocks after starting memory bus
-	 * access, giving the hardware time to complete the access.
-	 * They provide more time for the (MEM) AP to complete the read ...
-	 * See "Minimum Response Time" for JTAG-DP, in the ADIv5 spec.
-	 */
-	if ((instr == JTAG_DP_APACC)
-			&& ((reg_addr == AP_REG_DRW)
-				|| ((reg_addr & 0xF0) == AP_REG_BD0))
-			&& (dap->memaccess_tck != 0))
-		jtag_add_runtest(dap->memaccess_tck,
-				TAP_IDLE);
+	adi_jtag_dp_scan_delay(dap, instr, reg_addr);
 
 	return ERROR_OK;
 }
 
 /**
- * Scan DPACC or APACC out and in from host ordered uint32_t buffers.
- * This is exactly like adi_jtag_dp_scan(), except that endianness
- * conversions are performed (so the types of invalue and outvalue
- * must be different).
+ * Scan DPACC or APACC out and in from host ordered uint32_t values.
+ * This is exactly like adi_jtag_dp_scan(), except that the word oriented
+ * scan API is used, so no endianness conversions are needed here and the
+ * types of invalue and outvalue differ.
  */
 static int adi_jtag_dp_scan_u32(struct adiv5_dap *dap,
 		uint8_t instr, uint8_t reg_addr, uint8_t RnW,
-		uint32_t outvalue, uint32_t *invalue, uint8_t *ack)
+		uint32_t outvalue, uint32_t *invalue, uint32_t *ack)
 {
-	uint8_t out_value_buf[4];
+	struct arm_jtag *jtag_info = dap->jtag_info;
 	int retval;
 
-	buf_set_u32(out_value_buf, 0, 32, outvalue);
-
-	retval = adi_jtag_dp_scan(dap, instr, reg_addr, RnW,
-			out_value_buf, (uint8_t *)invalue, ack);
+	retval = arm_jtag_set_instr(jtag_info, instr, NULL, TAP_IDLE);
 	if (retval != ERROR_OK)
 		return retval;
 
-	if (invalue)
-		jtag_add_callback(arm_le_to_h_u32,
-				(jtag_callback_data_t) invalue);
+	struct scan_field_u32 fields[2] = {
+		{
+			.num_bits = 3,
+			.out_value = ((reg_addr >> 1) & 0x6) | (RnW & 0x1),
+			.in_value = ack,
+		},
+		{
+			.num_bits = 32,
+			.out_value = outvalue,
+			.in_value = invalue,
+		},
+	};
 
-	return retval;
-}
+	jtag_add_dr_scan_u32(jtag_info->tap, 2, fields, TAP_IDLE);
 
-/**
- * Utility to write AP registers.
- */
-static inline int adi_jtag_ap_write_check(struct adiv5_dap *dap,
-		uint8_t reg_addr, uint8_t *outvalue)
-{
-	return adi_jtag_dp_scan(dap, JTAG_DP_APACC, reg_addr, DPAP_WRITE,
-			outvalue, NULL, NULL);
+	adi_jtag_dp_scan_delay(dap, instr, reg_addr);
+
+	return ERROR_OK;
 }
 
 static int adi_jtag_scan_inout_check_u32(struct adiv5_dap *dap,
@@ -384,22 +390,23 @@ static int jtag_ap_q_read(struct adiv5_dap *dap, unsigned reg,
 static int jtag_ap_q_write(struct adiv5_dap *dap, unsigned reg,
 		uint32_t data)
 {
-	uint8_t out_value_buf[4];
-
 	int retval = jtag_ap_q_bankselect(dap, reg);
 	if (retval != ERROR_OK)
 		return retval;
 
-	buf_set_u32(out_value_buf, 0, 32, data);
-
-	return adi_jtag_ap_write_check(dap, reg, out_value_buf);
+	return adi_jtag_dp_scan_u32(dap, JTAG_DP_APACC, reg, DPAP_WRITE,
+			data, NULL, NULL);
 }
 
 static int jtag_ap_q_abort(struct adiv5_dap *dap, uint8_t *ack)
 {
+	uint8_t out_value_buf[4];
+
+	buf_set_u32(out_value_buf, 0, 32, 1);
+
 	/* for JTAG, this is the only valid ABORT register operation */
-	return adi_jtag_dp_scan_u32(dap, JTAG_DP_ABORT,
-			0, DPAP_WRITE, 1, NULL, ack);
+	return adi_jtag_dp_scan(dap, JTAG_DP_ABORT,
+			0, DPAP_WRITE, out_value_buf, NULL, ack);
 }
 
 static int jtag_dp_run(struct adiv5_dap *dap)
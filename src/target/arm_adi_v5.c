@@ -88,6 +88,17 @@ static uint32_t max_tar_block_size(uint32_t tar_autoincr_block, uint32_t address
 	return tar_autoincr_block - ((tar_autoincr_block - 1) & address);
 }
 
+/* DRW transfers that mem_ap_read() and mem_ap_write() queue before running
+ * them, so their memory use doesn't grow with the size of the access */
+#define MEM_AP_WINDOW 1024
+
+/* whether the next DRW transfer can be a packed one, moving 4 bytes */
+static bool mem_ap_packed(struct adiv5_dap *dap, bool addrinc, size_t nbytes, uint32_t address)
+{
+	return addrinc && dap->packed_transfers && nbytes >= 4
+			&& max_tar_block_size(dap->tar_autoincr_block, address) >= 4;
+}
+
 /***************************************************************************
  *                                                                         *
  * DP and MEM-AP  register access  through APACC and DPACC                 *
@@ -331,17 +342,17 @@ int mem_ap_write(struct adiv5_dap *dap, const uint8_t *buffer, uint32_t size, ui
 	if (retval != ERROR_OK)
 		return retval;
 
+	unsigned window = 0;
+
 	while (nbytes > 0) {
-		uint32_t this_size = size;
+		bool packed = mem_ap_packed(dap, addrinc, nbytes, address);
+		uint32_t this_size = packed ? 4 : size;
 
 		/* Select packed transfer if possible */
-		if (addrinc && dap->packed_transfers && nbytes >= 4
-				&& max_tar_block_size(dap->tar_autoincr_block, address) >= 4) {
-			this_size = 4;
+		if (packed)
 			retval = dap_setup_accessport_csw(dap, csw_size | CSW_ADDRINC_PACKED);
-		} else {
+		else
 			retval = dap_setup_accessport_csw(dap, csw_size | csw_addrincr);
-		}
 
 		if (retval != ERROR_OK)
 			break;
@@ -389,6 +400,14 @@ int mem_ap_write(struct adiv5_dap *dap, const uint8_t *buffer, uint32_t size, ui
 			if (retval != ERROR_OK)
 				break;
 		}
+
+		/* Don't let the queue grow with the size of the write */
+		if (++window == MEM_AP_WINDOW && nbytes > 0) {
+			window = 0;
+			retval = dap_run(dap);
+			if (retval != ERROR_OK)
+				break;
+		}
 	}
 
 	/* REVISIT: Might want to have a queued version of this function that does not run. */
@@ -407,9 +426,90 @@ int mem_ap_write(struct adiv5_dap *dap, const uint8_t *buffer, uint32_t size, ui
 	return retval;
 }
 
+/* Queues the DRW reads of one window of mem_ap_read(), each storing the
+ * entire DRW word in read_buf, and advances address and nbytes past them */
+static int mem_ap_read_window(struct adiv5_dap *dap, uint32_t *read_buf, uint32_t size,
+		uint32_t csw_size, bool addrinc, uint32_t *address, size_t *nbytes)
+{
+	const uint32_t csw_addrincr = addrinc ? CSW_ADDRINC_SINGLE : CSW_ADDRINC_OFF;
+	int retval;
+
+	retval = dap_setup_accessport_tar(dap, *address);
+	if (retval != ERROR_OK)
+		return retval;
+
+	for (unsigned i = 0; i < MEM_AP_WINDOW && *nbytes > 0; i++) {
+		bool packed = mem_ap_packed(dap, addrinc, *nbytes, *address);
+		uint32_t this_size = packed ? 4 : size;
+
+		/* Select packed transfer if possible */
+		if (packed)
+			retval = dap_setup_accessport_csw(dap, csw_size | CSW_ADDRINC_PACKED);
+		else
+			retval = dap_setup_accessport_csw(dap, csw_size | csw_addrincr);
+		if (retval != ERROR_OK)
+			return retval;
+
+		retval = dap_queue_ap_read(dap, AP_REG_DRW, read_buf++);
+		if (retval != ERROR_OK)
+			return retval;
+
+		*nbytes -= this_size;
+		*address += this_size;
+
+		/* Rewrite TAR if it wrapped */
+		if (addrinc && *address % dap->tar_autoincr_block < size && *nbytes > 0) {
+			retval = dap_setup_accessport_tar(dap, *address);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+	}
+
+	return ERROR_OK;
+}
+
+/* Replays the reads of a window to populate the caller's buffer from the
+ * correct word and byte lane */
+static void mem_ap_read_unpack(struct adiv5_dap *dap, uint8_t *buffer, const uint32_t *read_ptr,
+		uint32_t size, bool addrinc, uint32_t address, size_t nbytes)
+{
+	while (nbytes > 0) {
+		uint32_t this_size = mem_ap_packed(dap, addrinc, nbytes, address) ? 4 : size;
+
+		if (dap->ti_be_32_quirks) {
+			switch (this_size) {
+			case 4:
+				*buffer++ = *read_ptr >> 8 * (3 - (address++ & 3));
+				*buffer++ = *read_ptr >> 8 * (3 - (address++ & 3));
+			case 2:
+				*buffer++ = *read_ptr >> 8 * (3 - (address++ & 3));
+			case 1:
+				*buffer++ = *read_ptr >> 8 * (3 - (address++ & 3));
+			}
+		} else {
+			switch (this_size) {
+			case 4:
+				*buffer++ = *read_ptr >> 8 * (address++ & 3);
+				*buffer++ = *read_ptr >> 8 * (address++ & 3);
+			case 2:
+				*buffer++ = *read_ptr >> 8 * (address++ & 3);
+			case 1:
+				*buffer++ = *read_ptr >> 8 * (address++ & 3);
+			}
+		}
+
+		read_ptr++;
+		nbytes -= this_size;
+	}
+}
+
 /**
  * Synchronous read of a block of memory, using a specific access size.
  *
+ * The reads are queued in windows of MEM_AP_WINDOW transfers; each window
+ * is queued before the previous one is unpacked into @a buffer, so adapters
+ * that run their queue as it fills can already work on it.
+ *
  * @param dap The DAP connected to the MEM-AP.
  * @param buffer The data buffer to receive the data. No particular alignment is assumed.
  * @param size Which access size to use, in bytes. 1, 2 or 4.
@@ -423,10 +523,9 @@ int mem_ap_read(struct adiv5_dap *dap, uint8_t *buffer, uint32_t size, uint32_t
 		uint32_t adr, bool addrinc)
 {
 	size_t nbytes = size * count;
-	const uint32_t csw_addrincr = addrinc ? CSW_ADDRINC_SINGLE : CSW_ADDRINC_OFF;
 	uint32_t csw_size;
 	uint32_t address = adr;
-	int retval;
+	int retval = ERROR_OK;
 
 	/* TI BE-32 Quirks mode:
 	 * Reads on big-endian TMS570 behave strangely differently than writes.
@@ -447,113 +546,228 @@ int mem_ap_read(struct adiv5_dap *dap, uint8_t *buffer, uint32_t size, uint32_t
 	if (dap->unaligned_access_bad && (adr % size != 0))
 		return ERROR_TARGET_UNALIGNED_ACCESS;
 
-	/* Allocate buffer to hold the sequence of DRW reads that will be made. This is a significant
-	 * over-allocation if packed transfers are going to be used, but determining the real need at
-	 * this point would be messy. */
-	uint32_t *read_buf = malloc(count * sizeof(uint32_t));
-	uint32_t *read_ptr = read_buf;
+	/* Two windows of DRW words: one being read, one being unpacked */
+	uint32_t *read_buf = malloc(2 * MEM_AP_WINDOW * sizeof(uint32_t));
 	if (read_buf == NULL) {
 		LOG_ERROR("Failed to allocate read buffer");
 		return ERROR_FAIL;
 	}
 
-	retval = dap_setup_accessport_tar(dap, address);
-	if (retval != ERROR_OK) {
-		free(read_buf);
-		return retval;
-	}
+	/* the window whose reads are queued, and the one read before it */
+	uint32_t *cur_buf = read_buf, *prev_buf = read_buf + MEM_AP_WINDOW;
+	uint32_t cur_address = address, prev_address = address;
+	size_t cur_nbytes = 0, prev_nbytes = 0;
 
-	/* Queue up all reads. Each read will store the entire DRW word in the read buffer. How many
-	 * useful bytes it contains, and their location in the word, depends on the type of transfer
-	 * and alignment. */
 	while (nbytes > 0) {
-		uint32_t this_size = size;
-
-		/* Select packed transfer if possible */
-		if (addrinc && dap->packed_transfers && nbytes >= 4
-				&& max_tar_block_size(dap->tar_autoincr_block, address) >= 4) {
-			this_size = 4;
-			retval = dap_setup_accessport_csw(dap, csw_size | CSW_ADDRINC_PACKED);
-		} else {
-			retval = dap_setup_accessport_csw(dap, csw_size | csw_addrincr);
-		}
-		if (retval != ERROR_OK)
-			break;
-
-		retval = dap_queue_ap_read(dap, AP_REG_DRW, read_ptr++);
+		cur_address = address;
+		cur_nbytes = nbytes;
+		retval = mem_ap_read_window(dap, cur_buf, size, csw_size, addrinc, &address, &nbytes);
+		cur_nbytes -= nbytes;
+
+		/* the previous window is complete, unpack it while this one
+		 * is on its way */
+		mem_ap_read_unpack(dap, buffer, prev_buf, size, addrinc, prev_address, prev_nbytes);
+		buffer += prev_nbytes;
+		prev_nbytes = 0;
+
+		if (retval == ERROR_OK)
+			retval = dap_run(dap);
 		if (retval != ERROR_OK)
 			break;
 
-		nbytes -= this_size;
-		address += this_size;
-
-		/* Rewrite TAR if it wrapped */
-		if (addrinc && address % dap->tar_autoincr_block < size && nbytes > 0) {
-			retval = dap_setup_accessport_tar(dap, address);
-			if (retval != ERROR_OK)
-				break;
-		}
+		prev_address = cur_address;
+		prev_nbytes = cur_nbytes;
+		uint32_t *tmp = prev_buf;
+		prev_buf = cur_buf;
+		cur_buf = tmp;
+		cur_nbytes = 0;
 	}
 
-	if (retval == ERROR_OK)
-		retval = dap_run(dap);
-
-	/* Restore state */
-	address = adr;
-	nbytes = size * count;
-	read_ptr = read_buf;
-
-	/* If something failed, read TAR to find out how much data was successfully read, so we can
-	 * at least give the caller what we have. */
+	/* If something failed, read TAR to find out how much data of the last
+	 * window was successfully read, so we can at least give the caller
+	 * what we have. */
 	if (retval != ERROR_OK) {
 		uint32_t tar;
 		if (dap_queue_ap_read(dap, AP_REG_TAR, &tar) == ERROR_OK
 				&& dap_run(dap) == ERROR_OK) {
 			LOG_ERROR("Failed to read memory at 0x%08"PRIx32, tar);
-			if (nbytes > tar - address)
-				nbytes = tar - address;
+			if (cur_nbytes > tar - cur_address)
+				cur_nbytes = tar - cur_address;
 		} else {
 			LOG_ERROR("Failed to read memory and, additionally, failed to find out where");
-			nbytes = 0;
+			cur_nbytes = 0;
 		}
+		mem_ap_read_unpack(dap, buffer, cur_buf, size, addrinc, cur_address, cur_nbytes);
+	} else {
+		mem_ap_read_unpack(dap, buffer, prev_buf, size, addrinc, prev_address, prev_nbytes);
 	}
 
-	/* Replay loop to populate caller's buffer from the correct word and byte lane */
-	while (nbytes > 0) {
-		uint32_t this_size = size;
+	free(read_buf);
+	return retval;
+}
+
+/* a read of mem_ap_read_scatter(), in planning order */
+struct mem_ap_scatter_read {
+	uint32_t address;
+	uint32_t size;
+	/* index into the caller's list */
+	unsigned index;
+	/* the DRW/BDx word it is taken from */
+	uint32_t *word;
+};
+
+static int mem_ap_scatter_compare(const void *a, const void *b)
+{
+	const struct mem_ap_scatter_read *ra = a, *rb = b;
 
-		if (addrinc && dap->packed_transfers && nbytes >= 4
-				&& max_tar_block_size(dap->tar_autoincr_block, address) >= 4) {
-			this_size = 4;
+	if (ra->address != rb->address)
+		return ra->address < rb->address ? -1 : 1;
+	if (ra->size != rb->size)
+		return ra->size < rb->size ? -1 : 1;
+	return ra->index < rb->index ? -1 : (ra->index > rb->index);
+}
+
+/**
+ * Synchronous read of scattered memory locations, such as the registers
+ * of a debug component or the saved contexts of RTOS threads.
+ *
+ * The reads are sorted by address and planned to need as few CSW and TAR
+ * writes as possible: contiguous reads of one size go through DRW with
+ * TAR auto-increment, other word reads within the 16 byte bank TAR points
+ * to go through BD0-BD3, and each location is read only once.  TAR is
+ * tracked across auto-increments and only rewritten where that can't
+ * reach the next address, e.g. at tar_autoincr_block boundaries.
+ *
+ * The order of the reads on the bus is not the order of @a reads, so this
+ * isn't meant for registers whose reads have side effects.
+ *
+ * @param dap The DAP connected to the MEM-AP.
+ * @param reads What to read; each value is stored zero extended.
+ * @param count Number of entries in @a reads.
+ * @return ERROR_OK on success, otherwise an error code.
+ */
+int mem_ap_read_scatter(struct adiv5_dap *dap, const struct mem_ap_scatter *reads, unsigned count)
+{
+	int retval = ERROR_OK;
+
+	for (unsigned i = 0; i < count; i++) {
+		uint32_t size = reads[i].size;
+		if (size != 1 && size != 2 && size != 4)
+			return ERROR_TARGET_UNALIGNED_ACCESS;
+		if (reads[i].address % size != 0)
+			return ERROR_TARGET_UNALIGNED_ACCESS;
+	}
+
+	/* the byte lanes of BE-32 quirks mode are left to mem_ap_read() */
+	if (dap->ti_be_32_quirks) {
+		for (unsigned i = 0; i < count && retval == ERROR_OK; i++) {
+			uint8_t buf[4];
+			retval = mem_ap_read(dap, buf, reads[i].size, 1, reads[i].address, true);
+			if (retval != ERROR_OK)
+				break;
+			*reads[i].value = reads[i].size == 4 ? le_to_h_u32(buf)
+				: reads[i].size == 2 ? le_to_h_u16(buf) : buf[0];
 		}
+		return retval;
+	}
 
-		if (dap->ti_be_32_quirks) {
-			switch (this_size) {
-			case 4:
-				*buffer++ = *read_ptr >> 8 * (3 - (address++ & 3));
-				*buffer++ = *read_ptr >> 8 * (3 - (address++ & 3));
-			case 2:
-				*buffer++ = *read_ptr >> 8 * (3 - (address++ & 3));
-			case 1:
-				*buffer++ = *read_ptr >> 8 * (3 - (address++ & 3));
+	struct mem_ap_scatter_read *plan = malloc(count * sizeof(*plan));
+	uint32_t *words = malloc(count * sizeof(*words));
+	if (count && (!plan || !words)) {
+		LOG_ERROR("Failed to allocate read plan");
+		free(plan);
+		free(words);
+		return ERROR_FAIL;
+	}
+
+	for (unsigned i = 0; i < count; i++) {
+		plan[i].address = reads[i].address;
+		plan[i].size = reads[i].size;
+		plan[i].index = i;
+	}
+	qsort(plan, count, sizeof(*plan), mem_ap_scatter_compare);
+
+	/* TAR is only known while it can't have been incremented behind
+	 * our back */
+	bool tar_known = !(dap->ap_csw_value & CSW_ADDRINC_MASK);
+	uint32_t tar = dap->ap_tar_value;
+	unsigned num_words = 0;
+
+	for (unsigned i = 0; i < count; i++) {
+		struct mem_ap_scatter_read *r = &plan[i];
+
+		/* the same location again */
+		if (i > 0 && r->address == plan[i - 1].address && r->size == plan[i - 1].size) {
+			r->word = plan[i - 1].word;
+			continue;
+		}
+
+		uint32_t csw_size = r->size == 4 ? CSW_32BIT : r->size == 2 ? CSW_16BIT : CSW_8BIT;
+		retval = dap_setup_accessport_csw(dap, csw_size | CSW_ADDRINC_SINGLE);
+		if (retval != ERROR_OK)
+			break;
+
+		/* a contiguous run continues where TAR stopped; other reads
+		 * through DRW need TAR set */
+		bool next_contiguous = i + 1 < count && plan[i + 1].size == r->size
+			&& plan[i + 1].address == r->address + r->size;
+		bool in_bank = tar_known && (tar & ~0xfu) == (r->address & ~0xfu);
+		unsigned reg;
+
+		if (tar_known && tar == r->address && (next_contiguous || r->size != 4)) {
+			reg = AP_REG_DRW;
+		} else if (r->size == 4 && !next_contiguous) {
+			/* word reads within a bank don't need TAR to move */
+			if (!in_bank) {
+				tar = r->address & ~0xfu;
+				retval = dap_queue_ap_write(dap, AP_REG_TAR, tar);
+				if (retval != ERROR_OK)
+					break;
+				tar_known = true;
 			}
+			reg = AP_REG_BD0 + (r->address & 0xc);
 		} else {
-			switch (this_size) {
-			case 4:
-				*buffer++ = *read_ptr >> 8 * (address++ & 3);
-				*buffer++ = *read_ptr >> 8 * (address++ & 3);
-			case 2:
-				*buffer++ = *read_ptr >> 8 * (address++ & 3);
-			case 1:
-				*buffer++ = *read_ptr >> 8 * (address++ & 3);
-			}
+			tar = r->address;
+			retval = dap_queue_ap_write(dap, AP_REG_TAR, tar);
+			if (retval != ERROR_OK)
+				break;
+			tar_known = true;
+			reg = AP_REG_DRW;
 		}
 
-		read_ptr++;
-		nbytes -= this_size;
+		r->word = &words[num_words++];
+		retval = dap_queue_ap_read(dap, reg, r->word);
+		if (retval != ERROR_OK)
+			break;
+
+		if (reg == AP_REG_DRW) {
+			/* what happens past the auto-increment block is
+			 * implementation defined */
+			if (tar % dap->tar_autoincr_block + r->size >= dap->tar_autoincr_block)
+				tar_known = false;
+			tar += r->size;
+		}
 	}
 
-	free(read_buf);
+	dap->ap_tar_value = tar_known ? tar : (uint32_t)-1;
+
+	if (retval == ERROR_OK)
+		retval = dap_run(dap);
+
+	if (retval == ERROR_OK) {
+		for (unsigned i = 0; i < count; i++) {
+			const struct mem_ap_scatter_read *r = &plan[i];
+			uint32_t value = *r->word >> 8 * (r->address & 3);
+
+			if (r->size < 4)
+				value &= (1u << 8 * r->size) - 1;
+			*reads[r->index].value = value;
+		}
+	} else
+		LOG_ERROR("Failed to read scattered memory");
+
+	free(plan);
+	free(words);
 	return retval;
 }
 
@@ -602,6 +816,13 @@ int mem_ap_sel_write_buf(struct adiv5_dap *swjdp, uint8_t ap,
 	return mem_ap_write(swjdp, buffer, size, count, address, true);
 }
 
+int mem_ap_sel_read_scatter(struct adiv5_dap *swjdp, uint8_t ap,
+		const struct mem_ap_scatter *reads, unsigned count)
+{
+	dap_ap_select(swjdp, ap);
+	return mem_ap_read_scatter(swjdp, reads, count);
+}
+
 int mem_ap_sel_read_buf_noincr(struct adiv5_dap *swjdp, uint8_t ap,
 		uint8_t *buffer, uint32_t size, uint32_t count, uint32_t address)
 {
@@ -644,6 +865,7 @@ int ahbap_debugport_init(struct adiv5_dap *dap)
 {
 	/* check that we support packed transfers */
 	uint32_t csw, cfg;
+	uint32_t ctrl_stat = 0;
 	int retval;
 
 	LOG_DEBUG(" ");
@@ -670,7 +892,7 @@ int ahbap_debugport_init(struct adiv5_dap *dap)
 
 		dap->dp_bank_value = 0;
 
-		retval = dap_queue_dp_read(dap, DP_CTRL_STAT, NULL);
+		retval = dap_queue_dp_read(dap, DP_CTRL_STAT, &ctrl_stat);
 		if (retval != ERROR_OK)
 			continue;
 
@@ -736,6 +958,10 @@ int ahbap_debugport_init(struct adiv5_dap *dap)
 	if (retval != ERROR_OK)
 		return retval;
 
+	/* components may have changed while debug power was off */
+	if ((ctrl_stat & (CDBGPWRUPACK | CSYSPWRUPACK)) != (CDBGPWRUPACK | CSYSPWRUPACK))
+		dap_rom_flush(dap);
+
 	if (csw & CSW_ADDRINC_PACKED)
 		dap->packed_transfers = true;
 	else
@@ -834,6 +1060,307 @@ int dap_find_ap(struct adiv5_dap *dap, enum ap_type type_to_find, uint8_t *ap_nu
 	return ERROR_FAIL;
 }
 
+/* the ID registers in the last 4 KB page of a component: DEVTYPE,
+ * PIDR4, PIDR0-3 and CIDR0-3 */
+static const uint16_t dap_id_regs[] = {
+	0xfcc, 0xfd0, 0xfe0, 0xfe4, 0xfe8, 0xfec, 0xff0, 0xff4, 0xff8, 0xffc
+};
+
+/* ROM table entries read per run */
+#define ROM_TABLE_CHUNK 16
+
+/* ROM table entries live below the ID registers */
+#define ROM_TABLE_END 0xf00
+
+/* deepest ROM table nesting walked */
+#define ROM_TABLE_MAX_DEPTH 16
+
+struct adiv5_rom_table;
+
+/* a ROM table entry, and what the ID registers of the component it
+ * points to say */
+struct adiv5_component {
+	uint32_t romentry;
+	/* base of the last 4 KB page of the component */
+	uint32_t base;
+	/* false if the component didn't answer */
+	bool readable;
+	uint64_t pid;
+	uint32_t cid;
+	uint8_t devtype;
+	/* the entries if the component is a ROM table itself */
+	struct adiv5_rom_table *table;
+};
+
+struct adiv5_rom_table {
+	/* up to and including the terminating zero entry */
+	struct adiv5_component *entries;
+	unsigned num_entries;
+};
+
+/* the CoreSight topology behind one AP */
+struct adiv5_rom {
+	int ap;
+	uint32_t apid;
+	uint32_t dbgbase;
+	/* the ROM table at dbgbase, with its ID registers; no table if
+	 * root.table is NULL */
+	struct adiv5_component root;
+	/* components that didn't answer, e.g. powered down cores */
+	unsigned num_unreadable;
+};
+
+static void dap_rom_table_free(struct adiv5_rom_table *table)
+{
+	if (!table)
+		return;
+
+	for (unsigned i = 0; i < table->num_entries; i++)
+		dap_rom_table_free(table->entries[i].table);
+	free(table->entries);
+	free(table);
+}
+
+static void dap_rom_free(struct adiv5_rom *rom)
+{
+	if (!rom)
+		return;
+
+	dap_rom_table_free(rom->root.table);
+	free(rom);
+}
+
+/**
+ * Forget the ROM table topology read from all APs of a DAP, e.g. once
+ * its debug power domain was found off.
+ */
+void dap_rom_flush(struct adiv5_dap *dap)
+{
+	for (unsigned ap = 0; ap < ARRAY_SIZE(dap->rom); ap++) {
+		dap_rom_free(dap->rom[ap]);
+		dap->rom[ap] = NULL;
+	}
+}
+
+/* reads the ID registers of @a count components in a single run */
+static int dap_read_component_ids(struct adiv5_dap *dap,
+		struct adiv5_component **components, unsigned count)
+{
+	const unsigned n = ARRAY_SIZE(dap_id_regs);
+	struct mem_ap_scatter *reads = malloc(count * n * sizeof(*reads));
+	uint32_t *values = malloc(count * n * sizeof(*values));
+	int retval;
+
+	if (!reads || !values) {
+		LOG_ERROR("Failed to allocate ID register reads");
+		free(reads);
+		free(values);
+		return ERROR_FAIL;
+	}
+
+	for (unsigned c = 0; c < count; c++) {
+		for (unsigned r = 0; r < n; r++) {
+			reads[c * n + r].address = components[c]->base | dap_id_regs[r];
+			reads[c * n + r].size = 4;
+			reads[c * n + r].value = &values[c * n + r];
+		}
+	}
+
+	retval = mem_ap_read_scatter(dap, reads, count * n);
+	if (retval == ERROR_OK) {
+		for (unsigned c = 0; c < count; c++) {
+			struct adiv5_component *comp = components[c];
+			const uint32_t *v = &values[c * n];
+
+			comp->readable = true;
+			comp->devtype = v[0] & 0xff;
+			comp->pid = (uint64_t)(v[1] & 0xff) << 32 | (v[5] & 0xff) << 24
+				| (v[4] & 0xff) << 16 | (v[3] & 0xff) << 8 | (v[2] & 0xff);
+			comp->cid = (v[9] & 0xff) << 24 | (v[8] & 0xff) << 16
+				| (v[7] & 0xff) << 8 | (v[6] & 0xff);
+		}
+	}
+
+	free(reads);
+	free(values);
+	return retval;
+}
+
+/* reads the entries of the ROM table at parent->base and the ID registers
+ * of the components they point to, then walks nested ROM tables */
+static int dap_rom_walk(struct adiv5_dap *dap, struct adiv5_rom *rom,
+		struct adiv5_component *parent, unsigned depth)
+{
+	struct adiv5_rom_table *table;
+	struct adiv5_component **present = NULL;
+	unsigned num_present = 0;
+	uint32_t entries[ROM_TABLE_CHUNK];
+	struct mem_ap_scatter reads[ROM_TABLE_CHUNK];
+	bool end = false;
+	int retval = ERROR_OK;
+
+	if (depth > ROM_TABLE_MAX_DEPTH) {
+		LOG_ERROR("ROM tables nested too deep at 0x%8.8" PRIx32, parent->base);
+		return ERROR_FAIL;
+	}
+
+	table = calloc(1, sizeof(*table));
+	if (!table) {
+		LOG_ERROR("Failed to allocate ROM table");
+		return ERROR_FAIL;
+	}
+	parent->table = table;
+
+	/* the entries, a chunk per run up to the terminating zero */
+	for (uint32_t offset = 0; !end && offset < ROM_TABLE_END; ) {
+		unsigned count = MIN(ROM_TABLE_CHUNK, (ROM_TABLE_END - offset) / 4);
+
+		for (unsigned i = 0; i < count; i++) {
+			reads[i].address = parent->base | (offset + 4 * i);
+			reads[i].size = 4;
+			reads[i].value = &entries[i];
+		}
+		retval = mem_ap_read_scatter(dap, reads, count);
+		if (retval != ERROR_OK)
+			return retval;
+
+		struct adiv5_component *grown = realloc(table->entries,
+				(table->num_entries + count) * sizeof(*grown));
+		if (!grown) {
+			LOG_ERROR("Failed to allocate ROM table");
+			return ERROR_FAIL;
+		}
+		table->entries = grown;
+
+		for (unsigned i = 0; i < count && !end; i++) {
+			struct adiv5_component *comp = &table->entries[table->num_entries++];
+
+			memset(comp, 0, sizeof(*comp));
+			comp->romentry = entries[i];
+			if (comp->romentry & 0x1)
+				comp->base = parent->base + (comp->romentry & 0xFFFFF000);
+			end = comp->romentry == 0;
+		}
+		offset += 4 * count;
+	}
+
+	present = malloc(table->num_entries * sizeof(*present));
+	if (table->num_entries && !present) {
+		LOG_ERROR("Failed to allocate ROM table");
+		return ERROR_FAIL;
+	}
+	for (unsigned i = 0; i < table->num_entries; i++) {
+		if (table->entries[i].romentry & 0x1)
+			present[num_present++] = &table->entries[i];
+	}
+
+	/* the ID registers of all components in one run; if some of them
+	 * don't answer, one run each tells which */
+	if (num_present && dap_read_component_ids(dap, present, num_present) != ERROR_OK) {
+		for (unsigned i = 0; i < num_present; i++) {
+			if (dap_read_component_ids(dap, &present[i], 1) != ERROR_OK) {
+				LOG_DEBUG("Can't read component with base address 0x%" PRIx32
+					  ", the corresponding core might be turned off",
+					  present[i]->base);
+				rom->num_unreadable++;
+			}
+		}
+	}
+
+	for (unsigned i = 0; i < num_present && retval == ERROR_OK; i++) {
+		/* ROM Table? */
+		if (present[i]->readable && ((present[i]->cid >> 12) & 0x0f) == 1)
+			retval = dap_rom_walk(dap, rom, present[i], depth + 1);
+	}
+
+	free(present);
+	return retval;
+}
+
+/* reads the BASE and IDR of an AP and walks its ROM tables, starting
+ * from @a dbgbase if it isn't the AP's BASE */
+static int dap_rom_read(struct adiv5_dap *dap, int ap, const uint32_t *dbgbase,
+		struct adiv5_rom **rom_out)
+{
+	struct adiv5_rom *rom;
+	int retval;
+
+	rom = calloc(1, sizeof(*rom));
+	if (!rom) {
+		LOG_ERROR("Failed to allocate ROM table");
+		return ERROR_FAIL;
+	}
+	rom->ap = ap;
+
+	dap_ap_select(dap, ap);
+
+	retval = dap_queue_ap_read(dap, AP_REG_BASE, &rom->dbgbase);
+	if (retval == ERROR_OK)
+		retval = dap_queue_ap_read(dap, AP_REG_IDR, &rom->apid);
+	if (retval == ERROR_OK)
+		retval = dap_run(dap);
+	if (retval != ERROR_OK) {
+		dap_rom_free(rom);
+		return retval;
+	}
+
+	if (dbgbase)
+		rom->dbgbase = *dbgbase;
+
+	/* only a MEM-AP has a ROM table */
+	if ((rom->apid & 0x10000) && (rom->apid & 0x0f) != 0 && rom->dbgbase != 0xFFFFFFFF) {
+		struct adiv5_component *root = &rom->root;
+
+		root->romentry = rom->dbgbase;
+		root->base = rom->dbgbase & 0xFFFFF000;
+
+		/* Now we read ROM table ID registers, ref. ARM IHI 0029B sec  */
+		retval = dap_read_component_ids(dap, &root, 1);
+		if (retval == ERROR_OK)
+			retval = dap_rom_walk(dap, rom, root, 0);
+		if (retval != ERROR_OK) {
+			dap_rom_free(rom);
+			return retval;
+		}
+	}
+
+	*rom_out = rom;
+	return ERROR_OK;
+}
+
+/*
+ * Returns the topology of an AP, read once and kept in the DAP.  Walks
+ * that found components not answering aren't kept, so cores that power
+ * up later get seen; release those with dap_rom_put().
+ */
+static int dap_rom_get(struct adiv5_dap *dap, int ap, struct adiv5_rom **rom)
+{
+	int retval;
+
+	/* AP address is in bits 31:24 of DP_SELECT */
+	if (ap < 0 || ap >= 256)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (dap->rom[ap]) {
+		*rom = dap->rom[ap];
+		return ERROR_OK;
+	}
+
+	retval = dap_rom_read(dap, ap, NULL, rom);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (!(*rom)->num_unreadable)
+		dap->rom[ap] = *rom;
+	return ERROR_OK;
+}
+
+static void dap_rom_put(struct adiv5_dap *dap, struct adiv5_rom *rom)
+{
+	if (rom != dap->rom[rom->ap])
+		dap_rom_free(rom);
+}
+
 int dap_get_debugbase(struct adiv5_dap *dap, int ap,
 			uint32_t *dbgbase, uint32_t *apid)
 {
@@ -844,6 +1371,12 @@ int dap_get_debugbase(struct adiv5_dap *dap, int ap,
 	if (ap >= 256)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
+	if (dap->rom[ap]) {
+		*dbgbase = dap->rom[ap]->dbgbase;
+		*apid = dap->rom[ap]->apid;
+		return ERROR_OK;
+	}
+
 	ap_old = dap->ap_current;
 	dap_ap_select(dap, ap);
 
@@ -862,11 +1395,46 @@ int dap_get_debugbase(struct adiv5_dap *dap, int ap,
 	return ERROR_OK;
 }
 
+static int dap_rom_lookup(const struct adiv5_rom_table *table, uint8_t type,
+		uint32_t *addr, int32_t *idx)
+{
+	int retval;
+
+	for (unsigned i = 0; i < table->num_entries; i++) {
+		const struct adiv5_component *comp = &table->entries[i];
+
+		if (!(comp->romentry & 0x1))
+			continue;
+
+		if (!comp->readable) {
+			LOG_ERROR("Can't read component with base address 0x%" PRIx32
+				  ", the corresponding core might be turned off", comp->base);
+			return ERROR_FAIL;
+		}
+
+		if (comp->table) {
+			retval = dap_rom_lookup(comp->table, type, addr, idx);
+			if (retval != ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
+				return retval;
+		}
+
+		if (comp->devtype == type) {
+			if (!*idx) {
+				*addr = comp->base;
+				return ERROR_OK;
+			} else
+				(*idx)--;
+		}
+	}
+
+	return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+}
+
 int dap_lookup_cs_component(struct adiv5_dap *dap, int ap,
 			uint32_t dbgbase, uint8_t type, uint32_t *addr, int32_t *idx)
 {
+	struct adiv5_rom *rom;
 	uint32_t ap_old;
-	uint32_t romentry, entry_offset = 0, component_base, devtype;
 	int retval;
 
 	if (ap >= 256)
@@ -874,99 +1442,49 @@ int dap_lookup_cs_component(struct adiv5_dap *dap, int ap,
 
 	*addr = 0;
 	ap_old = dap->ap_current;
-	dap_ap_select(dap, ap);
-
-	do {
-		retval = mem_ap_read_atomic_u32(dap, (dbgbase&0xFFFFF000) |
-						entry_offset, &romentry);
-		if (retval != ERROR_OK)
-			return retval;
-
-		component_base = (dbgbase & 0xFFFFF000)
-			+ (romentry & 0xFFFFF000);
 
-		if (romentry & 0x1) {
-			uint32_t c_cid1;
-			retval = mem_ap_read_atomic_u32(dap, component_base | 0xff4, &c_cid1);
-			if (retval != ERROR_OK) {
-				LOG_ERROR("Can't read component with base address 0x%" PRIx32
-					  ", the corresponding core might be turned off", component_base);
-				return retval;
-			}
-			if (((c_cid1 >> 4) & 0x0f) == 1) {
-				retval = dap_lookup_cs_component(dap, ap, component_base,
-							type, addr, idx);
-				if (retval == ERROR_OK)
-					break;
-				if (retval != ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
-					return retval;
-			}
+	retval = dap_rom_get(dap, ap, &rom);
+	if (retval == ERROR_OK && rom->dbgbase != dbgbase) {
+		/* not the AP's own ROM table */
+		dap_rom_put(dap, rom);
+		retval = dap_rom_read(dap, ap, &dbgbase, &rom);
+	}
+	if (retval != ERROR_OK)
+		return retval;
 
-			retval = mem_ap_read_atomic_u32(dap,
-					(component_base & 0xfffff000) | 0xfcc,
-					&devtype);
-			if (retval != ERROR_OK)
-				return retval;
-			if ((devtype & 0xff) == type) {
-				if (!*idx) {
-					*addr = component_base;
-					break;
-				} else
-					(*idx)--;
-			}
-		}
-		entry_offset += 4;
-	} while (romentry > 0);
+	if (rom->root.table)
+		retval = dap_rom_lookup(rom->root.table, type, addr, idx);
+	else
+		retval = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	dap_rom_put(dap, rom);
 
 	dap_ap_select(dap, ap_old);
 
-	if (!*addr)
-		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-
-	return ERROR_OK;
+	return retval;
 }
 
 static int dap_rom_display(struct command_context *cmd_ctx,
-				struct adiv5_dap *dap, int ap, uint32_t dbgbase, int depth)
+				const struct adiv5_component *parent, int depth)
 {
-	int retval;
+	const struct adiv5_rom_table *table = parent->table;
 	uint32_t cid0, cid1, cid2, cid3, memtype, romentry;
 	uint16_t entry_offset;
 	char tabs[7] = "";
 
-	if (depth > 16) {
-		command_print(cmd_ctx, "\tTables too deep");
-		return ERROR_FAIL;
-	}
-
 	if (depth)
 		snprintf(tabs, sizeof(tabs), "[L%02d] ", depth);
 
 	/* bit 16 of apid indicates a memory access port */
-	if (dbgbase & 0x02)
+	if (parent->romentry & 0x02)
 		command_print(cmd_ctx, "\t%sValid ROM table present", tabs);
 	else
 		command_print(cmd_ctx, "\t%sROM table in legacy format", tabs);
 
-	/* Now we read ROM table ID registers, ref. ARM IHI 0029B sec  */
-	retval = mem_ap_read_u32(dap, (dbgbase&0xFFFFF000) | 0xFF0, &cid0);
-	if (retval != ERROR_OK)
-		return retval;
-	retval = mem_ap_read_u32(dap, (dbgbase&0xFFFFF000) | 0xFF4, &cid1);
-	if (retval != ERROR_OK)
-		return retval;
-	retval = mem_ap_read_u32(dap, (dbgbase&0xFFFFF000) | 0xFF8, &cid2);
-	if (retval != ERROR_OK)
-		return retval;
-	retval = mem_ap_read_u32(dap, (dbgbase&0xFFFFF000) | 0xFFC, &cid3);
-	if (retval != ERROR_OK)
-		return retval;
-	retval = mem_ap_read_u32(dap, (dbgbase&0xFFFFF000) | 0xFCC, &memtype);
-	if (retval != ERROR_OK)
-		return retval;
-	retval = dap_run(dap);
-	if (retval != ERROR_OK)
-		return retval;
+	cid0 = parent->cid & 0xff;
+	cid1 = (parent->cid >> 8) & 0xff;
+	cid2 = (parent->cid >> 16) & 0xff;
+	cid3 = (parent->cid >> 24) & 0xff;
+	memtype = parent->devtype;
 
 	if (!is_dap_cid_ok(cid3, cid2, cid1, cid0))
 		command_print(cmd_ctx, "\t%sCID3 0x%02x"
@@ -982,10 +1500,10 @@ static int dap_rom_display(struct command_context *cmd_ctx,
 		command_print(cmd_ctx, "\t%sMEMTYPE system memory not present: dedicated debug bus", tabs);
 
 	/* Now we read ROM table entries from dbgbase&0xFFFFF000) | 0x000 until we get 0x00000000 */
-	for (entry_offset = 0; ; entry_offset += 4) {
-		retval = mem_ap_read_atomic_u32(dap, (dbgbase&0xFFFFF000) | entry_offset, &romentry);
-		if (retval != ERROR_OK)
-			return retval;
+	for (entry_offset = 0; entry_offset / 4 < table->num_entries; entry_offset += 4) {
+		const struct adiv5_component *comp = &table->entries[entry_offset / 4];
+
+		romentry = comp->romentry;
 		command_print(cmd_ctx, "\t%sROMTABLE[0x%x] = 0x%" PRIx32 "",
 				tabs, entry_offset, romentry);
 		if (romentry & 0x01) {
@@ -995,49 +1513,24 @@ static int dap_rom_display(struct command_context *cmd_ctx,
 			uint32_t part_num;
 			const char *type, *full;
 
-			component_base = (dbgbase & 0xFFFFF000) + (romentry & 0xFFFFF000);
+			component_base = comp->base;
 
 			/* IDs are in last 4K section */
-			retval = mem_ap_read_atomic_u32(dap, component_base + 0xFE0, &c_pid0);
-			if (retval != ERROR_OK) {
+			if (!comp->readable) {
 				command_print(cmd_ctx, "\t%s\tCan't read component with base address 0x%" PRIx32
 					      ", the corresponding core might be turned off", tabs, component_base);
 				continue;
 			}
-			c_pid0 &= 0xff;
-			retval = mem_ap_read_atomic_u32(dap, component_base + 0xFE4, &c_pid1);
-			if (retval != ERROR_OK)
-				return retval;
-			c_pid1 &= 0xff;
-			retval = mem_ap_read_atomic_u32(dap, component_base + 0xFE8, &c_pid2);
-			if (retval != ERROR_OK)
-				return retval;
-			c_pid2 &= 0xff;
-			retval = mem_ap_read_atomic_u32(dap, component_base + 0xFEC, &c_pid3);
-			if (retval != ERROR_OK)
-				return retval;
-			c_pid3 &= 0xff;
-			retval = mem_ap_read_atomic_u32(dap, component_base + 0xFD0, &c_pid4);
-			if (retval != ERROR_OK)
-				return retval;
-			c_pid4 &= 0xff;
+			c_pid0 = comp->pid & 0xff;
+			c_pid1 = (comp->pid >> 8) & 0xff;
+			c_pid2 = (comp->pid >> 16) & 0xff;
+			c_pid3 = (comp->pid >> 24) & 0xff;
+			c_pid4 = (comp->pid >> 32) & 0xff;
 
-			retval = mem_ap_read_atomic_u32(dap, component_base + 0xFF0, &c_cid0);
-			if (retval != ERROR_OK)
-				return retval;
-			c_cid0 &= 0xff;
-			retval = mem_ap_read_atomic_u32(dap, component_base + 0xFF4, &c_cid1);
-			if (retval != ERROR_OK)
-				return retval;
-			c_cid1 &= 0xff;
-			retval = mem_ap_read_atomic_u32(dap, component_base + 0xFF8, &c_cid2);
-			if (retval != ERROR_OK)
-				return retval;
-			c_cid2 &= 0xff;
-			retval = mem_ap_read_atomic_u32(dap, component_base + 0xFFC, &c_cid3);
-			if (retval != ERROR_OK)
-				return retval;
-			c_cid3 &= 0xff;
+			c_cid0 = comp->cid & 0xff;
+			c_cid1 = (comp->cid >> 8) & 0xff;
+			c_cid2 = (comp->cid >> 16) & 0xff;
+			c_cid3 = (comp->cid >> 24) & 0xff;
 
 			command_print(cmd_ctx, "\t\tComponent base address 0x%" PRIx32 ", "
 				      "start address 0x%" PRIx32, component_base,
@@ -1050,15 +1543,10 @@ static int dap_rom_display(struct command_context *cmd_ctx,
 
 			/* CoreSight component? */
 			if (((c_cid1 >> 4) & 0x0f) == 9) {
-				uint32_t devtype;
+				uint32_t devtype = comp->devtype;
 				unsigned minor;
 				const char *major = "Reserved", *subtype = "Reserved";
 
-				retval = mem_ap_read_atomic_u32(dap,
-						(component_base & 0xfffff000) | 0xfcc,
-						&devtype);
-				if (retval != ERROR_OK)
-					return retval;
 				minor = (devtype >> 4) & 0x0f;
 				switch (devtype & 0x0f) {
 				case 0:
@@ -1199,7 +1687,7 @@ static int dap_rom_display(struct command_context *cmd_ctx,
 				/* REVISIT also show 0xfc8 DevId */
 			}
 
-			if (!is_dap_cid_ok(cid3, cid2, cid1, cid0))
+			if (!is_dap_cid_ok(c_cid3, c_cid2, c_cid1, c_cid0))
 				command_print(cmd_ctx,
 						"\t\tCID3 0%02x"
 						", CID2 0%02x"
@@ -1379,11 +1867,8 @@ static int dap_rom_display(struct command_context *cmd_ctx,
 					type, full);
 
 			/* ROM Table? */
-			if (((c_cid1 >> 4) & 0x0f) == 1) {
-				retval = dap_rom_display(cmd_ctx, dap, ap, component_base, depth + 1);
-				if (retval != ERROR_OK)
-					return retval;
-			}
+			if (comp->table)
+				dap_rom_display(cmd_ctx, comp, depth + 1);
 		} else {
 			if (romentry)
 				command_print(cmd_ctx, "\t\tComponent not present");
@@ -1399,17 +1884,20 @@ static int dap_info_command(struct command_context *cmd_ctx,
 		struct adiv5_dap *dap, int ap)
 {
 	int retval;
+	struct adiv5_rom *rom;
 	uint32_t dbgbase, apid;
-	int romtable_present = 0;
 	uint8_t mem_ap;
 	uint32_t ap_old;
 
-	retval = dap_get_debugbase(dap, ap, &dbgbase, &apid);
+	ap_old = dap->ap_current;
+
+	retval = dap_rom_get(dap, ap, &rom);
+	dap_ap_select(dap, ap_old);
 	if (retval != ERROR_OK)
 		return retval;
 
-	ap_old = dap->ap_current;
-	dap_ap_select(dap, ap);
+	dbgbase = rom->dbgbase;
+	apid = rom->apid;
 
 	/* Now we read ROM table ID registers, ref. ARM IHI 0029B sec  */
 	mem_ap = ((apid&0x10000) && ((apid&0x0F) != 0));
@@ -1438,12 +1926,11 @@ static int dap_info_command(struct command_context *cmd_ctx,
 	} else
 		command_print(cmd_ctx, "No AP found at this ap 0x%x", ap);
 
-	romtable_present = ((mem_ap) && (dbgbase != 0xFFFFFFFF));
-	if (romtable_present)
-		dap_rom_display(cmd_ctx, dap, ap, dbgbase, 0);
+	if (rom->root.table)
+		dap_rom_display(cmd_ctx, &rom->root, 0);
 	else
 		command_print(cmd_ctx, "\tNo ROM table present");
-	dap_ap_select(dap, ap_old);
+	dap_rom_put(dap, rom);
 
 	return ERROR_OK;
 }
@@ -1469,6 +1956,59 @@ COMMAND_HANDLER(handle_dap_info_command)
 	return dap_info_command(CMD_CTX, dap, apsel);
 }
 
+static void dap_components_print(struct command_context *cmd_ctx,
+		const struct adiv5_rom_table *table, unsigned depth)
+{
+	for (unsigned i = 0; i < table->num_entries; i++) {
+		const struct adiv5_component *comp = &table->entries[i];
+
+		if (!(comp->romentry & 0x1) || !comp->readable)
+			continue;
+
+		command_print(cmd_ctx, "%u 0x%8.8" PRIx32 " 0x%10.10" PRIx64
+				" 0x%8.8" PRIx32 " 0x%2.2" PRIx8,
+				depth, comp->base, comp->pid, comp->cid, comp->devtype);
+		if (comp->table)
+			dap_components_print(cmd_ctx, comp->table, depth + 1);
+	}
+}
+
+COMMAND_HANDLER(dap_components_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct arm *arm = target_to_arm(target);
+	struct adiv5_dap *dap = arm->dap;
+	struct adiv5_rom *rom;
+	uint32_t apsel, ap_old;
+	int retval;
+
+	switch (CMD_ARGC) {
+	case 0:
+		apsel = dap->apsel;
+		break;
+	case 1:
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], apsel);
+		/* AP address is in bits 31:24 of DP_SELECT */
+		if (apsel >= 256)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		break;
+	default:
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+
+	ap_old = dap->ap_current;
+	retval = dap_rom_get(dap, apsel, &rom);
+	dap_ap_select(dap, ap_old);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (rom->root.table)
+		dap_components_print(CMD_CTX, rom->root.table, 0);
+	dap_rom_put(dap, rom);
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(dap_baseaddr_command)
 {
 	struct target *target = get_current_target(CMD_CTX);
@@ -1681,6 +2221,16 @@ static const struct command_registration dap_commands[] = {
 			"(default currently selected AP)",
 		.usage = "[ap_num]",
 	},
+	{
+		.name = "components",
+		.handler = dap_components_command,
+		.mode = COMMAND_EXEC,
+		.help = "list the CoreSight components in the ROM tables "
+			"of a MEM-AP, one per line as depth, base address, "
+			"PIDR, CIDR and DEVTYPE "
+			"(default currently selected AP)",
+		.usage = "[ap_num]",
+	},
 	{
 		.name = "apsel",
 		.handler = dap_apsel_command,
@@ -121,6 +121,8 @@
 #define CSW_SPROT           (1UL << 30)
 #define CSW_DBGSWENABLE     (1UL << 31)
 
+struct adiv5_rom;
+
 /**
  * This represents an ARM Debug Interface (v5) Debug Access Port (DAP).
  * A DAP has two types of component:  one Debug Port (DP), which is a
@@ -185,7 +187,7 @@ struct adiv5_dap {
 	uint32_t ap_tar_value;
 
 	/* information about current pending SWjDP-AHBAP transaction */
-	uint8_t  ack;
+	uint32_t ack;
 
 	/**
 	 * Holds the pointer to the destination word for the last queued read,
@@ -219,6 +221,12 @@ struct adiv5_dap {
 	 * should be performed before the next access.
 	 */
 	bool do_reconnect;
+
+	/**
+	 * The ROM table topology of each AP, read on first use and kept
+	 * until the debug power domain is found off.  NULL if not read yet.
+	 */
+	struct adiv5_rom *rom[256];
 };
 
 /**
@@ -449,11 +457,26 @@ int mem_ap_read(struct adiv5_dap *dap, uint8_t *buffer, uint32_t size,
 int mem_ap_write(struct adiv5_dap *dap, const uint8_t *buffer, uint32_t size,
 		uint32_t count, uint32_t address, bool addrinc);
 
+/** One location read by mem_ap_read_scatter(). */
+struct mem_ap_scatter {
+	uint32_t address;
+	/** Access size in bytes: 1, 2 or 4; the address must be aligned to it. */
+	uint32_t size;
+	/** Where the value read is stored, zero extended. */
+	uint32_t *value;
+};
+
+/* Synchronous MEM-AP reads of scattered locations, in as few transactions as possible */
+int mem_ap_read_scatter(struct adiv5_dap *dap, const struct mem_ap_scatter *reads,
+		unsigned count);
+
 /* Synchronous MEM-AP memory mapped bus block transfers with selection of ap */
 int mem_ap_sel_read_buf(struct adiv5_dap *swjdp, uint8_t ap,
 		uint8_t *buffer, uint32_t size, uint32_t count, uint32_t address);
 int mem_ap_sel_write_buf(struct adiv5_dap *swjdp, uint8_t ap,
 		const uint8_t *buffer, uint32_t size, uint32_t count, uint32_t address);
+int mem_ap_sel_read_scatter(struct adiv5_dap *swjdp, uint8_t ap,
+		const struct mem_ap_scatter *reads, unsigned count);
 
 /* Synchronous, non-incrementing buffer functions for accessing fifos, with
  * selection of ap */
@@ -478,6 +501,9 @@ int dap_find_ap(struct adiv5_dap *dap,
 int dap_lookup_cs_component(struct adiv5_dap *dap, int ap,
 			uint32_t dbgbase, uint8_t type, uint32_t *addr, int32_t *idx);
 
+/* Forget the cached ROM table topology of all APs */
+void dap_rom_flush(struct adiv5_dap *dap);
+
 struct target;
 
 /* Put debug link into SWD mode */
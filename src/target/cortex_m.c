@@ -131,6 +131,155 @@ static int cortexm_dap_write_coreregister_u32(struct target *target,
 	return retval;
 }
 
+/* DCRSR register selectors are below this */
+#define DCRSR_REGSEL_MAX 0x60
+
+/* the DCRSR selector of a register of load_core_reg_u32(), -1 if it
+ * isn't read through DCRSR/DCRDR */
+static int cortex_m_dcrsr_regsel(uint32_t num)
+{
+	switch (num) {
+		case 0 ... 18:
+			return num;
+		case ARMV7M_PRIMASK:
+		case ARMV7M_BASEPRI:
+		case ARMV7M_FAULTMASK:
+		case ARMV7M_CONTROL:
+			return 20;
+		case ARMV7M_FPSCR:
+			return 0x21;
+		case ARMV7M_S0 ... ARMV7M_S31:
+			return num - ARMV7M_S0 + 0x40;
+		default:
+			return -1;
+	}
+}
+
+/* Cortex-M3 packages PRIMASK, BASEPRI, FAULTMASK and CONTROL as
+ * bitfields in one Debug Core register.  So say r0 and r2 docs;
+ * it was removed from r1 docs, but still works.
+ */
+static uint32_t cortex_m_special_reg(uint32_t num, uint32_t value)
+{
+	switch (num) {
+		case ARMV7M_PRIMASK:
+			return value & 0x1;
+		case ARMV7M_BASEPRI:
+			return (value >> 8) & 0xff;
+		case ARMV7M_FAULTMASK:
+			return (value >> 16) & 0x1;
+		case ARMV7M_CONTROL:
+			return (value >> 24) & 0x3;
+		default:
+			return value;
+	}
+}
+
+/*
+ * Loads all registers of the cache that aren't valid yet in one DAP run.
+ * DHCSR, DCRSR and DCRDR share a TAR bank, so each register is a DCRSR
+ * write through BD1 and a DCRDR read through BD2 without touching TAR.
+ * There's no S_REGRDY polling between them: the core moves a register
+ * into DCRDR faster than the DAP gets to the next access, which the
+ * S_REGRDY read at the end of the run double checks.
+ *
+ * Registers that can't be read this way are left invalid.
+ */
+static int cortex_m_fast_read_all_regs(struct target *target)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	struct adiv5_dap *swjdp = armv7m->arm.dap;
+	struct reg_cache *cache = armv7m->arm.core_cache;
+	uint32_t values[DCRSR_REGSEL_MAX];
+	bool wanted[DCRSR_REGSEL_MAX] = { false };
+	uint32_t dcrdr, dhcsr;
+	int regsel, retval;
+
+	for (unsigned i = 0; i < cache->num_regs; i++) {
+		struct arm_reg *arm_reg = cache->reg_list[i].arch_info;
+
+		if (cache->reg_list[i].valid)
+			continue;
+
+		if (arm_reg->num >= ARMV7M_D0 && arm_reg->num <= ARMV7M_D15) {
+			/* map D0..D15 to S0..S31 */
+			regsel = cortex_m_dcrsr_regsel(ARMV7M_S0 + 2 * (arm_reg->num - ARMV7M_D0));
+			wanted[regsel] = wanted[regsel + 1] = true;
+		} else {
+			regsel = cortex_m_dcrsr_regsel(arm_reg->num);
+			if (regsel >= 0)
+				wanted[regsel] = true;
+		}
+	}
+
+	retval = dap_setup_accessport(swjdp, CSW_32BIT | CSW_ADDRINC_OFF, DCB_DHCSR);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* because the DCB_DCRDR is used for the emulated dcc channel
+	 * we have to save/restore the DCB_DCRDR when used */
+	if (target->dbg_msg_enabled) {
+		retval = dap_queue_ap_read(swjdp, AP_REG_BD2, &dcrdr);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	for (regsel = 0; regsel < DCRSR_REGSEL_MAX; regsel++) {
+		if (!wanted[regsel])
+			continue;
+		retval = dap_queue_ap_write(swjdp, AP_REG_BD1, regsel);
+		if (retval != ERROR_OK)
+			return retval;
+		retval = dap_queue_ap_read(swjdp, AP_REG_BD2, &values[regsel]);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	retval = dap_queue_ap_read(swjdp, AP_REG_BD0, &dhcsr);
+	if (retval != ERROR_OK)
+		return retval;
+	retval = dap_run(swjdp);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (target->dbg_msg_enabled) {
+		/* restore DCB_DCRDR - this needs to be in a separate
+		 * transaction otherwise the emulated DCC channel breaks */
+		retval = mem_ap_write_atomic_u32(swjdp, DCB_DCRDR, dcrdr);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	if (!(dhcsr & S_REGRDY)) {
+		LOG_DEBUG("DHCSR 0x%08" PRIx32 ", core registers weren't ready", dhcsr);
+		return ERROR_FAIL;
+	}
+
+	for (unsigned i = 0; i < cache->num_regs; i++) {
+		struct reg *r = &cache->reg_list[i];
+		struct arm_reg *arm_reg = r->arch_info;
+
+		if (r->valid)
+			continue;
+
+		if (arm_reg->num >= ARMV7M_D0 && arm_reg->num <= ARMV7M_D15) {
+			regsel = cortex_m_dcrsr_regsel(ARMV7M_S0 + 2 * (arm_reg->num - ARMV7M_D0));
+			buf_set_u32(r->value, 0, 32, values[regsel]);
+			buf_set_u32(r->value + 4, 0, 32, values[regsel + 1]);
+		} else {
+			regsel = cortex_m_dcrsr_regsel(arm_reg->num);
+			if (regsel < 0)
+				continue;
+			buf_set_u32(r->value, 0, 32,
+					cortex_m_special_reg(arm_reg->num, values[regsel]));
+		}
+		r->valid = 1;
+		r->dirty = 0;
+	}
+
+	return ERROR_OK;
+}
+
 static int cortex_m_write_debug_halt_mask(struct target *target,
 	uint32_t mask_on, uint32_t mask_off)
 {
@@ -430,6 +579,11 @@ static int cortex_m_debug_entry(struct target *target)
 	 * First load register accessible through core debug port */
 	int num_regs = arm->core_cache->num_regs;
 
+	/* all in one go, anything left over one by one */
+	retval = cortex_m_fast_read_all_regs(target);
+	if (retval != ERROR_OK)
+		LOG_DEBUG("reading core registers one by one");
+
 	for (i = 0; i < num_regs; i++) {
 		r = &armv7m->arm.core_cache->reg_list[i];
 		if (!r->valid)
@@ -1538,29 +1692,8 @@ static int cortex_m_load_core_reg_u32(struct target *target,
 		case ARMV7M_BASEPRI:
 		case ARMV7M_FAULTMASK:
 		case ARMV7M_CONTROL:
-			/* Cortex-M3 packages these four registers as bitfields
-			 * in one Debug Core register.  So say r0 and r2 docs;
-			 * it was removed from r1 docs, but still works.
-			 */
 			cortexm_dap_read_coreregister_u32(target, value, 20);
-
-			switch (num) {
-				case ARMV7M_PRIMASK:
-					*value = buf_get_u32((uint8_t *)value, 0, 1);
-					break;
-
-				case ARMV7M_BASEPRI:
-					*value = buf_get_u32((uint8_t *)value, 8, 8);
-					break;
-
-				case ARMV7M_FAULTMASK:
-					*value = buf_get_u32((uint8_t *)value, 16, 1);
-					break;
-
-				case ARMV7M_CONTROL:
-					*value = buf_get_u32((uint8_t *)value, 24, 2);
-					break;
-			}
+			*value = cortex_m_special_reg(num, *value);
 
 			LOG_DEBUG("load from special reg %i value 0x%" PRIx32 "", (int)num, *value);
 			break;
@@ -1945,6 +2078,7 @@ int cortex_m_examine(struct target *target)
 				free(armv7m->arm.core_cache->reg_list[idx].reg_data_type);
 			}
 			armv7m->arm.core_cache->num_regs = ARMV7M_NUM_CORE_REGS_NOFP;
+			register_cache_changed();
 		}
 
 		if (i == 4 || i == 3) {
@@ -2006,6 +2140,94 @@ int cortex_m_examine(struct target *target)
 	return ERROR_OK;
 }
 
+/* DWT_PCSR reads per DAP run while profiling */
+#define PCSR_BATCH 256
+
+/*
+ * Reads PCSR_BATCH samples of DWT_PCSR in one DAP run, without address
+ * increment.  PCSR reads as all ones while the core is halted and as zero
+ * if it isn't implemented; those samples are dropped.
+ */
+static int cortex_m_read_pcsr(struct target *target, struct target_profile *prof)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	struct adiv5_dap *swjdp = armv7m->arm.dap;
+	uint32_t *samples;
+	int retval;
+
+	samples = target_profile_reserve(prof, PCSR_BATCH);
+	if (samples == NULL) {
+		LOG_ERROR("No memory to store samples.");
+		return ERROR_FAIL;
+	}
+
+	retval = mem_ap_read(swjdp, (uint8_t *)samples, 4, PCSR_BATCH, DWT_PCSR, false);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("Error while reading PCSR");
+		return retval;
+	}
+
+	for (unsigned i = 0; i < PCSR_BATCH; i++) {
+		uint32_t pc = target_buffer_get_u32(target, (uint8_t *)&samples[i]);
+		if (pc != 0xffffffff && pc != 0)
+			prof->samples[prof->num_samples++] = pc;
+	}
+
+	return ERROR_OK;
+}
+
+/* Samples the PC through DWT_PCSR while the core keeps running. */
+static int cortex_m_profiling(struct target *target, struct target_profile *prof,
+		uint32_t seconds)
+{
+	struct timeval timeout, now;
+	uint32_t reg_value;
+	int retval;
+
+	/* PCSR is optional on ARMv6-M and reads as zero if missing */
+	retval = target_read_u32(target, DWT_PCSR, &reg_value);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("Error while reading PCSR");
+		return retval;
+	}
+	if (reg_value == 0) {
+		LOG_INFO("PCSR sampling not supported on this processor.");
+		return target_profiling_default(target, prof, seconds);
+	}
+
+	gettimeofday(&timeout, NULL);
+	timeval_add_time(&timeout, seconds, 0);
+
+	LOG_INFO("Starting Cortex-M profiling. Sampling DWT_PCSR as fast as we can...");
+
+	/* Make sure the target is running */
+	target_poll(target);
+	if (target->state == TARGET_HALTED)
+		retval = target_resume(target, 1, 0, 0, 0);
+
+	if (retval != ERROR_OK) {
+		LOG_ERROR("Error while resuming target");
+		return retval;
+	}
+
+	for (;;) {
+		retval = cortex_m_read_pcsr(target, prof);
+		if (retval != ERROR_OK)
+			return retval;
+
+		keep_alive();
+
+		gettimeofday(&now, NULL);
+		if (now.tv_sec > timeout.tv_sec ||
+			(now.tv_sec == timeout.tv_sec && now.tv_usec >= timeout.tv_usec)) {
+			LOG_INFO("Profiling completed. %" PRIu32 " samples.", prof->num_samples);
+			break;
+		}
+	}
+
+	return ERROR_OK;
+}
+
 static int cortex_m_dcc_read(struct target *target, uint8_t *value, uint8_t *ctrl)
 {
 	struct armv7m_common *armv7m = target_to_armv7m(target);
@@ -2408,4 +2630,7 @@ struct target_type cortexm_target = {
 	.init_target = cortex_m_init_target,
 	.examine = cortex_m_examine,
 	.deinit_target = cortex_m_deinit_target,
+
+	.profiling = cortex_m_profiling,
+	.profile_batch = cortex_m_read_pcsr,
 };
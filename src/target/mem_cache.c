@@ -0,0 +1,360 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.           *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/log.h>
+
+#include "target.h"
+#include "mem_cache.h"
+
+/*
+ * A direct mapped cache of target memory lines.  Nothing is cached
+ * unless it lies in a region the user declared cacheable with
+ * 'mem_cache add', so peripheral registers are always read from the
+ * target.  The cache only serves a halted target; target.c flushes it
+ * whenever the target runs, steps or is reset, and drops the lines of
+ * everything written through target_write_*().
+ */
+
+#define MEM_CACHE_LINE_SIZE	64
+#define MEM_CACHE_NUM_LINES	256
+
+struct mem_cache_region {
+	uint32_t start;
+	uint32_t size;
+	struct mem_cache_region *next;
+};
+
+struct mem_cache_line {
+	bool valid;
+	uint32_t address;
+	uint8_t data[MEM_CACHE_LINE_SIZE];
+};
+
+struct mem_cache {
+	struct mem_cache_region *regions;
+	struct mem_cache_line *lines;
+
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t fills;
+	uint64_t bypassed;
+	uint64_t flushes;
+};
+
+static struct mem_cache_line *mem_cache_line(struct mem_cache *cache, uint32_t address)
+{
+	return &cache->lines[(address / MEM_CACHE_LINE_SIZE) % MEM_CACHE_NUM_LINES];
+}
+
+static bool mem_cache_cacheable(struct mem_cache *cache, uint32_t address, uint32_t size)
+{
+	for (struct mem_cache_region *r = cache->regions; r; r = r->next) {
+		if (address >= r->start && address - r->start + (uint64_t)size <= r->size)
+			return true;
+	}
+	return false;
+}
+
+/* fills the missing lines from first to last, each run of them with a
+ * single read */
+static int mem_cache_fill(struct target *target, struct mem_cache *cache,
+		uint32_t first, uint32_t last)
+{
+	uint8_t *buffer = NULL;
+	int retval = ERROR_OK;
+
+	for (uint32_t address = first; address <= last && retval == ERROR_OK; ) {
+		struct mem_cache_line *line = mem_cache_line(cache, address);
+
+		if (line->valid && line->address == address) {
+			cache->hits++;
+			if (address == last)
+				break;
+			address += MEM_CACHE_LINE_SIZE;
+			continue;
+		}
+
+		uint32_t end = address;
+		while (end < last) {
+			line = mem_cache_line(cache, end + MEM_CACHE_LINE_SIZE);
+			if (line->valid && line->address == end + MEM_CACHE_LINE_SIZE)
+				break;
+			end += MEM_CACHE_LINE_SIZE;
+		}
+
+		uint32_t count = (end - address) / MEM_CACHE_LINE_SIZE + 1;
+		if (buffer == NULL) {
+			buffer = malloc((last - first) + MEM_CACHE_LINE_SIZE);
+			if (buffer == NULL)
+				return ERROR_FAIL;
+		}
+
+		retval = target_read_memory(target, address, 4,
+				count * MEM_CACHE_LINE_SIZE / 4, buffer);
+		if (retval != ERROR_OK)
+			break;
+
+		cache->fills++;
+		cache->misses += count;
+		for (uint32_t i = 0; i < count; i++) {
+			line = mem_cache_line(cache, address);
+			line->valid = true;
+			line->address = address;
+			memcpy(line->data, buffer + i * MEM_CACHE_LINE_SIZE, MEM_CACHE_LINE_SIZE);
+			address += MEM_CACHE_LINE_SIZE;
+		}
+		if (end == last)
+			break;
+	}
+
+	free(buffer);
+	return retval;
+}
+
+int mem_cache_read(struct target *target, uint32_t address,
+		uint32_t size, uint8_t *buffer)
+{
+	struct mem_cache *cache = target->mem_cache;
+
+	if (cache == NULL || cache->regions == NULL || size == 0)
+		return target_read_buffer(target, address, size, buffer);
+
+	uint32_t first = address & ~(MEM_CACHE_LINE_SIZE - 1);
+	uint64_t end = ((uint64_t)address + size + MEM_CACHE_LINE_SIZE - 1)
+			& ~(uint64_t)(MEM_CACHE_LINE_SIZE - 1);
+
+	/* reads bigger than the cache would only evict themselves */
+	if (target->state != TARGET_HALTED
+			|| end - first > MEM_CACHE_LINE_SIZE * MEM_CACHE_NUM_LINES
+			|| end > UINT32_MAX
+			|| !mem_cache_cacheable(cache, first, end - first)) {
+		cache->bypassed++;
+		return target_read_buffer(target, address, size, buffer);
+	}
+
+	if (cache->lines == NULL) {
+		cache->lines = calloc(MEM_CACHE_NUM_LINES, sizeof(*cache->lines));
+		if (cache->lines == NULL)
+			return target_read_buffer(target, address, size, buffer);
+	}
+
+	uint32_t last = end - MEM_CACHE_LINE_SIZE;
+	if (mem_cache_fill(target, cache, first, last) != ERROR_OK) {
+		/* let an uncached read report exactly what failed */
+		cache->bypassed++;
+		return target_read_buffer(target, address, size, buffer);
+	}
+
+	while (size > 0) {
+		struct mem_cache_line *line = mem_cache_line(cache, address);
+		uint32_t offset = address - line->address;
+		uint32_t n = MIN(size, MEM_CACHE_LINE_SIZE - offset);
+
+		memcpy(buffer, line->data + offset, n);
+		address += n;
+		buffer += n;
+		size -= n;
+	}
+
+	return ERROR_OK;
+}
+
+void mem_cache_invalidate(struct target *target, uint32_t address, uint32_t size)
+{
+	struct mem_cache *cache = target->mem_cache;
+
+	if (cache == NULL || cache->lines == NULL || size == 0)
+		return;
+
+	if (size > MEM_CACHE_LINE_SIZE * (MEM_CACHE_NUM_LINES - 1)) {
+		mem_cache_flush(target);
+		return;
+	}
+
+	uint32_t first = address & ~(MEM_CACHE_LINE_SIZE - 1);
+	uint32_t count = (address - first + size - 1) / MEM_CACHE_LINE_SIZE + 1;
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t line_address = first + i * MEM_CACHE_LINE_SIZE;
+		struct mem_cache_line *line = mem_cache_line(cache, line_address);
+		if (line->address == line_address)
+			line->valid = false;
+	}
+}
+
+void mem_cache_flush(struct target *target)
+{
+	struct mem_cache *cache = target->mem_cache;
+
+	if (cache == NULL || cache->lines == NULL)
+		return;
+
+	for (unsigned i = 0; i < MEM_CACHE_NUM_LINES; i++)
+		cache->lines[i].valid = false;
+	cache->flushes++;
+}
+
+void mem_cache_free(struct target *target)
+{
+	struct mem_cache *cache = target->mem_cache;
+
+	if (cache == NULL)
+		return;
+
+	struct mem_cache_region *r = cache->regions;
+	while (r) {
+		struct mem_cache_region *next = r->next;
+		free(r);
+		r = next;
+	}
+	free(cache->lines);
+	free(cache);
+	target->mem_cache = NULL;
+}
+
+COMMAND_HANDLER(handle_mem_cache_add_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	uint32_t start, size;
+
+	if (CMD_ARGC != 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], start);
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], size);
+
+	/* lines are read whole, so a region must not end within one */
+	if ((start | size) & (MEM_CACHE_LINE_SIZE - 1) || size == 0
+			|| start + (uint64_t)size - 1 > UINT32_MAX) {
+		LOG_ERROR("cacheable region must be a multiple of %d bytes and aligned to it",
+				MEM_CACHE_LINE_SIZE);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	if (target->mem_cache == NULL) {
+		target->mem_cache = calloc(1, sizeof(struct mem_cache));
+		if (target->mem_cache == NULL) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+	}
+
+	struct mem_cache_region *r = malloc(sizeof(*r));
+	if (r == NULL) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	r->start = start;
+	r->size = size;
+	r->next = target->mem_cache->regions;
+	target->mem_cache->regions = r;
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_mem_cache_clear_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	mem_cache_free(get_current_target(CMD_CTX));
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_mem_cache_flush_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	mem_cache_flush(get_current_target(CMD_CTX));
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_mem_cache_stats_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct mem_cache *cache = target->mem_cache;
+
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (cache == NULL || cache->regions == NULL) {
+		command_print(CMD_CTX, "no cacheable regions for %s", target_name(target));
+		return ERROR_OK;
+	}
+
+	for (struct mem_cache_region *r = cache->regions; r; r = r->next)
+		command_print(CMD_CTX, "cacheable 0x%8.8" PRIx32 " size 0x%8.8" PRIx32,
+				r->start, r->size);
+
+	uint64_t lookups = cache->hits + cache->misses;
+	command_print(CMD_CTX, "hits %" PRIu64 " misses %" PRIu64 " (%.1f%% hit rate), "
+			"%" PRIu64 " target reads, %" PRIu64 " uncached, %" PRIu64 " flushes",
+			cache->hits, cache->misses,
+			lookups ? 100.0 * cache->hits / lookups : 0.0,
+			cache->fills, cache->bypassed, cache->flushes);
+
+	return ERROR_OK;
+}
+
+static const struct command_registration mem_cache_subcommand_handlers[] = {
+	{
+		.name = "add",
+		.handler = handle_mem_cache_add_command,
+		.mode = COMMAND_ANY,
+		.help = "let debugger reads of this range of the current target "
+			"be cached while it is halted",
+		.usage = "address size",
+	},
+	{
+		.name = "clear",
+		.handler = handle_mem_cache_clear_command,
+		.mode = COMMAND_ANY,
+		.help = "remove all cacheable regions of the current target",
+		.usage = "",
+	},
+	{
+		.name = "flush",
+		.handler = handle_mem_cache_flush_command,
+		.mode = COMMAND_EXEC,
+		.help = "drop all cached memory of the current target",
+		.usage = "",
+	},
+	{
+		.name = "stats",
+		.handler = handle_mem_cache_stats_command,
+		.mode = COMMAND_EXEC,
+		.help = "show cacheable regions and hit/miss counts",
+		.usage = "",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+const struct command_registration mem_cache_command_handlers[] = {
+	{
+		.name = "mem_cache",
+		.mode = COMMAND_ANY,
+		.help = "memory read cache for debugger sessions",
+		.usage = "",
+		.chain = mem_cache_subcommand_handlers,
+	},
+	COMMAND_REGISTRATION_DONE
+};
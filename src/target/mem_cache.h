@@ -0,0 +1,45 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.           *
+ ***************************************************************************/
+
+#ifndef MEM_CACHE_H
+#define MEM_CACHE_H
+
+#include <helper/command.h>
+
+struct target;
+
+/**
+ * Reads @a size bytes at @a address like target_read_buffer(), served
+ * from the memory cache of the target where the range lies in a region
+ * marked cacheable and the target is halted.  Used for debugger reads,
+ * which ask for the same few lines again and again while stopped.
+ */
+int mem_cache_read(struct target *target, uint32_t address,
+		uint32_t size, uint8_t *buffer);
+
+/** Drops whatever the cache holds of the given range. */
+void mem_cache_invalidate(struct target *target, uint32_t address, uint32_t size);
+
+/** Drops all cached lines, when the target ran or was reset. */
+void mem_cache_flush(struct target *target);
+
+/** Frees the cache and its list of regions. */
+void mem_cache_free(struct target *target);
+
+extern const struct command_registration mem_cache_command_handlers[];
+
+#endif /* MEM_CACHE_H */
@@ -52,16 +52,15 @@ void mips_ejtag_set_instr(struct mips_ejtag *ejtag_info, int new_instr)
 
 int mips_ejtag_get_idcode(struct mips_ejtag *ejtag_info, uint32_t *idcode)
 {
-	struct scan_field field;
-	uint8_t r[4];
+	struct scan_field_u32 field;
 
 	mips_ejtag_set_instr(ejtag_info, EJTAG_INST_IDCODE);
 
 	field.num_bits = 32;
-	field.out_value = NULL;
-	field.in_value = r;
+	field.out_value = 0;
+	field.in_value = idcode;
 
-	jtag_add_dr_scan(ejtag_info->tap, 1, &field, TAP_IDLE);
+	jtag_add_dr_scan_u32(ejtag_info->tap, 1, &field, TAP_IDLE);
 
 	int retval;
 	retval = jtag_execute_queue();
@@ -70,23 +69,20 @@ int mips_ejtag_get_idcode(struct mips_ejtag *ejtag_info, uint32_t *idcode)
 		return retval;
 	}
 
-	*idcode = buf_get_u32(field.in_value, 0, 32);
-
 	return ERROR_OK;
 }
 
 static int mips_ejtag_get_impcode(struct mips_ejtag *ejtag_info, uint32_t *impcode)
 {
-	struct scan_field field;
-	uint8_t r[4];
+	struct scan_field_u32 field;
 
 	mips_ejtag_set_instr(ejtag_info, EJTAG_INST_IMPCODE);
 
 	field.num_bits = 32;
-	field.out_value = NULL;
-	field.in_value = r;
+	field.out_value = 0;
+	field.in_value = impcode;
 
-	jtag_add_dr_scan(ejtag_info->tap, 1, &field, TAP_IDLE);
+	jtag_add_dr_scan_u32(ejtag_info->tap, 1, &field, TAP_IDLE);
 
 	int retval;
 	retval = jtag_execute_queue();
@@ -95,8 +91,6 @@ static int mips_ejtag_get_impcode(struct mips_ejtag *ejtag_info, uint32_t *impco
 		return retval;
 	}
 
-	*impcode = buf_get_u32(field.in_value, 0, 32);
-
 	return ERROR_OK;
 }
 
@@ -129,16 +123,14 @@ int mips_ejtag_drscan_32(struct mips_ejtag *ejtag_info, uint32_t *data)
 	tap  = ejtag_info->tap;
 	assert(tap != NULL);
 
-	struct scan_field field;
-	uint8_t t[4], r[4];
+	struct scan_field_u32 field;
 	int retval;
 
 	field.num_bits = 32;
-	field.out_value = t;
-	buf_set_u32(t, 0, field.num_bits, *data);
-	field.in_value = r;
+	field.out_value = *data;
+	field.in_value = data;
 
-	jtag_add_dr_scan(tap, 1, &field, TAP_IDLE);
+	jtag_add_dr_scan_u32(tap, 1, &field, TAP_IDLE);
 
 	retval = jtag_execute_queue();
 	if (retval != ERROR_OK) {
@@ -146,8 +138,6 @@ int mips_ejtag_drscan_32(struct mips_ejtag *ejtag_info, uint32_t *data)
 		return retval;
 	}
 
-	*data = buf_get_u32(field.in_value, 0, 32);
-
 	keep_alive();
 
 	return ERROR_OK;
@@ -155,20 +145,17 @@ int mips_ejtag_drscan_32(struct mips_ejtag *ejtag_info, uint32_t *data)
 
 void mips_ejtag_drscan_32_out(struct mips_ejtag *ejtag_info, uint32_t data)
 {
-	uint8_t t[4];
 	struct jtag_tap *tap;
 	tap  = ejtag_info->tap;
 	assert(tap != NULL);
 
-	struct scan_field field;
+	struct scan_field_u32 field;
 
 	field.num_bits = 32;
-	field.out_value = t;
-	buf_set_u32(t, 0, field.num_bits, data);
-
+	field.out_value = data;
 	field.in_value = NULL;
 
-	jtag_add_dr_scan(tap, 1, &field, TAP_IDLE);
+	jtag_add_dr_scan_u32(tap, 1, &field, TAP_IDLE);
 }
 
 int mips_ejtag_drscan_8(struct mips_ejtag *ejtag_info, uint32_t *data)
@@ -177,16 +164,14 @@ int mips_ejtag_drscan_8(struct mips_ejtag *ejtag_info, uint32_t *data)
 	tap  = ejtag_info->tap;
 	assert(tap != NULL);
 
-	struct scan_field field;
-	uint8_t t[4] = {0, 0, 0, 0}, r[4];
+	struct scan_field_u32 field;
 	int retval;
 
 	field.num_bits = 8;
-	field.out_value = t;
-	buf_set_u32(t, 0, field.num_bits, *data);
-	field.in_value = r;
+	field.out_value = *data;
+	field.in_value = data;
 
-	jtag_add_dr_scan(tap, 1, &field, TAP_IDLE);
+	jtag_add_dr_scan_u32(tap, 1, &field, TAP_IDLE);
 
 	retval = jtag_execute_queue();
 	if (retval != ERROR_OK) {
@@ -194,8 +179,6 @@ int mips_ejtag_drscan_8(struct mips_ejtag *ejtag_info, uint32_t *data)
 		return retval;
 	}
 
-	*data = buf_get_u32(field.in_value, 0, 32);
-
 	return ERROR_OK;
 }
 
@@ -205,13 +188,13 @@ void mips_ejtag_drscan_8_out(struct mips_ejtag *ejtag_info, uint8_t data)
 	tap  = ejtag_info->tap;
 	assert(tap != NULL);
 
-	struct scan_field field;
+	struct scan_field_u32 field;
 
 	field.num_bits = 8;
-	field.out_value = &data;
+	field.out_value = data;
 	field.in_value = NULL;
 
-	jtag_add_dr_scan(tap, 1, &field, TAP_IDLE);
+	jtag_add_dr_scan_u32(tap, 1, &field, TAP_IDLE);
 }
 
 /* Set (to enable) or clear (to disable stepping) the SSt bit (bit 8) in Cp0 Debug reg (reg 23, sel 0) */
@@ -451,30 +434,25 @@ int mips_ejtag_fastdata_scan(struct mips_ejtag *ejtag_info, int write_t, uint32_
 	tap = ejtag_info->tap;
 	assert(tap != NULL);
 
-	struct scan_field fields[2];
-	uint8_t spracc = 0;
-	uint8_t t[4] = {0, 0, 0, 0};
+	struct scan_field_u32 fields[2];
 
 	/* fastdata 1-bit register */
 	fields[0].num_bits = 1;
-	fields[0].out_value = &spracc;
+	fields[0].out_value = 0;
 	fields[0].in_value = NULL;
 
 	/* processor access data register 32 bit */
 	fields[1].num_bits = 32;
-	fields[1].out_value = t;
 
 	if (write_t) {
+		fields[1].out_value = *data;
 		fields[1].in_value = NULL;
-		buf_set_u32(t, 0, 32, *data);
-	} else
-		fields[1].in_value = (uint8_t *) data;
-
-	jtag_add_dr_scan(tap, 2, fields, TAP_IDLE);
+	} else {
+		fields[1].out_value = 0;
+		fields[1].in_value = data;
+	}
 
-	if (!write_t && data)
-		jtag_add_callback(mips_le_to_h_u32,
-			(jtag_callback_data_t) data);
+	jtag_add_dr_scan_u32(tap, 2, fields, TAP_IDLE);
 
 	keep_alive();
 
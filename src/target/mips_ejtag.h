@@ -228,10 +228,4 @@ int mips_ejtag_fastdata_scan(struct mips_ejtag *ejtag_info, int write_t, uint32_
 int mips_ejtag_init(struct mips_ejtag *ejtag_info);
 int mips_ejtag_config_step(struct mips_ejtag *ejtag_info, int enable_step);
 
-static inline void mips_le_to_h_u32(jtag_callback_data_t arg)
-{
-	uint8_t *in = (uint8_t *)arg;
-	*((uint32_t *)arg) = le_to_h_u32(in);
-}
-
 #endif /* MIPS_EJTAG */
@@ -2487,19 +2487,24 @@ int nds32_gdb_fileio_end(struct target *target, int retcode, int fileio_errno, b
 	return ERROR_OK;
 }
 
-int nds32_profiling(struct target *target, uint32_t *samples,
-			uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
+int nds32_profiling(struct target *target, struct target_profile *prof,
+		uint32_t seconds)
 {
 	/* sample $PC every 10 milliseconds */
 	uint32_t iteration = seconds * 100;
 	struct aice_port_s *aice = target_to_aice(target);
 	struct nds32 *nds32 = target_to_nds32(target);
+	uint32_t *samples, num_samples = 0;
 
-	if (max_num_samples < iteration)
-		iteration = max_num_samples;
+	samples = target_profile_reserve(prof, iteration);
+	if (samples == NULL) {
+		LOG_ERROR("No memory to store samples.");
+		return ERROR_FAIL;
+	}
 
 	int pc_regnum = nds32->register_map(nds32, PC);
-	aice_profiling(aice, 10, iteration, pc_regnum, samples, num_samples);
+	aice_profiling(aice, 10, iteration, pc_regnum, samples, &num_samples);
+	prof->num_samples += num_samples;
 
 	register_cache_invalidate(nds32->core_cache);
 
@@ -1206,8 +1206,8 @@ static int or1k_checksum_memory(struct target *target, uint32_t address,
 	return ERROR_FAIL;
 }
 
-static int or1k_profiling(struct target *target, uint32_t *samples,
-		uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
+static int or1k_profiling(struct target *target, struct target_profile *prof,
+		uint32_t seconds)
 {
 	struct timeval timeout, now;
 	struct or1k_common *or1k = target_to_or1k(target);
@@ -1229,8 +1229,6 @@ static int or1k_profiling(struct target *target, uint32_t *samples,
 		return retval;
 	}
 
-	uint32_t sample_count = 0;
-
 	for (;;) {
 		uint32_t reg_value;
 		retval = du_core->or1k_jtag_read_cpu(&or1k->jtag, GROUP0 + 16 /* NPC */, 1, &reg_value);
@@ -1239,17 +1237,22 @@ static int or1k_profiling(struct target *target, uint32_t *samples,
 			return retval;
 		}
 
-		samples[sample_count++] = reg_value;
+		uint32_t *sample = target_profile_reserve(prof, 1);
+		if (sample == NULL) {
+			LOG_ERROR("No memory to store samples.");
+			return ERROR_FAIL;
+		}
+		*sample = reg_value;
+		prof->num_samples++;
 
 		gettimeofday(&now, NULL);
-		if ((sample_count >= max_num_samples) ||
-			((now.tv_sec >= timeout.tv_sec) && (now.tv_usec >= timeout.tv_usec))) {
-			LOG_INFO("Profiling completed. %" PRIu32 " samples.", sample_count);
+		if (now.tv_sec > timeout.tv_sec ||
+			(now.tv_sec == timeout.tv_sec && now.tv_usec >= timeout.tv_usec)) {
+			LOG_INFO("Profiling completed. %" PRIu32 " samples.", prof->num_samples);
 			break;
 		}
 	}
 
-	*num_samples = sample_count;
 	return retval;
 }
 
@@ -59,6 +59,20 @@ struct reg *register_get_by_name(struct reg_cache *first,
 	return NULL;
 }
 
+/* bumped whenever the register caches of a target may have changed, so
+ * descriptions built from the caches know to regenerate */
+static unsigned reg_cache_generation;
+
+unsigned register_cache_generation(void)
+{
+	return reg_cache_generation;
+}
+
+void register_cache_changed(void)
+{
+	reg_cache_generation++;
+}
+
 struct reg_cache **register_get_last_cache_p(struct reg_cache **first)
 {
 	struct reg_cache **cache_p = first;
@@ -74,6 +88,7 @@ struct reg_cache **register_get_last_cache_p(struct reg_cache **first)
 
 void register_unlink_cache(struct reg_cache **cache_p, const struct reg_cache *cache)
 {
+	register_cache_changed();
 	while (*cache_p && *cache_p != cache)
 		cache_p = &((*cache_p)->next);
 	if (*cache_p)
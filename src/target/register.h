@@ -148,6 +148,16 @@ struct reg *register_get_by_name(struct reg_cache *first,
 struct reg_cache **register_get_last_cache_p(struct reg_cache **first);
 void register_unlink_cache(struct reg_cache **cache_p, const struct reg_cache *cache);
 void register_cache_invalidate(struct reg_cache *cache);
+/** @returns A counter that changes whenever register caches are added,
+ * removed or reshaped on any target, see register_cache_changed(). */
+unsigned register_cache_generation(void);
+/**
+ * Tells users of register_cache_generation() that the set of registers
+ * changed: a cache was linked or unlinked, or the @c num_regs or
+ * @c exist fields of a linked cache changed.  Examining a target counts
+ * as a change.
+ */
+void register_cache_changed(void);
 
 void register_init_dummy(struct reg *reg);
 
@@ -54,6 +54,7 @@
 #include "register.h"
 #include "trace.h"
 #include "image.h"
+#include "mem_cache.h"
 #include "rtos/rtos.h"
 #include "transport/transport.h"
 
@@ -73,8 +74,6 @@ static int target_get_gdb_fileio_info_default(struct target *target,
 		struct gdb_fileio_info *fileio_info);
 static int target_gdb_fileio_end_default(struct target *target, int retcode,
 		int fileio_errno, bool ctrl_c);
-static int target_profiling_default(struct target *target, uint32_t *samples,
-		uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds);
 
 /* targets */
 extern struct target_type arm7tdmi_target;
@@ -784,6 +783,7 @@ int target_run_algorithm(struct target *target,
 		goto done;
 	}
 
+	mem_cache_flush(target);
 	target->running_alg = true;
 	retval = target->type->run_algorithm(target,
 			num_mem_params, mem_params,
@@ -824,6 +824,7 @@ int target_start_algorithm(struct target *target,
 		goto done;
 	}
 
+	mem_cache_flush(target);
 	target->running_alg = true;
 	retval = target->type->start_algorithm(target,
 			num_mem_params, mem_params,
@@ -1054,6 +1055,7 @@ int target_write_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	mem_cache_invalidate(target, address, size * count);
 	return target->type->write_memory(target, address, size, count, buffer);
 }
 
@@ -1068,6 +1070,8 @@ int target_write_phys_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_phys_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	/* the cache holds virtual addresses */
+	mem_cache_flush(target);
 	return target->type->write_phys_memory(target, address, size, count, buffer);
 }
 
@@ -1078,6 +1082,8 @@ int target_add_breakpoint(struct target *target,
 		LOG_WARNING("target %s is not halted", target_name(target));
 		return ERROR_TARGET_NOT_HALTED;
 	}
+	/* software breakpoints patch memory */
+	mem_cache_invalidate(target, breakpoint->address, breakpoint->length);
 	return target->type->add_breakpoint(target, breakpoint);
 }
 
@@ -1098,12 +1104,14 @@ int target_add_hybrid_breakpoint(struct target *target,
 		LOG_WARNING("target %s is not halted", target_name(target));
 		return ERROR_TARGET_NOT_HALTED;
 	}
+	mem_cache_invalidate(target, breakpoint->address, breakpoint->length);
 	return target->type->add_hybrid_breakpoint(target, breakpoint);
 }
 
 int target_remove_breakpoint(struct target *target,
 		struct breakpoint *breakpoint)
 {
+	mem_cache_invalidate(target, breakpoint->address, breakpoint->length);
 	return target->type->remove_breakpoint(target, breakpoint);
 }
 
@@ -1148,6 +1156,7 @@ int target_get_gdb_reg_list(struct target *target,
 int target_step(struct target *target,
 		int current, uint32_t address, int handle_breakpoints)
 {
+	mem_cache_flush(target);
 	return target->type->step(target, current, address, handle_breakpoints);
 }
 
@@ -1169,15 +1178,34 @@ int target_gdb_fileio_end(struct target *target, int retcode, int fileio_errno,
 	return target->type->gdb_fileio_end(target, retcode, fileio_errno, ctrl_c);
 }
 
-int target_profiling(struct target *target, uint32_t *samples,
-			uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
+uint32_t *target_profile_reserve(struct target_profile *prof, uint32_t count)
+{
+	if (count > UINT32_MAX / sizeof(uint32_t) - prof->num_samples)
+		return NULL;
+
+	if (prof->num_samples + count > prof->max_samples) {
+		uint32_t max = MAX(prof->num_samples + count, 2 * prof->max_samples);
+		if (max > UINT32_MAX / sizeof(uint32_t))
+			max = prof->num_samples + count;
+
+		uint32_t *samples = realloc(prof->samples, max * sizeof(uint32_t));
+		if (samples == NULL)
+			return NULL;
+		prof->samples = samples;
+		prof->max_samples = max;
+	}
+
+	return prof->samples + prof->num_samples;
+}
+
+int target_profiling(struct target *target, struct target_profile *prof,
+		uint32_t seconds)
 {
 	if (target->state != TARGET_HALTED) {
 		LOG_WARNING("target %s is not halted", target->cmd_name);
 		return ERROR_TARGET_NOT_HALTED;
 	}
-	return target->type->profiling(target, samples, max_num_samples,
-			num_samples, seconds);
+	return target->type->profiling(target, prof, seconds);
 }
 
 /**
@@ -1210,6 +1238,7 @@ static int target_init_one(struct command_context *cmd_ctx,
 		LOG_ERROR("target '%s' init failed", target_name(target));
 		return retval;
 	}
+	register_cache_changed();
 
 	/* Sanity-check MMU support ... stub in what we must, to help
 	 * implement it in stages, but warn if we need to do so.
@@ -1498,6 +1527,28 @@ int target_call_event_callbacks(struct target *target, enum target_event event)
 	LOG_DEBUG("target event %i (%s)", event,
 			Jim_Nvp_value2name_simple(nvp_target_event, event)->name);
 
+	/* whatever the target did meanwhile, cached memory is stale */
+	switch (event) {
+		case TARGET_EVENT_HALTED:
+		case TARGET_EVENT_RESUMED:
+		case TARGET_EVENT_RESUME_START:
+		case TARGET_EVENT_DEBUG_HALTED:
+		case TARGET_EVENT_DEBUG_RESUMED:
+		case TARGET_EVENT_RESET_START:
+		case TARGET_EVENT_RESET_END:
+		case TARGET_EVENT_EXAMINE_END:
+		case TARGET_EVENT_GDB_FLASH_ERASE_END:
+		case TARGET_EVENT_GDB_FLASH_WRITE_END:
+			mem_cache_flush(target);
+			break;
+		default:
+			break;
+	}
+
+	/* examine may have added, dropped or resized register caches */
+	if (event == TARGET_EVENT_EXAMINE_END)
+		register_cache_changed();
+
 	target_handle_event(target, event);
 
 	while (callback) {
@@ -1868,6 +1919,7 @@ void target_quit(void)
 	     target; target = target->next) {
 		if (target->type->deinit_target)
 			target->type->deinit_target(target);
+		mem_cache_free(target);
 	}
 }
 
@@ -1956,8 +2008,8 @@ static int target_gdb_fileio_end_default(struct target *target,
 	return ERROR_OK;
 }
 
-static int target_profiling_default(struct target *target, uint32_t *samples,
-		uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
+int target_profiling_default(struct target *target, struct target_profile *prof,
+		uint32_t seconds)
 {
 	struct timeval timeout, now;
 
@@ -1967,7 +2019,6 @@ static int target_profiling_default(struct target *target, uint32_t *samples,
 	LOG_INFO("Starting profiling. Halting and resuming the"
 			" target as often as we can...");
 
-	uint32_t sample_count = 0;
 	/* hopefully it is safe to cache! We want to stop/restart as quickly as possible. */
 	struct reg *reg = register_get_by_name(target->reg_cache, "pc", 1);
 
@@ -1975,8 +2026,14 @@ static int target_profiling_default(struct target *target, uint32_t *samples,
 	for (;;) {
 		target_poll(target);
 		if (target->state == TARGET_HALTED) {
-			uint32_t t = buf_get_u32(reg->value, 0, 32);
-			samples[sample_count++] = t;
+			uint32_t *sample = target_profile_reserve(prof, 1);
+			if (sample == NULL) {
+				LOG_ERROR("No memory to store samples.");
+				retval = ERROR_FAIL;
+				break;
+			}
+			*sample = buf_get_u32(reg->value, 0, 32);
+			prof->num_samples++;
 			/* current pc, addr = 0, do not handle breakpoints, not debugging */
 			retval = target_resume(target, 1, 0, 0, 0);
 			target_poll(target);
@@ -1994,14 +2051,13 @@ static int target_profiling_default(struct target *target, uint32_t *samples,
 			break;
 
 		gettimeofday(&now, NULL);
-		if ((sample_count >= max_num_samples) ||
-			((now.tv_sec >= timeout.tv_sec) && (now.tv_usec >= timeout.tv_usec))) {
-			LOG_INFO("Profiling completed. %" PRIu32 " samples.", sample_count);
+		if (now.tv_sec > timeout.tv_sec ||
+			(now.tv_sec == timeout.tv_sec && now.tv_usec >= timeout.tv_usec)) {
+			LOG_INFO("Profiling completed. %" PRIu32 " samples.", prof->num_samples);
 			break;
 		}
 	}
 
-	*num_samples = sample_count;
 	return retval;
 }
 
@@ -2030,6 +2086,7 @@ int target_write_buffer(struct target *target, uint32_t address, uint32_t size,
 		return ERROR_FAIL;
 	}
 
+	mem_cache_invalidate(target, address, size);
 	return target->type->write_buffer(target, address, size, buffer);
 }
 
@@ -3689,8 +3746,10 @@ static void writeString(FILE *f, char *s)
 
 typedef unsigned char UNIT[2];  /* unit of profiling */
 
-/* Dump a gmon.out histogram file. */
-static void write_gmon(uint32_t *samples, uint32_t sampleNum, const char *filename, bool with_range,
+/* Dump a gmon.out histogram file.  Each sample counts once, or
+ * counts[i] times if counts isn't NULL. */
+static void write_gmon(const uint32_t *samples, const uint32_t *counts, uint32_t sampleNum,
+			const char *filename, bool with_range,
 			uint32_t start_address, uint32_t end_address, struct target *target)
 {
 	uint32_t i;
@@ -3752,7 +3811,9 @@ static void write_gmon(uint32_t *samples, uint32_t sampleNum, const char *filena
 		long long b = numBuckets;
 		long long c = addressSpace;
 		int index_t = (a * b) / c; /* danger!!!! int32 overflows */
-		buckets[index_t]++;
+		/* more than fits the file doesn't matter */
+		long long count = buckets[index_t] + (long long)(counts ? counts[i] : 1);
+		buckets[index_t] = count > 65535 ? 65535 : count;
 	}
 
 	/* append binary memory gmon.out &profile_hist_hdr ((char*)&profile_hist_hdr + sizeof(struct gmon_hist_hdr)) */
@@ -3786,26 +3847,358 @@ static void write_gmon(uint32_t *samples, uint32_t sampleNum, const char *filena
 	fclose(f);
 }
 
+/*
+ * 'profile -stream' keeps sampling the PC of a running target from a
+ * timer callback, one quick batch per tick, and folds the samples into a
+ * histogram with a counter per PC.  Memory grows with the code the target
+ * runs, not with the time it runs.  Snapshots of the histogram go to a
+ * gmon.out file and a folded text file every period.
+ */
+struct profile_stream {
+	struct target *target;
+	char *filename;
+	char *folded_filename;
+	int64_t period_ms;
+	int64_t next_snapshot;
+	bool with_range;
+	uint32_t start_address;
+	uint32_t end_address;
+
+	/* scratch buffer for one batch */
+	struct target_profile batch;
+
+	/* open addressing hash of PC to count, a count of 0 is a free slot */
+	uint32_t *pcs;
+	uint32_t *counts;
+	uint32_t num_pcs;
+	uint32_t hash_size;
+
+	uint64_t num_samples;
+};
+
+/* sampling ticks, in ms */
+#define PROFILE_STREAM_TICK 1
+
+static struct profile_stream *profile_stream;
+
+static unsigned profile_stream_hash(uint32_t pc, uint32_t hash_size)
+{
+	/* Thumb and ARM PCs are at least halfword aligned */
+	return ((pc >> 1) * 2654435761u) & (hash_size - 1);
+}
+
+static int profile_stream_grow(struct profile_stream *ps)
+{
+	uint32_t size = ps->hash_size ? 2 * ps->hash_size : 1024;
+	uint32_t *pcs = calloc(size, sizeof(uint32_t));
+	uint32_t *counts = calloc(size, sizeof(uint32_t));
+
+	if (pcs == NULL || counts == NULL) {
+		free(pcs);
+		free(counts);
+		return ERROR_FAIL;
+	}
+
+	for (uint32_t i = 0; i < ps->hash_size; i++) {
+		if (!ps->counts[i])
+			continue;
+		unsigned h = profile_stream_hash(ps->pcs[i], size);
+		while (counts[h])
+			h = (h + 1) & (size - 1);
+		pcs[h] = ps->pcs[i];
+		counts[h] = ps->counts[i];
+	}
+
+	free(ps->pcs);
+	free(ps->counts);
+	ps->pcs = pcs;
+	ps->counts = counts;
+	ps->hash_size = size;
+	return ERROR_OK;
+}
+
+static int profile_stream_add(struct profile_stream *ps, uint32_t pc)
+{
+	if (ps->with_range && (pc < ps->start_address || pc >= ps->end_address))
+		return ERROR_OK;
+
+	/* keep the hash at most half full */
+	if (2 * (ps->num_pcs + 1) > ps->hash_size) {
+		if (profile_stream_grow(ps) != ERROR_OK) {
+			LOG_ERROR("No memory for the profile histogram.");
+			return ERROR_FAIL;
+		}
+	}
+
+	unsigned h = profile_stream_hash(pc, ps->hash_size);
+	while (ps->counts[h] && ps->pcs[h] != pc)
+		h = (h + 1) & (ps->hash_size - 1);
+
+	if (!ps->counts[h]) {
+		ps->pcs[h] = pc;
+		ps->num_pcs++;
+	}
+	if (ps->counts[h] < UINT32_MAX)
+		ps->counts[h]++;
+	ps->num_samples++;
+	return ERROR_OK;
+}
+
+struct profile_bucket {
+	uint32_t pc;
+	uint32_t count;
+};
+
+static int profile_bucket_compare(const void *a, const void *b)
+{
+	const struct profile_bucket *ba = a, *bb = b;
+
+	if (ba->count != bb->count)
+		return ba->count > bb->count ? -1 : 1;
+	return ba->pc < bb->pc ? -1 : ba->pc > bb->pc;
+}
+
+/* the histogram as PCs and counts, most samples first */
+static int profile_stream_sorted(struct profile_stream *ps,
+		uint32_t **pcs_out, uint32_t **counts_out)
+{
+	uint32_t n = MAX(ps->num_pcs, 1u);
+	struct profile_bucket *buckets = malloc(n * sizeof(*buckets));
+	uint32_t *pcs = malloc(n * sizeof(uint32_t));
+	uint32_t *counts = malloc(n * sizeof(uint32_t));
+
+	if (buckets == NULL || pcs == NULL || counts == NULL) {
+		free(buckets);
+		free(pcs);
+		free(counts);
+		return ERROR_FAIL;
+	}
+
+	n = 0;
+	for (uint32_t i = 0; i < ps->hash_size; i++) {
+		if (ps->counts[i]) {
+			buckets[n].pc = ps->pcs[i];
+			buckets[n++].count = ps->counts[i];
+		}
+	}
+	qsort(buckets, n, sizeof(*buckets), profile_bucket_compare);
+
+	for (uint32_t i = 0; i < n; i++) {
+		pcs[i] = buckets[i].pc;
+		counts[i] = buckets[i].count;
+	}
+	free(buckets);
+
+	*pcs_out = pcs;
+	*counts_out = counts;
+	return ERROR_OK;
+}
+
+static void profile_stream_snapshot(struct profile_stream *ps)
+{
+	uint32_t *pcs, *counts;
+
+	if (ps->num_pcs == 0)
+		return;
+
+	if (profile_stream_sorted(ps, &pcs, &counts) != ERROR_OK) {
+		LOG_ERROR("No memory for the profile snapshot.");
+		return;
+	}
+
+	write_gmon(pcs, counts, ps->num_pcs, ps->filename,
+		   ps->with_range, ps->start_address, ps->end_address, ps->target);
+
+	/* one "frame count" line per PC, as stack collapsing tools write */
+	FILE *f = fopen(ps->folded_filename, "w");
+	if (f != NULL) {
+		for (uint32_t i = 0; i < ps->num_pcs; i++)
+			fprintf(f, "0x%8.8" PRIx32 " %" PRIu32 "\n", pcs[i], counts[i]);
+		fclose(f);
+	} else
+		LOG_ERROR("can't open '%s' for writing", ps->folded_filename);
+
+	free(pcs);
+	free(counts);
+}
+
+static int profile_stream_tick(void *priv);
+
+static void profile_stream_stop(void)
+{
+	struct profile_stream *ps = profile_stream;
+
+	if (ps == NULL)
+		return;
+
+	target_unregister_timer_callback(profile_stream_tick, ps);
+	profile_stream_snapshot(ps);
+	LOG_INFO("Profiling stopped. %" PRIu64 " samples.", ps->num_samples);
+
+	free(ps->filename);
+	free(ps->folded_filename);
+	free(ps->batch.samples);
+	free(ps->pcs);
+	free(ps->counts);
+	free(ps);
+	profile_stream = NULL;
+}
+
+static int profile_stream_tick(void *priv)
+{
+	struct profile_stream *ps = priv;
+	struct target *target = ps->target;
+	int retval = ERROR_OK;
+
+	/* a halted target is left alone, sampling goes on once it runs */
+	if (target->state == TARGET_RUNNING) {
+		ps->batch.num_samples = 0;
+		retval = target->type->profile_batch(target, &ps->batch);
+		for (uint32_t i = 0; i < ps->batch.num_samples && retval == ERROR_OK; i++)
+			retval = profile_stream_add(ps, ps->batch.samples[i]);
+	}
+
+	if (retval != ERROR_OK) {
+		LOG_ERROR("Profiling of %s failed, stopping.", target_name(target));
+		profile_stream_stop();
+		return retval;
+	}
+
+	if (timeval_ms() >= ps->next_snapshot) {
+		profile_stream_snapshot(ps);
+		ps->next_snapshot = timeval_ms() + ps->period_ms;
+	}
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_profile_stream_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	uint32_t period, start_address = 0, end_address = 0;
+
+	/* -stream period filename [start end] */
+	if ((CMD_ARGC != 3) && (CMD_ARGC != 5))
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], period);
+	if (CMD_ARGC == 5) {
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[3], start_address);
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[4], end_address);
+	}
+	if (period == 0)
+		period = 1;
+
+	if (target->type->profile_batch == NULL) {
+		LOG_ERROR("%s can't sample the PC without halting, use 'profile seconds filename'",
+			target_name(target));
+		return ERROR_FAIL;
+	}
+
+	profile_stream_stop();
+
+	struct profile_stream *ps = calloc(1, sizeof(*ps));
+	if (ps == NULL) {
+		LOG_ERROR("No memory to store samples.");
+		return ERROR_FAIL;
+	}
+
+	ps->target = target;
+	ps->with_range = CMD_ARGC == 5;
+	ps->start_address = start_address;
+	ps->end_address = end_address;
+	ps->period_ms = period * 1000LL;
+	ps->next_snapshot = timeval_ms() + ps->period_ms;
+	ps->filename = strdup(CMD_ARGV[2]);
+	ps->folded_filename = alloc_printf("%s.folded", CMD_ARGV[2]);
+	profile_stream = ps;
+
+	if (ps->filename == NULL || ps->folded_filename == NULL
+			|| profile_stream_grow(ps) != ERROR_OK) {
+		LOG_ERROR("No memory to store samples.");
+		profile_stream_stop();
+		return ERROR_FAIL;
+	}
+
+	/* the stream samples a running target */
+	int retval = target_poll(target);
+	if (retval == ERROR_OK && target->state == TARGET_HALTED)
+		retval = target_resume(target, 1, 0, 0, 0);
+	if (retval == ERROR_OK)
+		retval = target_register_timer_callback(profile_stream_tick,
+				PROFILE_STREAM_TICK, 1, ps);
+	if (retval != ERROR_OK) {
+		profile_stream_stop();
+		return retval;
+	}
+
+	command_print(CMD_CTX, "Profiling %s, writing %s and %s every %" PRIu32 " s",
+			target_name(target), ps->filename, ps->folded_filename, period);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_profile_top_command)
+{
+	struct profile_stream *ps = profile_stream;
+	uint32_t *pcs, *counts;
+	uint32_t top = 10;
+
+	/* -top [count] */
+	if (CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	if (CMD_ARGC == 2)
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], top);
+
+	if (ps == NULL) {
+		LOG_ERROR("No profile stream running, see 'profile -stream'.");
+		return ERROR_FAIL;
+	}
+
+	if (profile_stream_sorted(ps, &pcs, &counts) != ERROR_OK) {
+		LOG_ERROR("No memory for the profile snapshot.");
+		return ERROR_FAIL;
+	}
+
+	for (uint32_t i = 0; i < ps->num_pcs && i < top; i++)
+		command_print(CMD_CTX, "0x%8.8" PRIx32 " %" PRIu32 " %.2f%%",
+				pcs[i], counts[i], 100.0 * counts[i] / ps->num_samples);
+
+	free(pcs);
+	free(counts);
+	return ERROR_OK;
+}
+
 /* profiling samples the CPU PC as quickly as OpenOCD is able,
  * which will be used as a random sampling of PC */
 COMMAND_HANDLER(handle_profile_command)
 {
 	struct target *target = get_current_target(CMD_CTX);
 
+	if (CMD_ARGC >= 1 && strcmp(CMD_ARGV[0], "-stream") == 0)
+		return CALL_COMMAND_HANDLER(handle_profile_stream_command);
+	if (CMD_ARGC >= 1 && strcmp(CMD_ARGV[0], "-top") == 0)
+		return CALL_COMMAND_HANDLER(handle_profile_top_command);
+	if (CMD_ARGC == 1 && strcmp(CMD_ARGV[0], "-stop") == 0) {
+		profile_stream_stop();
+		return ERROR_OK;
+	}
+
 	if ((CMD_ARGC != 2) && (CMD_ARGC != 4))
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
-	const uint32_t MAX_PROFILE_SAMPLE_NUM = 10000;
+	struct target_profile prof = { .samples = NULL };
 	uint32_t offset;
-	uint32_t num_of_samples;
 	int retval = ERROR_OK;
 
 	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], offset);
 
-	uint32_t *samples = malloc(sizeof(uint32_t) * MAX_PROFILE_SAMPLE_NUM);
-	if (samples == NULL) {
-		LOG_ERROR("No memory to store samples.");
-		return ERROR_FAIL;
+	uint32_t start_address = 0;
+	uint32_t end_address = 0;
+	bool with_range = false;
+	if (CMD_ARGC == 4) {
+		with_range = true;
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[2], start_address);
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[3], end_address);
 	}
 
 	/**
@@ -3813,48 +4206,42 @@ COMMAND_HANDLER(handle_profile_command)
 	 * annoying halt/resume step; for example, ARMv7 PCSR.
 	 * Provide a way to use that more efficient mechanism.
 	 */
-	retval = target_profiling(target, samples, MAX_PROFILE_SAMPLE_NUM,
-				&num_of_samples, offset);
+	retval = target_profiling(target, &prof, offset);
 	if (retval != ERROR_OK) {
-		free(samples);
+		free(prof.samples);
 		return retval;
 	}
 
-	assert(num_of_samples <= MAX_PROFILE_SAMPLE_NUM);
-
 	retval = target_poll(target);
 	if (retval != ERROR_OK) {
-		free(samples);
+		free(prof.samples);
 		return retval;
 	}
 	if (target->state == TARGET_RUNNING) {
 		retval = target_halt(target);
 		if (retval != ERROR_OK) {
-			free(samples);
+			free(prof.samples);
 			return retval;
 		}
 	}
 
 	retval = target_poll(target);
 	if (retval != ERROR_OK) {
-		free(samples);
+		free(prof.samples);
 		return retval;
 	}
 
-	uint32_t start_address = 0;
-	uint32_t end_address = 0;
-	bool with_range = false;
-	if (CMD_ARGC == 4) {
-		with_range = true;
-		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[2], start_address);
-		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[3], end_address);
+	if (prof.num_samples == 0) {
+		LOG_ERROR("No samples taken.");
+		free(prof.samples);
+		return ERROR_FAIL;
 	}
 
-	write_gmon(samples, num_of_samples, CMD_ARGV[1],
+	write_gmon(prof.samples, NULL, prof.num_samples, CMD_ARGV[1],
 		   with_range, start_address, end_address, target);
 	command_print(CMD_CTX, "Wrote %s", CMD_ARGV[1]);
 
-	free(samples);
+	free(prof.samples);
 	return retval;
 }
 
@@ -4853,6 +5240,7 @@ static int jim_target_examine(Jim_Interp *interp, int argc, Jim_Obj *const *argv
 		return jim_target_tap_disabled(interp);
 
 	int e = target->type->examine(target);
+	register_cache_changed();
 	if (e != ERROR_OK)
 		return JIM_ERR;
 	return JIM_OK;
@@ -5703,6 +6091,9 @@ static const struct command_registration target_command_handlers[] = {
 
 		.chain = target_subcommand_handlers,
 	},
+	{
+		.chain = mem_cache_command_handlers,
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -5960,8 +6351,10 @@ static const struct command_registration target_exec_command_handlers[] = {
 		.name = "profile",
 		.handler = handle_profile_command,
 		.mode = COMMAND_EXEC,
-		.usage = "seconds filename [start end]",
-		.help = "profiling samples the CPU PC",
+		.usage = "seconds filename [start end] | "
+			"-stream period filename [start end] | -top [count] | -stop",
+		.help = "profiling samples the CPU PC, for some seconds or "
+			"continuously into a histogram",
 	},
 	/** @todo don't register virt2phys() unless target supports it */
 	{
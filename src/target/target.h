@@ -44,6 +44,7 @@ struct mem_param;
 struct reg_param;
 struct target_list;
 struct gdb_fileio_info;
+struct mem_cache;
 
 /*
  * TARGET_UNKNOWN = 0: we don't know anything about the target yet
@@ -197,6 +198,8 @@ struct target {
 
 	/* file-I/O information for host to do syscall */
 	struct gdb_fileio_info *fileio_info;
+
+	struct mem_cache *mem_cache;		/* debugger read cache, see mem_cache.c */
 };
 
 struct target_list {
@@ -598,6 +601,38 @@ int target_get_gdb_fileio_info(struct target *target, struct gdb_fileio_info *fi
  */
 int target_gdb_fileio_end(struct target *target, int retcode, int fileio_errno, bool ctrl_c);
 
+/**
+ * PC samples taken by target_profiling(), in a buffer that grows as the
+ * samples come in.  The caller frees @a samples.
+ */
+struct target_profile {
+	uint32_t *samples;
+	uint32_t num_samples;
+	uint32_t max_samples;
+};
+
+/**
+ * Makes room for @a count more samples after the @a num_samples taken.
+ *
+ * @returns where they go, or NULL if out of memory.
+ */
+uint32_t *target_profile_reserve(struct target_profile *prof, uint32_t count);
+
+/**
+ * Sample the PC of a halted target for @a seconds, leaving it running.
+ *
+ * This routine is a wrapper for target->type->profiling.
+ */
+int target_profiling(struct target *target, struct target_profile *prof,
+		uint32_t seconds);
+
+/**
+ * Profiling for targets without a way to sample the PC on the fly:
+ * halts and resumes the target as often as it can.
+ */
+int target_profiling_default(struct target *target, struct target_profile *prof,
+		uint32_t seconds);
+
 
 
 /** Return the *name* of this targets current state */
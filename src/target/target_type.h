@@ -272,10 +272,17 @@ struct target_type {
 	 */
 	int (*gdb_fileio_end)(struct target *target, int retcode, int fileio_errno, bool ctrl_c);
 
-	/* do target profiling
+	/* do target profiling: sample the PC of a halted target for @a seconds,
+	 * leaving it running.
 	 */
-	int (*profiling)(struct target *target, uint32_t *samples,
-			uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds);
+	int (*profiling)(struct target *target, struct target_profile *prof,
+			uint32_t seconds);
+
+	/* Optional: append one quick batch of PC samples of a running target
+	 * to @a prof, without changing its run state.  'profile -stream' is
+	 * only available on targets that implement it.
+	 */
+	int (*profile_batch)(struct target *target, struct target_profile *prof);
 };
 
 #endif /* TARGET_TYPE_H */